@@ -0,0 +1,34 @@
+//Replacement of <asm/io.h> to compile alt_dma.c of DMA_PL330_LKM in the host
+//PC. There is no DMAC in the host: ioremap() fails, reads return 0 and writes
+//are lost, so only the functions that assemble programs can be used.
+#ifndef _HOST_ASM_IO_H
+#define _HOST_ASM_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+static inline void* ioremap(unsigned long addr, size_t size)
+{
+  (void) addr;
+  (void) size;
+  return NULL;
+}
+
+static inline void iounmap(void* addr)
+{
+  (void) addr;
+}
+
+static inline uint32_t ioread32(const void* addr)
+{
+  (void) addr;
+  return 0;
+}
+
+static inline void iowrite32(uint32_t val, void* addr)
+{
+  (void) val;
+  (void) addr;
+}
+
+#endif
@@ -0,0 +1,20 @@
+//Replacement of <linux/kernel.h> to compile the hwlib files of DMA_PL330_LKM
+//(alt_dma_program.c and its headers) in the host PC. It gives the types and
+//functions of the kernel they use with the C library.
+#ifndef _HOST_LINUX_KERNEL_H
+#define _HOST_LINUX_KERNEL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+typedef uint8_t  u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+
+#define KERN_INFO ""
+#define printk printf
+
+#endif
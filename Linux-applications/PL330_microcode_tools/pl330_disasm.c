@@ -0,0 +1,717 @@
+/**
+ * @file    pl330_disasm.c
+ * @brief  Decoder, disassembler and validator of PL330 DMAC microcode for the
+ * host PC (see pl330_disasm.h).
+ *
+ * The encoding of the instructions is the one in the PL330 TRM (chapter 4),
+ * the same used by alt_dma_program.c to assemble them. The validator walks
+ * the microcode once, the same way the channel thread does it (there are no
+ * jumps but the ones of DMALPEND), and checks:
+ * -All the instructions are valid and complete, no manager instructions.
+ * -Loops are nested: DMALPEND closes the last loop opened, with its counter,
+ *  jumping to its first instruction, and all loops are closed.
+ * -The program ends with DMAEND.
+ * -The CCR uses beats of 8 Bytes or less, the endian swap is not bigger than
+ *  the beats and the bursts of loads and stores move the same Bytes. Loads
+ *  and stores move the same Bytes in the whole program (MFIFO empty at the
+ *  end). SAR and DAR are followed to count the shorter first beat of the
+ *  bursts from unaligned addresses.
+ * -The microcode starts in a 32B line of the instruction cache (see the
+ *  alignment rules in DMA_PL330_LKM.c) and fits in the 16 lines of the cache.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "pl330_disasm.h"
+
+#define PL330_ICACHE_LINE  ALT_DMA_PROGRAM_CACHE_LINE_SIZE
+#define PL330_ICACHE_LINES ALT_DMA_PROGRAM_CACHE_LINE_COUNT
+#define PL330_MAX_EVENT    7 //events and irqs of the DMAC in Cyclone V
+
+#define PL330_MAX_LOOPS    16 //loops nested in a program (2 with counter)
+
+struct pl330_loop {
+  uint32_t body;     //offset of the first instruction of the loop
+  uint8_t lc;
+  uint32_t count;
+};
+
+//-----------------------------DECODER-----------------------------------//
+static uint32_t pl330_imm32(const uint8_t* p)
+{
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) |
+    ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+//Condition of the bs and x bits of DMALD, DMAST and DMALPEND
+static bool pl330_cond_bsx(uint8_t b, PL330_COND_t* cond)
+{
+  switch (b & 0x3)
+  {
+    case 0x0: *cond = PL330_COND_NONE; return true;
+    case 0x1: *cond = PL330_COND_SINGLE; return true;
+    case 0x3: *cond = PL330_COND_BURST; return true;
+    default: return false;
+  }
+}
+
+bool pl330_decode(const uint8_t* code, uint32_t size, uint32_t offset,
+  PL330_INST_t* inst)
+{
+  uint8_t b;
+  uint8_t len = 1;
+  bool ok = true;
+
+  memset(inst, 0, sizeof(*inst));
+  inst->offset = offset;
+  if (offset >= size)
+    return false;
+  b = code[offset];
+
+  if ((b == 0x00) || (b == 0x01))
+    inst->op = (b == 0x00) ? PL330_OP_END : PL330_OP_KILL;
+  else if ((b & 0xFC) == 0x04)
+  {
+    inst->op = PL330_OP_LD;
+    ok = pl330_cond_bsx(b, &inst->cond);
+  }
+  else if ((b & 0xFC) == 0x08)
+  {
+    inst->op = PL330_OP_ST;
+    ok = pl330_cond_bsx(b, &inst->cond);
+  }
+  else if (b == 0x0C)
+    inst->op = PL330_OP_STZ;
+  else if ((b == 0x12) || (b == 0x13))
+    inst->op = (b == 0x12) ? PL330_OP_RMB : PL330_OP_WMB;
+  else if (b == 0x18)
+    inst->op = PL330_OP_NOP;
+  else if ((b == 0x20) || (b == 0x22))
+  {
+    inst->op = PL330_OP_LP;
+    inst->lc = (b >> 1) & 0x1;
+    len = 2;
+  }
+  else if ((b == 0x25) || (b == 0x27) || (b == 0x29) || (b == 0x2B))
+  {
+    inst->op = (b & 0x08) ? PL330_OP_STP : PL330_OP_LDP;
+    inst->cond = (b & 0x2) ? PL330_COND_BURST : PL330_COND_SINGLE;
+    len = 2;
+  }
+  else if ((b == 0x28) || (b == 0x2C) || ((b & 0xF8) == 0x38))
+  {
+    //DMALPEND: 0 0 1 nf 1 lc bs x, the end of DMALPFE (nf = 0) has no
+    //condition (0x29 and 0x2B are DMASTP)
+    inst->op = PL330_OP_LPEND;
+    inst->forever = !(b & 0x10);
+    inst->lc = (b >> 2) & 0x1;
+    ok = pl330_cond_bsx(b, &inst->cond);
+    len = 2;
+  }
+  else if ((b & 0xFC) == 0x30)
+  {
+    inst->op = PL330_OP_WFP;
+    if (b == 0x30)
+      inst->cond = PL330_COND_SINGLE;
+    else if (b == 0x31)
+      inst->cond = PL330_COND_PERIPH;
+    else if (b == 0x32)
+      inst->cond = PL330_COND_BURST;
+    else
+      ok = false;
+    len = 2;
+  }
+  else if ((b == 0x34) || (b == 0x35) || (b == 0x36))
+  {
+    inst->op = (b == 0x34) ? PL330_OP_SEV :
+      ((b == 0x35) ? PL330_OP_FLUSHP : PL330_OP_WFE);
+    len = 2;
+  }
+  else if ((b & 0xF5) == 0x54)
+  {
+    inst->op = (b & 0x08) ? PL330_OP_ADNH : PL330_OP_ADDH;
+    inst->reg = (b & 0x2) ? ALT_DMA_PROGRAM_REG_DAR : ALT_DMA_PROGRAM_REG_SAR;
+    len = 3;
+  }
+  else if ((b == 0xA0) || (b == 0xA2))
+  {
+    inst->op = PL330_OP_GO;
+    len = 6;
+  }
+  else if (b == 0xBC)
+  {
+    inst->op = PL330_OP_MOV;
+    len = 6;
+  }
+  else
+    ok = false;
+
+  if (!ok || (size - offset < len))
+  {
+    inst->op = PL330_OP_INVALID;
+    return false;
+  }
+  inst->size = len;
+
+  //operands
+  switch (inst->op)
+  {
+    case PL330_OP_LP:
+      inst->imm = (uint32_t) code[offset+1] + 1;
+      break;
+    case PL330_OP_LPEND:
+      inst->imm = code[offset+1];
+      break;
+    case PL330_OP_LDP:
+    case PL330_OP_STP:
+    case PL330_OP_WFP:
+    case PL330_OP_SEV:
+    case PL330_OP_FLUSHP:
+    case PL330_OP_WFE:
+      inst->num = code[offset+1] >> 3;
+      inst->invalidate = (inst->op == PL330_OP_WFE) &&
+        (code[offset+1] & 0x2);
+      break;
+    case PL330_OP_ADDH:
+    case PL330_OP_ADNH:
+      inst->imm = (uint32_t) code[offset+1] | ((uint32_t) code[offset+2] << 8);
+      break;
+    case PL330_OP_GO:
+      inst->num = code[offset+1] & 0x7;
+      inst->imm = pl330_imm32(&code[offset+2]);
+      break;
+    case PL330_OP_MOV:
+      inst->reg = code[offset+1];
+      inst->imm = pl330_imm32(&code[offset+2]);
+      if ((inst->reg != ALT_DMA_PROGRAM_REG_SAR) &&
+        (inst->reg != ALT_DMA_PROGRAM_REG_CCR) &&
+        (inst->reg != ALT_DMA_PROGRAM_REG_DAR))
+      {
+        inst->op = PL330_OP_INVALID;
+        inst->size = 0;
+        return false;
+      }
+      break;
+    default:
+      break;
+  }
+  return true;
+}
+
+//-----------------------------DISASSEMBLER------------------------------//
+static const char* pl330_reg_name(uint8_t reg)
+{
+  switch (reg)
+  {
+    case ALT_DMA_PROGRAM_REG_SAR: return "SAR";
+    case ALT_DMA_PROGRAM_REG_CCR: return "CCR";
+    case ALT_DMA_PROGRAM_REG_DAR: return "DAR";
+    default: return "?";
+  }
+}
+
+static const char* pl330_cond_suffix(PL330_COND_t cond)
+{
+  switch (cond)
+  {
+    case PL330_COND_SINGLE: return "S";
+    case PL330_COND_BURST: return "B";
+    default: return "";
+  }
+}
+
+//CCR in the syntax of the ARM assembler (beat sizes in bits)
+static void pl330_format_ccr(uint32_t ccr, char* buf, size_t len)
+{
+  int n;
+
+  n = snprintf(buf, len, "SB%u SS%u %s SP%u SC%u DB%u DS%u %s DP%u DC%u",
+    PL330_CCR_SB(ccr), 8u << PL330_CCR_SS(ccr),
+    PL330_CCR_SAI(ccr) ? "SAI" : "SAF", PL330_CCR_SP(ccr), PL330_CCR_SC(ccr),
+    PL330_CCR_DB(ccr), 8u << PL330_CCR_DS(ccr),
+    PL330_CCR_DAI(ccr) ? "DAI" : "DAF", PL330_CCR_DP(ccr), PL330_CCR_DC(ccr));
+  if ((PL330_CCR_ES(ccr) != 0) && (n > 0) && ((size_t) n < len))
+    n += snprintf(buf + n, len - n, " ES%u", 8u << PL330_CCR_ES(ccr));
+  if ((n > 0) && ((size_t) n < len))
+    snprintf(buf + n, len - n, " (0x%08x)", ccr);
+}
+
+void pl330_format(const PL330_INST_t* inst, char* buf, size_t len)
+{
+  char ccr[128];
+
+  switch (inst->op)
+  {
+    case PL330_OP_END: snprintf(buf, len, "DMAEND"); break;
+    case PL330_OP_KILL: snprintf(buf, len, "DMAKILL"); break;
+    case PL330_OP_LD:
+      snprintf(buf, len, "DMALD%s", pl330_cond_suffix(inst->cond));
+      break;
+    case PL330_OP_ST:
+      snprintf(buf, len, "DMAST%s", pl330_cond_suffix(inst->cond));
+      break;
+    case PL330_OP_STZ: snprintf(buf, len, "DMASTZ"); break;
+    case PL330_OP_RMB: snprintf(buf, len, "DMARMB"); break;
+    case PL330_OP_WMB: snprintf(buf, len, "DMAWMB"); break;
+    case PL330_OP_NOP: snprintf(buf, len, "DMANOP"); break;
+    case PL330_OP_LP:
+      snprintf(buf, len, "DMALP lc%u, %u", inst->lc, inst->imm);
+      break;
+    case PL330_OP_LDP:
+      snprintf(buf, len, "DMALDP%s P%u", pl330_cond_suffix(inst->cond),
+        inst->num);
+      break;
+    case PL330_OP_STP:
+      snprintf(buf, len, "DMASTP%s P%u", pl330_cond_suffix(inst->cond),
+        inst->num);
+      break;
+    case PL330_OP_LPEND:
+      if (inst->forever)
+        snprintf(buf, len, "DMALPEND lc%u (forever), to 0x%04x", inst->lc,
+          inst->offset - inst->imm);
+      else
+        snprintf(buf, len, "DMALPEND%s lc%u, to 0x%04x",
+          pl330_cond_suffix(inst->cond), inst->lc, inst->offset - inst->imm);
+      break;
+    case PL330_OP_WFP:
+      snprintf(buf, len, "DMAWFP P%u, %s", inst->num,
+        (inst->cond == PL330_COND_SINGLE) ? "single" :
+        ((inst->cond == PL330_COND_BURST) ? "burst" : "periph"));
+      break;
+    case PL330_OP_SEV: snprintf(buf, len, "DMASEV E%u", inst->num); break;
+    case PL330_OP_FLUSHP:
+      snprintf(buf, len, "DMAFLUSHP P%u", inst->num);
+      break;
+    case PL330_OP_WFE:
+      snprintf(buf, len, "DMAWFE E%u%s", inst->num,
+        inst->invalidate ? ", invalid" : "");
+      break;
+    case PL330_OP_ADDH:
+      snprintf(buf, len, "DMAADDH %s, 0x%x", pl330_reg_name(inst->reg),
+        inst->imm);
+      break;
+    case PL330_OP_ADNH:
+      snprintf(buf, len, "DMAADNH %s, 0x%x", pl330_reg_name(inst->reg),
+        inst->imm);
+      break;
+    case PL330_OP_GO:
+      snprintf(buf, len, "DMAGO C%u, 0x%08x", inst->num, inst->imm);
+      break;
+    case PL330_OP_MOV:
+      if (inst->reg == ALT_DMA_PROGRAM_REG_CCR)
+      {
+        pl330_format_ccr(inst->imm, ccr, sizeof(ccr));
+        snprintf(buf, len, "DMAMOV CCR, %s", ccr);
+      }
+      else
+        snprintf(buf, len, "DMAMOV %s, 0x%08x", pl330_reg_name(inst->reg),
+          inst->imm);
+      break;
+    default:
+      snprintf(buf, len, "(invalid)");
+      break;
+  }
+}
+
+void pl330_disassemble(FILE* out, const uint8_t* code, uint32_t size,
+  uint32_t addr)
+{
+  PL330_INST_t inst;
+  char text[192];
+  char bytes[24];
+  uint32_t offset = 0;
+  uint32_t i;
+  int n;
+  int depth = 0;
+
+  while (offset < size)
+  {
+    if (!pl330_decode(code, size, offset, &inst))
+    {
+      snprintf(bytes, sizeof(bytes), "%02x ", code[offset]);
+      fprintf(out, "%08x  %-18s  DCB 0x%02x ; invalid or truncated\n",
+        addr + offset, bytes, code[offset]);
+      offset++;
+      continue;
+    }
+
+    n = 0;
+    for (i = 0; i < inst.size; i++)
+      n += snprintf(bytes + n, sizeof(bytes) - n, "%02x ", code[offset+i]);
+    pl330_format(&inst, text, sizeof(text));
+    if ((inst.op == PL330_OP_LPEND) && !inst.forever && (depth > 0))
+      depth--;
+    fprintf(out, "%08x  %-18s  %*s%s\n", addr + offset, bytes, 2*depth, "",
+      text);
+    if (inst.op == PL330_OP_LP)
+      depth++;
+    offset += inst.size;
+  }
+}
+
+//-----------------------------VALIDATOR---------------------------------//
+static void pl330_report(FILE* log, uint32_t* counter, const char* kind,
+  uint32_t offset, const char* fmt, ...)
+{
+  va_list args;
+
+  (*counter)++;
+  if (log == NULL)
+    return;
+  fprintf(log, "%s: 0x%04x: ", kind, offset);
+  va_start(args, fmt);
+  vfprintf(log, fmt, args);
+  va_end(args);
+  fprintf(log, "\n");
+}
+
+#define PL330_ERROR(offset, ...) \
+  pl330_report(log, &stats->errors, "error", offset, __VA_ARGS__)
+#define PL330_WARNING(offset, ...) \
+  pl330_report(log, &stats->warnings, "warning", offset, __VA_ARGS__)
+
+//Check the CCR written in offset
+static void pl330_check_ccr(uint32_t ccr, uint32_t offset, FILE* log,
+  PL330_STATS_t* stats)
+{
+  uint32_t src = PL330_CCR_SB(ccr) << PL330_CCR_SS(ccr);
+  uint32_t dst = PL330_CCR_DB(ccr) << PL330_CCR_DS(ccr);
+
+  if ((PL330_CCR_SS(ccr) > PL330_MAX_BEAT_SIZE_CODE) ||
+    (PL330_CCR_DS(ccr) > PL330_MAX_BEAT_SIZE_CODE))
+    PL330_ERROR(offset, "CCR beats of %u and %u Bytes, the AXI bus of the DMAC is 8 Bytes wide",
+      1u << PL330_CCR_SS(ccr), 1u << PL330_CCR_DS(ccr));
+  if (PL330_CCR_ES(ccr) > PL330_MAX_BEAT_SIZE_CODE)
+    PL330_ERROR(offset, "CCR endian swap size %u is reserved",
+      PL330_CCR_ES(ccr));
+  else if ((PL330_CCR_ES(ccr) > PL330_CCR_SS(ccr)) ||
+    (PL330_CCR_ES(ccr) > PL330_CCR_DS(ccr)))
+    PL330_ERROR(offset, "CCR endian swap of %u Bytes is bigger than the beats",
+      1u << PL330_CCR_ES(ccr));
+  if (src != dst)
+    PL330_WARNING(offset, "CCR bursts load %u Bytes and store %u Bytes",
+      src, dst);
+}
+
+//Bytes moved by a DMALD or DMAST executed mult times from the address in
+//reg (updated). With an unaligned address the first beat moves less Bytes
+//and the next ones are aligned, as in the PL330.
+static uint64_t pl330_static_bytes(uint32_t* reg, bool inc, uint64_t mult,
+  uint32_t beats, uint32_t beat)
+{
+  uint32_t off = *reg & (beat - 1);
+  uint64_t bytes;
+
+  if (!inc)
+    return mult*beats*(beat - off);
+  bytes = mult*beats*beat - off;
+  *reg += (uint32_t) bytes;
+  return bytes;
+}
+
+uint32_t pl330_validate(const uint8_t* code, uint32_t size, uint32_t addr,
+  FILE* log, PL330_STATS_t* stats)
+{
+  struct pl330_loop loops[PL330_MAX_LOOPS];
+  PL330_INST_t inst;
+  uint64_t mult = 1;     //times the current instruction is executed
+  uint32_t depth = 0;
+  uint32_t offset = 0;
+  uint32_t ccr = 0;
+  uint32_t sar = 0;      //aligned if not set by the program
+  uint32_t dar = 0;
+  bool ccr_set = false;
+  bool ended = false;
+  bool known_req = false; //request type set by DMAWFP single or burst
+  PL330_COND_t req = PL330_COND_NONE;
+  uint32_t beats;
+  uint32_t beat_bytes;
+  uint32_t first;
+  uint32_t i;
+
+  memset(stats, 0, sizeof(*stats));
+  stats->code_size = size;
+
+  if (size == 0)
+  {
+    PL330_ERROR(0, "empty program");
+    return stats->errors;
+  }
+
+  //instruction cache
+  first = (addr == PL330_ADDR_UNKNOWN) ? 0 : addr;
+  stats->icache_lines = (first + size - 1)/PL330_ICACHE_LINE -
+    first/PL330_ICACHE_LINE + 1;
+  if ((addr != PL330_ADDR_UNKNOWN) && (addr % PL330_ICACHE_LINE != 0))
+    PL330_ERROR(0, "microcode in 0x%08x is not aligned to a %uB line of the instruction cache",
+      addr, PL330_ICACHE_LINE);
+  if (stats->icache_lines > PL330_ICACHE_LINES)
+    PL330_WARNING(0, "microcode uses %u lines of the instruction cache (%u lines), fetches will miss",
+      stats->icache_lines, PL330_ICACHE_LINES);
+
+  while (offset < size)
+  {
+    if (!pl330_decode(code, size, offset, &inst))
+    {
+      PL330_ERROR(offset, "invalid or truncated instruction (0x%02x)",
+        code[offset]);
+      //keep validating after the invalid Byte
+      offset++;
+      continue;
+    }
+    stats->instructions++;
+    stats->executed += mult;
+
+    switch (inst.op)
+    {
+      case PL330_OP_END:
+        if (depth > 0)
+          PL330_WARNING(offset, "DMAEND inside a loop ends the program in the first iteration");
+        else
+          ended = true;
+        break;
+
+      case PL330_OP_KILL:
+        PL330_WARNING(offset, "DMAKILL in a channel program");
+        break;
+
+      case PL330_OP_GO:
+        PL330_ERROR(offset, "DMAGO is only valid in the manager thread");
+        break;
+
+      case PL330_OP_MOV:
+        if (inst.reg == ALT_DMA_PROGRAM_REG_CCR)
+        {
+          ccr = inst.imm;
+          ccr_set = true;
+          pl330_check_ccr(ccr, offset, log, stats);
+        }
+        else if (inst.reg == ALT_DMA_PROGRAM_REG_SAR)
+          sar = inst.imm;
+        else
+          dar = inst.imm;
+        break;
+
+      case PL330_OP_ADDH:
+      case PL330_OP_ADNH:
+        if (inst.op == PL330_OP_ADNH)
+          inst.imm |= 0xFFFF0000;
+        if (inst.reg == ALT_DMA_PROGRAM_REG_SAR)
+          sar += (uint32_t) (mult*inst.imm);
+        else
+          dar += (uint32_t) (mult*inst.imm);
+        break;
+
+      case PL330_OP_WFP:
+        known_req = (inst.cond != PL330_COND_PERIPH);
+        req = inst.cond;
+        break;
+
+      case PL330_OP_LD:
+      case PL330_OP_ST:
+      case PL330_OP_LDP:
+      case PL330_OP_STP:
+      case PL330_OP_STZ:
+        if (!ccr_set)
+          PL330_WARNING(offset, "transfer before DMAMOV CCR uses the CCR of the last program");
+        if ((inst.op == PL330_OP_LDP) || (inst.op == PL330_OP_STP) ||
+          ((inst.cond != PL330_COND_NONE) && !known_req))
+        {
+          //depends on the request of the peripheral
+          stats->cond_transfers += mult;
+          break;
+        }
+        if ((inst.cond != PL330_COND_NONE) && (inst.cond != req))
+          break; //not executed with the request of the last DMAWFP
+        if (inst.op == PL330_OP_LD)
+        {
+          beats = (inst.cond == PL330_COND_SINGLE) ? 1 : PL330_CCR_SB(ccr);
+          beat_bytes = 1u << PL330_CCR_SS(ccr);
+          stats->ld_bursts += mult;
+          stats->ld_beats += mult*beats;
+          stats->ld_bytes += pl330_static_bytes(&sar, PL330_CCR_SAI(ccr),
+            mult, beats, beat_bytes);
+        }
+        else
+        {
+          beats = (inst.cond == PL330_COND_SINGLE) ? 1 : PL330_CCR_DB(ccr);
+          beat_bytes = 1u << PL330_CCR_DS(ccr);
+          stats->st_bursts += mult;
+          stats->st_beats += mult*beats;
+          if (inst.op == PL330_OP_STZ)
+            stats->stz_bytes += pl330_static_bytes(&dar, PL330_CCR_DAI(ccr),
+              mult, beats, beat_bytes);
+          else
+            stats->st_bytes += pl330_static_bytes(&dar, PL330_CCR_DAI(ccr),
+              mult, beats, beat_bytes);
+        }
+        break;
+
+      case PL330_OP_SEV:
+      case PL330_OP_WFE:
+        if (inst.num > PL330_MAX_EVENT)
+          PL330_ERROR(offset, "event %u does not exist (0 to %u)", inst.num,
+            PL330_MAX_EVENT);
+        break;
+
+      case PL330_OP_LP:
+        for (i = 0; i < depth; i++)
+          if (loops[i].lc == inst.lc)
+            PL330_ERROR(offset, "DMALP lc%u inside a loop that uses lc%u",
+              inst.lc, inst.lc);
+        if (depth == PL330_MAX_LOOPS)
+        {
+          PL330_ERROR(offset, "more than %u loops nested", PL330_MAX_LOOPS);
+          break;
+        }
+        loops[depth].body = offset + inst.size;
+        loops[depth].lc = inst.lc;
+        loops[depth].count = inst.imm;
+        depth++;
+        stats->loops++;
+        if (depth > stats->max_loop_depth)
+          stats->max_loop_depth = depth;
+        mult *= inst.imm;
+        break;
+
+      case PL330_OP_LPEND:
+        if (inst.imm > offset)
+        {
+          PL330_ERROR(offset, "DMALPEND jumps before the start of the program");
+          break;
+        }
+        if (inst.forever)
+        {
+          //DMALPFE assembles nothing, the loop starts in the target
+          if ((depth > 0) && (offset - inst.imm < loops[depth-1].body))
+            PL330_ERROR(offset, "forever loop to 0x%04x starts outside the loop of 0x%04x",
+              offset - inst.imm, loops[depth-1].body);
+          stats->loops++;
+          stats->forever = true;
+          break;
+        }
+        if (depth == 0)
+        {
+          PL330_ERROR(offset, "DMALPEND lc%u without DMALP", inst.lc);
+          break;
+        }
+        depth--;
+        if (loops[depth].lc != inst.lc)
+          PL330_ERROR(offset, "DMALPEND lc%u closes the loop of DMALP lc%u",
+            inst.lc, loops[depth].lc);
+        if (offset - inst.imm != loops[depth].body)
+          PL330_ERROR(offset, "DMALPEND jumps to 0x%04x, the loop starts in 0x%04x",
+            offset - inst.imm, loops[depth].body);
+        mult /= loops[depth].count;
+        break;
+
+      default:
+        break;
+    }
+
+    offset += inst.size;
+    if (ended)
+      break;
+  }
+
+  if (depth > 0)
+    PL330_ERROR(offset, "%u loops not closed (first in 0x%04x)", depth,
+      loops[0].body);
+  if (!ended)
+    PL330_ERROR(offset, "unterminated program, there is no DMAEND");
+  else if (offset < size)
+    PL330_WARNING(offset, "%u Bytes after DMAEND are never executed",
+      size - offset);
+
+  //the MFIFO must be empty at the end
+  if (!stats->forever && (stats->cond_transfers == 0) &&
+    (stats->ld_bytes != stats->st_bytes))
+    PL330_ERROR(offset, "loads move %llu Bytes and stores %llu Bytes",
+      (unsigned long long) stats->ld_bytes,
+      (unsigned long long) stats->st_bytes);
+
+  return stats->errors;
+}
+
+const uint8_t* pl330_program_code(const ALT_DMA_PROGRAM_t* pgm, uint32_t* size)
+{
+  *size = pgm->code_size;
+  return pgm->program + pgm->buffer_start;
+}
+
+uint32_t pl330_validate_program(const ALT_DMA_PROGRAM_t* pgm,
+  uint32_t pgm_addr, FILE* log, PL330_STATS_t* stats)
+{
+  const uint8_t* code;
+  uint32_t size;
+  uint32_t addr = PL330_ADDR_UNKNOWN;
+  uint32_t errors = 0;
+  uint32_t warnings = 0;
+  uint32_t start = (uint32_t) offsetof(ALT_DMA_PROGRAM_t, program);
+
+  if ((pgm->buffer_start >= ALT_DMA_PROGRAM_CACHE_LINE_SIZE) ||
+    (pgm->code_size > ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE))
+  {
+    memset(stats, 0, sizeof(*stats));
+    pl330_report(log, &stats->errors, "error", 0,
+      "buffer_start %u or code_size %u out of range, not a program",
+      pgm->buffer_start, pgm->code_size);
+    return stats->errors;
+  }
+
+  //alt_dma_program_init() aligns the microcode with the virtual address of
+  //the struct. The DMAC fetches it from the hardware address, so the driver
+  //puts the struct in 16B + a multiple of 32B (buffer_start 0).
+  if (pgm_addr != PL330_ADDR_UNKNOWN)
+    addr = pgm_addr + start + pgm->buffer_start;
+  else if (pgm->buffer_start != 0)
+    pl330_report(log, &errors, "error", 0,
+      "buffer_start is %u: the struct + %uB is not aligned to 32B",
+      pgm->buffer_start, start);
+  if (alt_dma_program_validate(pgm) != ALT_E_SUCCESS)
+    pl330_report(log, &warnings, "warning", 0,
+      "alt_dma_program_validate() fails (open loops or no DMAEND when assembled)");
+
+  code = pl330_program_code(pgm, &size);
+  pl330_validate(code, size, addr, log, stats);
+  stats->errors += errors;
+  stats->warnings += warnings;
+  return stats->errors;
+}
+
+void pl330_print_stats(FILE* out, const PL330_STATS_t* stats)
+{
+  fprintf(out, "code size:          %u Bytes\n", stats->code_size);
+  fprintf(out, "instructions:       %u\n", stats->instructions);
+  fprintf(out, "icache lines:       %u of %u\n", stats->icache_lines,
+    PL330_ICACHE_LINES);
+  fprintf(out, "loops:              %u (max depth %u)%s\n", stats->loops,
+    stats->max_loop_depth, stats->forever ? ", forever loops counted once" : "");
+  fprintf(out, "executed:           %llu instructions\n",
+    (unsigned long long) stats->executed);
+  fprintf(out, "loads:              %llu bursts, %llu beats, %llu Bytes",
+    (unsigned long long) stats->ld_bursts,
+    (unsigned long long) stats->ld_beats,
+    (unsigned long long) stats->ld_bytes);
+  if (stats->ld_beats != 0)
+    fprintf(out, ", %.2f Bytes/beat",
+      (double) stats->ld_bytes / stats->ld_beats);
+  fprintf(out, "\n");
+  fprintf(out, "stores:             %llu bursts, %llu beats, %llu Bytes",
+    (unsigned long long) stats->st_bursts,
+    (unsigned long long) stats->st_beats,
+    (unsigned long long) (stats->st_bytes + stats->stz_bytes));
+  if (stats->st_beats != 0)
+    fprintf(out, ", %.2f Bytes/beat",
+      (double) (stats->st_bytes + stats->stz_bytes) / stats->st_beats);
+  if (stats->stz_bytes != 0)
+    fprintf(out, " (%llu Bytes of DMASTZ)",
+      (unsigned long long) stats->stz_bytes);
+  fprintf(out, "\n");
+  if (stats->cond_transfers != 0)
+    fprintf(out, "peripheral:         %llu loads/stores depend on the peripheral request\n",
+      (unsigned long long) stats->cond_transfers);
+  fprintf(out, "errors:             %u\n", stats->errors);
+  fprintf(out, "warnings:           %u\n", stats->warnings);
+}
@@ -0,0 +1,145 @@
+/**
+ * @file    pl330_disasm.h
+ * @brief  Decoder, disassembler and validator of PL330 DMAC microcode for the
+ * host PC. It reads the programs assembled by the alt_dma_program_DMA*()
+ * functions of hwlib (ALT_DMA_PROGRAM_t) or raw dumps of microcode.
+*/
+#ifndef _PL330_DISASM_H
+#define _PL330_DISASM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "alt_dma_program.h"
+
+//----------------------------INSTRUCTIONS-------------------------------//
+typedef enum PL330_OP_e
+{
+  PL330_OP_INVALID,
+  PL330_OP_END,
+  PL330_OP_KILL,
+  PL330_OP_LD,      //DMALD[S|B]
+  PL330_OP_ST,      //DMAST[S|B]
+  PL330_OP_STZ,
+  PL330_OP_RMB,
+  PL330_OP_WMB,
+  PL330_OP_NOP,
+  PL330_OP_LP,      //DMALP lc0|lc1
+  PL330_OP_LDP,     //DMALDP<S|B>
+  PL330_OP_STP,     //DMASTP<S|B>
+  PL330_OP_LPEND,   //DMALPEND[S|B] and end of DMALPFE (forever)
+  PL330_OP_WFP,
+  PL330_OP_SEV,
+  PL330_OP_FLUSHP,
+  PL330_OP_WFE,
+  PL330_OP_ADDH,
+  PL330_OP_ADNH,
+  PL330_OP_GO,      //only for the manager thread
+  PL330_OP_MOV
+}
+PL330_OP_t;
+
+//Condition of DMALD, DMAST, DMALPEND, DMALDP and DMASTP and request of DMAWFP
+typedef enum PL330_COND_e
+{
+  PL330_COND_NONE,
+  PL330_COND_SINGLE,
+  PL330_COND_BURST,
+  PL330_COND_PERIPH  //only DMAWFP
+}
+PL330_COND_t;
+
+typedef struct PL330_INST_s
+{
+  uint32_t offset;   //offset of the instruction in the microcode
+  uint8_t size;      //Bytes of the instruction
+  PL330_OP_t op;
+  PL330_COND_t cond;
+  uint8_t lc;        //loop counter of DMALP and DMALPEND (0 or 1)
+  bool forever;      //DMALPEND of a DMALPFE
+  uint8_t reg;       //ALT_DMA_PROGRAM_REG_t of DMAMOV, DMAADDH and DMAADNH
+  uint8_t num;       //peripheral, event or channel
+  bool invalidate;   //DMAWFE with invalidate
+  uint32_t imm;      //iterations of DMALP, jump of DMALPEND or immediate
+}
+PL330_INST_t;
+
+//Fields of the CCR written with DMAMOV CCR
+#define PL330_CCR_SAI(ccr)  ((ccr) & 0x1)
+#define PL330_CCR_SS(ccr)   (((ccr) >> 1) & 0x7)   //source beat 2^SS Bytes
+#define PL330_CCR_SB(ccr)   ((((ccr) >> 4) & 0xF) + 1) //source beats
+#define PL330_CCR_SP(ccr)   (((ccr) >> 8) & 0x7)
+#define PL330_CCR_SC(ccr)   (((ccr) >> 11) & 0x7)
+#define PL330_CCR_DAI(ccr)  (((ccr) >> 14) & 0x1)
+#define PL330_CCR_DS(ccr)   (((ccr) >> 15) & 0x7)  //destiny beat 2^DS Bytes
+#define PL330_CCR_DB(ccr)   ((((ccr) >> 18) & 0xF) + 1) //destiny beats
+#define PL330_CCR_DP(ccr)   (((ccr) >> 22) & 0x7)
+#define PL330_CCR_DC(ccr)   (((ccr) >> 25) & 0x7)
+#define PL330_CCR_ES(ccr)   (((ccr) >> 28) & 0x7)  //endian swap 2^ES Bytes
+
+//The AXI master of the DMAC in Cyclone V is 64 bits wide
+#define PL330_MAX_BEAT_SIZE_CODE 3
+
+//Hardware address of the microcode when it is not known
+#define PL330_ADDR_UNKNOWN 0xFFFFFFFF
+
+//-----------------------------STATISTICS--------------------------------//
+//Static statistics of a program. The loops are unrolled with their counts,
+//forever loops are counted once.
+typedef struct PL330_STATS_s
+{
+  uint32_t code_size;       //Bytes of microcode
+  uint32_t instructions;    //instructions in the microcode
+  uint32_t icache_lines;    //lines of 32B of the instruction cache used
+  uint32_t loops;
+  uint32_t max_loop_depth;
+  bool forever;             //there is a forever loop
+  uint64_t executed;        //instructions executed
+  uint64_t ld_bursts;
+  uint64_t ld_beats;
+  uint64_t ld_bytes;
+  uint64_t st_bursts;
+  uint64_t st_beats;
+  uint64_t st_bytes;
+  uint64_t stz_bytes;       //zeros written with DMASTZ
+  uint64_t cond_transfers;  //DMALD/DMAST depending on the peripheral request
+  uint32_t errors;
+  uint32_t warnings;
+}
+PL330_STATS_t;
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Decode the instruction in offset of code (size Bytes). Returns false if the
+//opcode is not valid or the instruction is truncated (inst->size is 0 then).
+bool pl330_decode(const uint8_t* code, uint32_t size, uint32_t offset,
+  PL330_INST_t* inst);
+
+//Write the PL330 assembly of an instruction in buf
+void pl330_format(const PL330_INST_t* inst, char* buf, size_t len);
+
+//Write the listing of the microcode (addr is the hardware address of the
+//first Byte, 0 if not known)
+void pl330_disassemble(FILE* out, const uint8_t* code, uint32_t size,
+  uint32_t addr);
+
+//Check the microcode and compute its statistics. Errors and warnings are
+//written to log (if not NULL). addr is the hardware address of the first
+//Byte (PL330_ADDR_UNKNOWN to skip the alignment check). Returns the number
+//of errors.
+uint32_t pl330_validate(const uint8_t* code, uint32_t size, uint32_t addr,
+  FILE* log, PL330_STATS_t* stats);
+
+//Microcode of a program assembled with hwlib and its size
+const uint8_t* pl330_program_code(const ALT_DMA_PROGRAM_t* pgm, uint32_t* size);
+
+//pl330_validate() for a program assembled with hwlib. It also checks the
+//fields of the struct. pgm_addr is the hardware address of the struct
+//(PL330_ADDR_UNKNOWN if not known).
+uint32_t pl330_validate_program(const ALT_DMA_PROGRAM_t* pgm,
+  uint32_t pgm_addr, FILE* log, PL330_STATS_t* stats);
+
+//Write the statistics
+void pl330_print_stats(FILE* out, const PL330_STATS_t* stats);
+
+#endif
@@ -0,0 +1,159 @@
+//Disassembler and validator of PL330 microcode. It reads a raw dump of
+//microcode or of a ALT_DMA_PROGRAM_t (i.e. the program of a channel of
+//DMA_PL330_LKM read from HPS OCR), prints the listing, the errors found and
+//the statistics of the program. Returns 0 if the program is valid, 1 if
+//there are errors and 2 if the input cannot be read.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "pl330_disasm.h"
+
+#define MAX_DUMP_SIZE 65536 //largest program buffer supported by hwlib
+
+static void usage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s [-p] [-x] [-a addr] [-q] file\n"
+    "  file     dump to read (- for stdin)\n"
+    "  -p       the dump is a ALT_DMA_PROGRAM_t, not raw microcode\n"
+    "  -x       the dump is hexadecimal text (i.e. from xxd -p or hexdump)\n"
+    "  -a addr  hardware address of the dump, to check the 32B alignment\n"
+    "  -q       do not print the listing, only errors and statistics\n",
+    name);
+}
+
+//Read the hexadecimal digits of the text in buf. Pairs of digits are Bytes,
+//"0x" prefixes and anything else are separators.
+static size_t parse_hex(const char* text, size_t len, uint8_t* buf, size_t max)
+{
+  size_t n = 0;
+  size_t i = 0;
+
+  while ((i < len) && (n < max))
+  {
+    if ((text[i] == '0') && (i + 1 < len) &&
+      ((text[i+1] == 'x') || (text[i+1] == 'X')))
+    {
+      i += 2;
+      continue;
+    }
+    if (isxdigit((unsigned char) text[i]) && (i + 1 < len) &&
+      isxdigit((unsigned char) text[i+1]))
+    {
+      char byte[3] = {text[i], text[i+1], 0};
+      buf[n++] = (uint8_t) strtoul(byte, NULL, 16);
+      i += 2;
+      continue;
+    }
+    i++;
+  }
+  return n;
+}
+
+int main(int argc, char** argv)
+{
+  static uint8_t raw[2*MAX_DUMP_SIZE];
+  static uint8_t dump[MAX_DUMP_SIZE];
+  ALT_DMA_PROGRAM_t pgm;
+  PL330_STATS_t stats;
+  const uint8_t* code;
+  FILE* f;
+  size_t len;
+  uint32_t size;
+  uint32_t addr = PL330_ADDR_UNKNOWN;
+  uint32_t code_addr;
+  int is_program = 0;
+  int is_hex = 0;
+  int quiet = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "pxa:q")) != -1)
+  {
+    switch (opt)
+    {
+      case 'p': is_program = 1; break;
+      case 'x': is_hex = 1; break;
+      case 'a': addr = (uint32_t) strtoul(optarg, NULL, 0); break;
+      case 'q': quiet = 1; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind != argc - 1)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  //Read the dump
+  if (strcmp(argv[optind], "-") == 0)
+    f = stdin;
+  else
+    f = fopen(argv[optind], "rb");
+  if (f == NULL)
+  {
+    perror(argv[optind]);
+    return 2;
+  }
+  len = fread(raw, 1, sizeof(raw), f);
+  if (f != stdin)
+    fclose(f);
+  if (is_hex)
+    len = parse_hex((const char*) raw, len, dump, sizeof(dump));
+  else
+  {
+    if (len > sizeof(dump))
+      len = sizeof(dump);
+    memcpy(dump, raw, len);
+  }
+
+  //Find the microcode
+  if (is_program)
+  {
+    memset(&pgm, 0, sizeof(pgm));
+    if (len > sizeof(pgm))
+      len = sizeof(pgm);
+    if (len < offsetof(ALT_DMA_PROGRAM_t, program))
+    {
+      fprintf(stderr, "The dump is smaller than the header of ALT_DMA_PROGRAM_t\n");
+      return 2;
+    }
+    memcpy(&pgm, dump, len);
+    if ((pgm.buffer_start < ALT_DMA_PROGRAM_CACHE_LINE_SIZE) &&
+      (pgm.code_size <= ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE) &&
+      (offsetof(ALT_DMA_PROGRAM_t, program) + pgm.buffer_start +
+      pgm.code_size > len))
+    {
+      fprintf(stderr, "The dump has %u Bytes, the program needs %u\n",
+        (unsigned int) len, (unsigned int) (offsetof(ALT_DMA_PROGRAM_t,
+        program) + pgm.buffer_start + pgm.code_size));
+      return 2;
+    }
+    code = pl330_program_code(&pgm, &size);
+    code_addr = (addr == PL330_ADDR_UNKNOWN) ? 0 :
+      addr + offsetof(ALT_DMA_PROGRAM_t, program) + pgm.buffer_start;
+  }
+  else
+  {
+    code = dump;
+    size = (uint32_t) len;
+    code_addr = (addr == PL330_ADDR_UNKNOWN) ? 0 : addr;
+  }
+
+  //Listing, errors and statistics
+  if (is_program)
+    pl330_validate_program(&pgm, addr, stdout, &stats);
+  else
+    pl330_validate(code, size, addr, stdout, &stats);
+  if (!quiet)
+  {
+    printf("\n");
+    pl330_disassemble(stdout, code, stats.code_size, code_addr);
+  }
+  printf("\n");
+  pl330_print_stats(stdout, &stats);
+
+  return (stats.errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,751 @@
+/**
+ * @file    pl330_sim.c
+ * @brief  Cycle-approximate model of a channel thread of the PL330 DMAC (see
+ * pl330_sim.h).
+ *
+ * The model is simple on purpose, it is made to compare programs and find
+ * errors in them, not to predict the exact time of a transfer:
+ * -The thread executes one instruction per cycle. A fetch of a line that is
+ *  not in the instruction cache (16 lines of 32B, LRU) costs the latency of
+ *  the region of the microcode.
+ * -DMALD reserves its Bytes in the MFIFO when it is issued (the thread waits
+ *  for stores to free space) and issues a read burst. The data arrives after
+ *  the read latency of the region, one beat every ceil(beat/width) cycles.
+ *  The read data channel is shared by all the bursts.
+ * -DMAST takes its Bytes from the MFIFO and issues a write burst. The data is
+ *  sent when it has arrived to the MFIFO and the write data channel is free.
+ *  The space in the MFIFO is freed when the data is sent and the burst ends
+ *  with the write response, after the write latency of the region.
+ * -The thread waits when the channel has max_reads or max_writes bursts
+ *  outstanding, in DMARMB, DMAWMB and in DMAEND (until all the bursts end).
+ * -Bursts with unaligned addresses move less Bytes in the first beat, as in
+ *  the PL330 (the address gets aligned after the first beat).
+ * The channel faults, as the real one, with invalid instructions, addresses
+ * with no slave, a store without data in the MFIFO, a load that can never
+ * fit in the MFIFO or data left in the MFIFO at DMAEND. DMAWFE only continues
+ * if the thread sent the event before (there are no other threads).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pl330_sim.h"
+
+#define PL330_PAGE_SHIFT 12
+#define PL330_PAGE_SIZE  (1u << PL330_PAGE_SHIFT)
+#define PL330_PAGES      (1u << (32 - PL330_PAGE_SHIFT))
+
+#define PL330_ICACHE_LINE  ALT_DMA_PROGRAM_CACHE_LINE_SIZE
+#define PL330_ICACHE_LINES ALT_DMA_PROGRAM_CACHE_LINE_COUNT
+
+struct PL330_SIM_MEM_s {
+  uint8_t* pages[PL330_PAGES];
+};
+
+//Data loaded in the MFIFO: cumulative position of its last Byte + 1 and
+//cycle when it arrives
+struct pl330_chunk {
+  uint64_t end;
+  uint64_t ready;
+};
+
+//Space freed in the MFIFO by a store
+struct pl330_free {
+  uint64_t time;
+  uint32_t bytes;
+};
+
+//Queue of times (outstanding bursts, in order of completion)
+struct pl330_queue {
+  uint64_t* time;
+  uint32_t head;
+  uint32_t count;
+  uint32_t size;
+};
+
+struct pl330_thread {
+  const PL330_SIM_CONFIG_t* cfg;
+  PL330_SIM_MEM_t* mem;
+  PL330_SIM_STATS_t* stats;
+  uint64_t t;               //cycle of the thread
+  uint32_t sar;
+  uint32_t dar;
+  uint32_t ccr;
+  uint32_t lc[2];
+  PL330_COND_t req;         //request type of the last DMAWFP
+  //MFIFO
+  uint8_t* fifo;            //data loaded and not stored (ring)
+  uint32_t fifo_head;
+  uint64_t loaded;          //Bytes loaded since the start
+  uint64_t stored;          //Bytes taken by stores since the start
+  struct pl330_chunk* chunks;
+  uint32_t chunk_head;
+  uint32_t chunk_count;
+  struct pl330_free* frees; //space freed after t (in order)
+  uint32_t free_head;
+  uint32_t free_count;
+  uint64_t freed;           //Bytes freed until t
+  //AXI master
+  uint64_t rd_free;         //cycle when the read data channel is free
+  uint64_t wr_free;         //cycle when the write data channel is free
+  uint64_t rd_last;         //end of the last read burst
+  uint64_t wr_last;         //write response of the last write burst
+  struct pl330_queue rd_out;
+  struct pl330_queue wr_out;
+  //instruction cache
+  uint32_t icache_tag[PL330_ICACHE_LINES];
+  uint64_t icache_use[PL330_ICACHE_LINES];
+  bool icache_valid[PL330_ICACHE_LINES];
+};
+
+//-----------------------------CONFIGURATION-----------------------------//
+void pl330_sim_default_config(PL330_SIM_CONFIG_t* cfg)
+{
+  memset(cfg, 0, sizeof(*cfg));
+  //Address map of Cyclone V with 1GB of SDRAM (DE1-SoC). Latencies in cycles
+  //of the DMAC clock, approximate.
+  pl330_sim_set_region(cfg, "sdram", 0x00000000, 0x40000000, 8, 40, 20);
+  pl330_sim_set_region(cfg, "acp",   0x80000000, 0x40000000, 8, 30, 15);
+  pl330_sim_set_region(cfg, "h2f",   0xC0000000, 0x3C000000, 8, 12, 6);
+  pl330_sim_set_region(cfg, "lwh2f", 0xFF200000, 0x00200000, 4, 14, 8);
+  pl330_sim_set_region(cfg, "ocr",   0xFFFF0000, 0x00010000, 8, 4, 2);
+  cfg->mfifo_size = 256;        //32 lines of 64 bits
+  cfg->max_reads = 8;
+  cfg->max_writes = 8;
+  cfg->clock_mhz = 100;         //l4_main_clk
+  cfg->prog_addr = 0xFFFF0020;  //program of channel 0 in DMA_PL330_LKM
+  cfg->periph_req = PL330_COND_BURST;
+  cfg->max_instructions = 100000000;
+  cfg->trace = NULL;
+}
+
+bool pl330_sim_set_region(PL330_SIM_CONFIG_t* cfg, const char* name,
+  uint32_t start, uint32_t size, uint32_t width, uint32_t rd_latency,
+  uint32_t wr_latency)
+{
+  PL330_REGION_t* r = NULL;
+  uint32_t i;
+
+  for (i = 0; i < cfg->num_regions; i++)
+    if (strcmp(cfg->regions[i].name, name) == 0)
+      r = &cfg->regions[i];
+  if (r == NULL)
+  {
+    if (cfg->num_regions == PL330_SIM_MAX_REGIONS)
+      return false;
+    r = &cfg->regions[cfg->num_regions++];
+  }
+  snprintf(r->name, sizeof(r->name), "%s", name);
+  r->start = start;
+  r->size = size;
+  r->width = (width == 0) ? 1 : width;
+  r->rd_latency = rd_latency;
+  r->wr_latency = wr_latency;
+  return true;
+}
+
+//-------------------------------MEMORY----------------------------------//
+PL330_SIM_MEM_t* pl330_sim_mem_create(void)
+{
+  return calloc(1, sizeof(PL330_SIM_MEM_t));
+}
+
+void pl330_sim_mem_destroy(PL330_SIM_MEM_t* mem)
+{
+  uint32_t i;
+
+  if (mem == NULL)
+    return;
+  for (i = 0; i < PL330_PAGES; i++)
+    free(mem->pages[i]);
+  free(mem);
+}
+
+void pl330_sim_mem_read(PL330_SIM_MEM_t* mem, uint32_t addr, uint8_t* buf,
+  uint32_t len)
+{
+  uint32_t page;
+  uint32_t off;
+  uint32_t n;
+
+  while (len > 0)
+  {
+    page = addr >> PL330_PAGE_SHIFT;
+    off = addr & (PL330_PAGE_SIZE - 1);
+    n = PL330_PAGE_SIZE - off;
+    if (n > len)
+      n = len;
+    if (mem->pages[page] != NULL)
+      memcpy(buf, mem->pages[page] + off, n);
+    else
+      memset(buf, 0, n);
+    addr += n;
+    buf += n;
+    len -= n;
+  }
+}
+
+void pl330_sim_mem_write(PL330_SIM_MEM_t* mem, uint32_t addr,
+  const uint8_t* buf, uint32_t len)
+{
+  uint32_t page;
+  uint32_t off;
+  uint32_t n;
+
+  while (len > 0)
+  {
+    page = addr >> PL330_PAGE_SHIFT;
+    off = addr & (PL330_PAGE_SIZE - 1);
+    n = PL330_PAGE_SIZE - off;
+    if (n > len)
+      n = len;
+    if (mem->pages[page] == NULL)
+      mem->pages[page] = calloc(1, PL330_PAGE_SIZE);
+    memcpy(mem->pages[page] + off, buf, n);
+    addr += n;
+    buf += n;
+    len -= n;
+  }
+}
+
+//------------------------------HELPERS----------------------------------//
+static void pl330_queue_pop_until(struct pl330_queue* q, uint64_t t)
+{
+  while ((q->count > 0) && (q->time[q->head] <= t))
+  {
+    q->head = (q->head + 1) % q->size;
+    q->count--;
+  }
+}
+
+static void pl330_queue_push(struct pl330_queue* q, uint64_t t)
+{
+  q->time[(q->head + q->count) % q->size] = t;
+  q->count++;
+}
+
+//Wait until there is a free place for a burst in q
+static void pl330_wait_outstanding(struct pl330_thread* th,
+  struct pl330_queue* q)
+{
+  pl330_queue_pop_until(q, th->t);
+  if (q->count == q->size)
+  {
+    th->t = q->time[q->head];
+    pl330_queue_pop_until(q, th->t);
+  }
+}
+
+//Region of the Bytes [addr, addr + len) or -1
+static int pl330_region(const PL330_SIM_CONFIG_t* cfg, uint32_t addr,
+  uint32_t len)
+{
+  uint32_t i;
+
+  for (i = 0; i < cfg->num_regions; i++)
+  {
+    const PL330_REGION_t* r = &cfg->regions[i];
+    if ((addr >= r->start) && (addr - r->start < r->size) &&
+      (len <= r->size - (addr - r->start)))
+      return (int) i;
+  }
+  return -1;
+}
+
+//Fetch the instruction in pc (cost of the misses of the instruction cache)
+static void pl330_fetch(struct pl330_thread* th, uint32_t pc, uint32_t len)
+{
+  uint32_t addr = th->cfg->prog_addr + pc;
+  uint32_t line;
+  uint32_t last = (addr + len - 1)/PL330_ICACHE_LINE;
+  uint32_t victim;
+  uint32_t i;
+  int r;
+
+  for (line = addr/PL330_ICACHE_LINE; line <= last; line++)
+  {
+    victim = 0;
+    for (i = 0; i < PL330_ICACHE_LINES; i++)
+    {
+      if (th->icache_valid[i] && (th->icache_tag[i] == line))
+        break;
+      if (!th->icache_valid[i] ||
+        (th->icache_valid[victim] && (th->icache_use[i] < th->icache_use[victim])))
+        victim = i;
+    }
+    if (i == PL330_ICACHE_LINES)
+    {
+      //miss: read the line from the region of the program
+      r = pl330_region(th->cfg, line*PL330_ICACHE_LINE, PL330_ICACHE_LINE);
+      if (r >= 0)
+        th->t += th->cfg->regions[r].rd_latency +
+          PL330_ICACHE_LINE/th->cfg->regions[r].width;
+      th->stats->icache_misses++;
+      th->icache_valid[victim] = true;
+      th->icache_tag[victim] = line;
+      i = victim;
+    }
+    th->icache_use[i] = th->t;
+  }
+}
+
+//Bytes of a burst of beats of beat Bytes from addr
+static uint32_t pl330_burst_bytes(uint32_t addr, bool inc, uint32_t beats,
+  uint32_t beat)
+{
+  uint32_t off = addr & (beat - 1);
+
+  return inc ? beats*beat - off : beats*(beat - off);
+}
+
+//Move the data of a burst between memory and buf
+static void pl330_burst_data(PL330_SIM_MEM_t* mem, uint32_t addr, bool inc,
+  uint32_t beats, uint32_t beat, uint8_t* buf, bool write)
+{
+  uint32_t n = pl330_burst_bytes(addr, inc, beats, beat);
+  uint32_t i;
+
+  if (inc)
+  {
+    if (write)
+      pl330_sim_mem_write(mem, addr, buf, n);
+    else
+      pl330_sim_mem_read(mem, addr, buf, n);
+    return;
+  }
+  //fixed address: all the beats use the same Bytes
+  n = beat - (addr & (beat - 1));
+  for (i = 0; i < beats; i++)
+  {
+    if (write)
+      pl330_sim_mem_write(mem, addr, buf + i*n, n);
+    else
+      pl330_sim_mem_read(mem, addr, buf + i*n, n);
+  }
+}
+
+//Cycle when the Byte pos of the MFIFO arrives
+static uint64_t pl330_chunk_ready(struct pl330_thread* th, uint64_t pos)
+{
+  uint32_t size = th->cfg->mfifo_size + 1;
+  uint32_t i;
+
+  for (i = 0; i < th->chunk_count; i++)
+  {
+    struct pl330_chunk* c = &th->chunks[(th->chunk_head + i) % size];
+    if (pos < c->end)
+      return c->ready;
+  }
+  return th->t;
+}
+
+static void pl330_fifo_put(struct pl330_thread* th, const uint8_t* buf,
+  uint32_t len, uint64_t ready)
+{
+  uint32_t size = th->cfg->mfifo_size;
+  uint32_t tail = (th->fifo_head + (uint32_t) (th->loaded - th->stored)) % size;
+  uint32_t i;
+
+  for (i = 0; i < len; i++)
+    th->fifo[(tail + i) % size] = buf[i];
+  th->loaded += len;
+  th->chunks[(th->chunk_head + th->chunk_count) % (size + 1)].end = th->loaded;
+  th->chunks[(th->chunk_head + th->chunk_count) % (size + 1)].ready = ready;
+  th->chunk_count++;
+}
+
+static void pl330_fifo_get(struct pl330_thread* th, uint8_t* buf, uint32_t len)
+{
+  uint32_t size = th->cfg->mfifo_size;
+  uint32_t i;
+
+  for (i = 0; i < len; i++)
+    buf[i] = th->fifo[(th->fifo_head + i) % size];
+  th->fifo_head = (th->fifo_head + len) % size;
+  th->stored += len;
+  while ((th->chunk_count > 0) && (th->chunks[th->chunk_head].end <= th->stored))
+  {
+    th->chunk_head = (th->chunk_head + 1) % (size + 1);
+    th->chunk_count--;
+  }
+}
+
+//Space freed by the stores until t
+static void pl330_free_until(struct pl330_thread* th, uint64_t t)
+{
+  while ((th->free_count > 0) && (th->frees[th->free_head].time <= t))
+  {
+    th->freed += th->frees[th->free_head].bytes;
+    th->free_head = (th->free_head + 1) % (th->cfg->max_writes + 1);
+    th->free_count--;
+  }
+}
+
+static bool pl330_fault(struct pl330_thread* th, uint32_t pc, const char* why)
+{
+  th->stats->fault = why;
+  th->stats->fault_pc = pc;
+  return false;
+}
+
+//Check the Bytes of a burst are in a region and count them
+static int pl330_burst_region(struct pl330_thread* th, uint32_t addr,
+  bool inc, uint32_t beats, uint32_t beat)
+{
+  uint32_t span = inc ? pl330_burst_bytes(addr, true, beats, beat) :
+    beat - (addr & (beat - 1));
+
+  if ((addr >> 12) != ((addr + span - 1) >> 12))
+    th->stats->bursts_4k++;
+  return pl330_region(th->cfg, addr, span);
+}
+
+//---------------------------TRANSFERS-----------------------------------//
+static bool pl330_load(struct pl330_thread* th, uint32_t pc, bool single)
+{
+  PL330_SIM_STATS_t* s = th->stats;
+  uint32_t beat = 1u << PL330_CCR_SS(th->ccr);
+  uint32_t beats = single ? 1 : PL330_CCR_SB(th->ccr);
+  bool inc = PL330_CCR_SAI(th->ccr);
+  uint32_t n = pl330_burst_bytes(th->sar, inc, beats, beat);
+  uint8_t buf[16*8];
+  const PL330_REGION_t* r;
+  uint64_t start = th->t;
+  uint64_t data_start;
+  uint32_t cycles;
+  int reg;
+
+  reg = pl330_burst_region(th, th->sar, inc, beats, beat);
+  if (reg < 0)
+    return pl330_fault(th, pc, "DMALD from an address with no slave");
+  r = &th->cfg->regions[reg];
+
+  //space in the MFIFO
+  if (th->loaded - th->stored + n > th->cfg->mfifo_size)
+    return pl330_fault(th, pc, "DMALD needs more space than the MFIFO has");
+  pl330_free_until(th, th->t);
+  while (th->loaded - th->freed + n > th->cfg->mfifo_size)
+  {
+    th->t = th->frees[th->free_head].time;
+    pl330_free_until(th, th->t);
+  }
+  pl330_wait_outstanding(th, &th->rd_out);
+  s->stall_cycles += th->t - start;
+
+  //read burst
+  cycles = beats*((beat + r->width - 1)/r->width);
+  data_start = th->t + r->rd_latency;
+  if (data_start < th->rd_free)
+    data_start = th->rd_free;
+  th->rd_free = data_start + cycles;
+  if (th->rd_free > th->rd_last)
+    th->rd_last = th->rd_free;
+  pl330_queue_push(&th->rd_out, th->rd_free);
+
+  pl330_burst_data(th->mem, th->sar, inc, beats, beat, buf, false);
+  pl330_fifo_put(th, buf, n, th->rd_free);
+  if (inc)
+    th->sar += n;
+
+  s->rd_bursts++;
+  s->rd_beats += beats;
+  s->rd_bytes += n;
+  s->rd_busy += cycles;
+  s->region_rd[reg] += n;
+  return true;
+}
+
+static bool pl330_store(struct pl330_thread* th, uint32_t pc, bool single,
+  bool zero)
+{
+  PL330_SIM_STATS_t* s = th->stats;
+  uint32_t beat = 1u << PL330_CCR_DS(th->ccr);
+  uint32_t beats = single ? 1 : PL330_CCR_DB(th->ccr);
+  bool inc = PL330_CCR_DAI(th->ccr);
+  uint32_t n = pl330_burst_bytes(th->dar, inc, beats, beat);
+  uint8_t buf[16*8];
+  const PL330_REGION_t* r;
+  uint64_t start = th->t;
+  uint64_t data_start;
+  uint64_t data_end;
+  uint64_t last_ready;
+  uint32_t cycles;
+  int reg;
+
+  reg = pl330_burst_region(th, th->dar, inc, beats, beat);
+  if (reg < 0)
+    return pl330_fault(th, pc, "DMAST to an address with no slave");
+  r = &th->cfg->regions[reg];
+  if (!zero && (th->loaded - th->stored < n))
+    return pl330_fault(th, pc, "DMAST without enough data in the MFIFO");
+  pl330_wait_outstanding(th, &th->wr_out);
+  s->stall_cycles += th->t - start;
+
+  //write burst: the data is sent when it is in the MFIFO
+  cycles = beats*((beat + r->width - 1)/r->width);
+  data_start = th->t;
+  if (data_start < th->wr_free)
+    data_start = th->wr_free;
+  if (!zero)
+  {
+    if (data_start < pl330_chunk_ready(th, th->stored))
+      data_start = pl330_chunk_ready(th, th->stored);
+    last_ready = pl330_chunk_ready(th, th->stored + n - 1);
+  }
+  else
+    last_ready = 0;
+  data_end = data_start + cycles;
+  if (data_end < last_ready + 1)
+    data_end = last_ready + 1;
+  th->wr_free = data_end;
+  if (data_end + r->wr_latency > th->wr_last)
+    th->wr_last = data_end + r->wr_latency;
+  pl330_queue_push(&th->wr_out, data_end + r->wr_latency);
+
+  if (zero)
+    memset(buf, 0, n);
+  else
+  {
+    pl330_fifo_get(th, buf, n);
+    //the space is free when the data is sent
+    //(there are less than max_writes bursts outstanding, so there is space)
+    pl330_free_until(th, th->t);
+    th->frees[(th->free_head + th->free_count) % (th->cfg->max_writes + 1)].time = data_end;
+    th->frees[(th->free_head + th->free_count) % (th->cfg->max_writes + 1)].bytes = n;
+    th->free_count++;
+  }
+  pl330_burst_data(th->mem, th->dar, inc, beats, beat, buf, true);
+  if (inc)
+    th->dar += n;
+
+  s->wr_bursts++;
+  s->wr_beats += beats;
+  s->wr_bytes += n;
+  s->wr_busy += data_end - data_start;
+  s->region_wr[reg] += n;
+  return true;
+}
+
+//Conditional instructions are executed with the request of the last DMAWFP
+static bool pl330_cond_ok(struct pl330_thread* th, PL330_COND_t cond)
+{
+  return (cond == PL330_COND_NONE) || (cond == th->req);
+}
+
+//------------------------------EXECUTION--------------------------------//
+static bool pl330_step(struct pl330_thread* th, const uint8_t* code,
+  uint32_t size, uint32_t* pc)
+{
+  PL330_INST_t inst;
+  char text[192];
+  uint32_t occupancy;
+
+  if (!pl330_decode(code, size, *pc, &inst))
+    return pl330_fault(th, *pc, (*pc >= size) ?
+      "the program runs out of the microcode" : "invalid instruction");
+  pl330_fetch(th, *pc, inst.size);
+  th->t++;
+  th->stats->instructions++;
+  occupancy = (uint32_t) (th->loaded - th->stored);
+  th->stats->mfifo_sum += occupancy;
+  if (occupancy > th->stats->mfifo_max)
+    th->stats->mfifo_max = occupancy;
+  if (th->cfg->trace != NULL)
+  {
+    pl330_format(&inst, text, sizeof(text));
+    fprintf(th->cfg->trace, "%10llu  %04x  %-40s SAR %08x DAR %08x MFIFO %u\n",
+      (unsigned long long) th->t, *pc, text, th->sar, th->dar, occupancy);
+  }
+  *pc += inst.size;
+
+  switch (inst.op)
+  {
+    case PL330_OP_END:
+      //wait for the outstanding bursts
+      if (th->rd_last > th->t)
+        th->t = th->rd_last;
+      if (th->wr_last > th->t)
+        th->t = th->wr_last;
+      if (th->loaded != th->stored)
+        return pl330_fault(th, inst.offset, "DMAEND with data in the MFIFO");
+      th->stats->ended = true;
+      return true;
+    case PL330_OP_KILL:
+      return pl330_fault(th, inst.offset, "DMAKILL");
+    case PL330_OP_GO:
+      return pl330_fault(th, inst.offset, "DMAGO in a channel thread");
+    case PL330_OP_MOV:
+      if (inst.reg == ALT_DMA_PROGRAM_REG_SAR)
+        th->sar = inst.imm;
+      else if (inst.reg == ALT_DMA_PROGRAM_REG_DAR)
+        th->dar = inst.imm;
+      else
+      {
+        if ((PL330_CCR_SS(inst.imm) > PL330_MAX_BEAT_SIZE_CODE) ||
+          (PL330_CCR_DS(inst.imm) > PL330_MAX_BEAT_SIZE_CODE))
+          return pl330_fault(th, inst.offset, "CCR with beats bigger than the bus");
+        th->ccr = inst.imm;
+      }
+      return true;
+    case PL330_OP_ADDH:
+    case PL330_OP_ADNH:
+      if (inst.op == PL330_OP_ADNH)
+        inst.imm |= 0xFFFF0000;
+      if (inst.reg == ALT_DMA_PROGRAM_REG_SAR)
+        th->sar += inst.imm;
+      else
+        th->dar += inst.imm;
+      return true;
+    case PL330_OP_LD:
+    case PL330_OP_LDP:
+      if (!pl330_cond_ok(th, inst.cond))
+        return true;
+      return pl330_load(th, inst.offset, inst.cond == PL330_COND_SINGLE);
+    case PL330_OP_ST:
+    case PL330_OP_STP:
+      if (!pl330_cond_ok(th, inst.cond))
+        return true;
+      return pl330_store(th, inst.offset, inst.cond == PL330_COND_SINGLE,
+        false);
+    case PL330_OP_STZ:
+      return pl330_store(th, inst.offset, false, true);
+    case PL330_OP_RMB:
+      if (th->rd_last > th->t)
+      {
+        th->stats->stall_cycles += th->rd_last - th->t;
+        th->t = th->rd_last;
+      }
+      return true;
+    case PL330_OP_WMB:
+      if (th->wr_last > th->t)
+      {
+        th->stats->stall_cycles += th->wr_last - th->t;
+        th->t = th->wr_last;
+      }
+      return true;
+    case PL330_OP_LP:
+      th->lc[inst.lc] = inst.imm - 1;
+      return true;
+    case PL330_OP_LPEND:
+      if (!pl330_cond_ok(th, inst.cond))
+        return true;
+      if (inst.forever)
+        *pc = inst.offset - inst.imm;
+      else if (th->lc[inst.lc] != 0)
+      {
+        th->lc[inst.lc]--;
+        *pc = inst.offset - inst.imm;
+      }
+      return true;
+    case PL330_OP_WFP:
+      th->req = (inst.cond == PL330_COND_PERIPH) ? th->cfg->periph_req :
+        inst.cond;
+      return true;
+    case PL330_OP_SEV:
+      th->stats->events |= 1u << inst.num;
+      return true;
+    case PL330_OP_WFE:
+      if (!(th->stats->events & (1u << inst.num)))
+        return pl330_fault(th, inst.offset, "DMAWFE of an event not sent");
+      th->stats->events &= ~(1u << inst.num);
+      return true;
+    default:
+      return true; //DMANOP and DMAFLUSHP
+  }
+}
+
+bool pl330_sim_run(const PL330_SIM_CONFIG_t* cfg, PL330_SIM_MEM_t* mem,
+  const uint8_t* code, uint32_t size, PL330_SIM_STATS_t* stats)
+{
+  struct pl330_thread th;
+  uint32_t pc = 0;
+  bool ok = true;
+
+  memset(stats, 0, sizeof(*stats));
+  memset(&th, 0, sizeof(th));
+  th.cfg = cfg;
+  th.mem = mem;
+  th.stats = stats;
+  th.req = PL330_COND_NONE;
+  th.fifo = malloc(cfg->mfifo_size);
+  th.chunks = malloc((cfg->mfifo_size + 1)*sizeof(struct pl330_chunk));
+  th.frees = malloc((cfg->max_writes + 1)*sizeof(struct pl330_free));
+  th.rd_out.size = cfg->max_reads;
+  th.rd_out.time = malloc(cfg->max_reads*sizeof(uint64_t));
+  th.wr_out.size = cfg->max_writes;
+  th.wr_out.time = malloc(cfg->max_writes*sizeof(uint64_t));
+  if ((th.fifo == NULL) || (th.chunks == NULL) || (th.frees == NULL) ||
+    (th.rd_out.time == NULL) || (th.wr_out.time == NULL) ||
+    (cfg->mfifo_size == 0) || (cfg->max_reads == 0) || (cfg->max_writes == 0))
+    ok = pl330_fault(&th, 0, "bad configuration of the simulation");
+
+  while (ok && !stats->ended)
+  {
+    if (stats->instructions == cfg->max_instructions)
+    {
+      ok = pl330_fault(&th, pc, "too many instructions (forever loop?)");
+      break;
+    }
+    ok = pl330_step(&th, code, size, &pc);
+  }
+
+  stats->cycles = th.t;
+  stats->sar = th.sar;
+  stats->dar = th.dar;
+  stats->ccr = th.ccr;
+  free(th.fifo);
+  free(th.chunks);
+  free(th.frees);
+  free(th.rd_out.time);
+  free(th.wr_out.time);
+  return ok;
+}
+
+void pl330_sim_print_stats(FILE* out, const PL330_SIM_CONFIG_t* cfg,
+  const PL330_SIM_STATS_t* stats)
+{
+  uint32_t i;
+
+  if (stats->fault != NULL)
+    fprintf(out, "fault:              %s (0x%04x)\n", stats->fault,
+      stats->fault_pc);
+  else
+    fprintf(out, "result:             DMAEND\n");
+  fprintf(out, "cycles:             %llu (%.2f us at %u MHz)\n",
+    (unsigned long long) stats->cycles,
+    (double) stats->cycles/cfg->clock_mhz, cfg->clock_mhz);
+  fprintf(out, "instructions:       %llu (%llu icache misses)\n",
+    (unsigned long long) stats->instructions,
+    (unsigned long long) stats->icache_misses);
+  fprintf(out, "stall cycles:       %llu\n",
+    (unsigned long long) stats->stall_cycles);
+  fprintf(out, "reads:              %llu bursts, %llu beats, %llu Bytes, busy %llu cycles\n",
+    (unsigned long long) stats->rd_bursts,
+    (unsigned long long) stats->rd_beats,
+    (unsigned long long) stats->rd_bytes,
+    (unsigned long long) stats->rd_busy);
+  fprintf(out, "writes:             %llu bursts, %llu beats, %llu Bytes, busy %llu cycles\n",
+    (unsigned long long) stats->wr_bursts,
+    (unsigned long long) stats->wr_beats,
+    (unsigned long long) stats->wr_bytes,
+    (unsigned long long) stats->wr_busy);
+  if (stats->bursts_4k != 0)
+    fprintf(out, "4kB crossings:      %llu bursts\n",
+      (unsigned long long) stats->bursts_4k);
+  fprintf(out, "MFIFO:              max %u Bytes of %u, mean %.1f Bytes\n",
+    stats->mfifo_max, cfg->mfifo_size, (stats->instructions == 0) ? 0.0 :
+    (double) stats->mfifo_sum/stats->instructions);
+  if (stats->cycles != 0)
+    fprintf(out, "throughput:         %.3f Bytes/cycle, %.1f MB/s\n",
+      (double) stats->wr_bytes/stats->cycles,
+      (double) stats->wr_bytes*cfg->clock_mhz/stats->cycles);
+  for (i = 0; i < cfg->num_regions; i++)
+    if ((stats->region_rd[i] != 0) || (stats->region_wr[i] != 0))
+      fprintf(out, "  %-6s            read %llu Bytes, written %llu Bytes\n",
+        cfg->regions[i].name, (unsigned long long) stats->region_rd[i],
+        (unsigned long long) stats->region_wr[i]);
+  fprintf(out, "SAR DAR CCR:        0x%08x 0x%08x 0x%08x\n", stats->sar,
+    stats->dar, stats->ccr);
+  if (stats->events != 0)
+    fprintf(out, "events:             0x%02x\n", stats->events);
+}
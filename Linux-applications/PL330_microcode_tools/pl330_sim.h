@@ -0,0 +1,106 @@
+/**
+ * @file    pl330_sim.h
+ * @brief  Cycle-approximate model of a channel thread of the PL330 DMAC and
+ * its MFIFO for the host PC. It executes microcode against a simulated
+ * address map (SDRAM, ACP, HPS-to-FPGA bridges, HPS OCR) with the latency and
+ * width of each region, moves the data in a simulated memory and reports
+ * beats, Bytes, MFIFO occupancy and an estimation of the cycles.
+*/
+#ifndef _PL330_SIM_H
+#define _PL330_SIM_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "pl330_disasm.h"
+
+#define PL330_SIM_MAX_REGIONS 8
+
+//Slave reached by the DMAC in an address window
+typedef struct PL330_REGION_s
+{
+  char name[16];
+  uint32_t start;
+  uint32_t size;
+  uint32_t width;        //Bytes per cycle of the slave
+  uint32_t rd_latency;   //cycles from the read address to the first data
+  uint32_t wr_latency;   //cycles from the last data to the write response
+}
+PL330_REGION_t;
+
+typedef struct PL330_SIM_CONFIG_s
+{
+  PL330_REGION_t regions[PL330_SIM_MAX_REGIONS];
+  uint32_t num_regions;
+  uint32_t mfifo_size;       //Bytes of the MFIFO
+  uint32_t max_reads;        //outstanding read bursts of the channel
+  uint32_t max_writes;       //outstanding write bursts of the channel
+  uint32_t clock_mhz;        //clock of the DMAC, to compute MB/s
+  uint32_t prog_addr;        //hardware address of the microcode
+  PL330_COND_t periph_req;   //request given by peripherals in DMAWFP periph
+  uint64_t max_instructions; //to stop forever loops
+  FILE* trace;               //print each instruction executed (or NULL)
+}
+PL330_SIM_CONFIG_t;
+
+//Sparse memory of the 4GB address space. Pages not written read as 0.
+typedef struct PL330_SIM_MEM_s PL330_SIM_MEM_t;
+
+typedef struct PL330_SIM_STATS_s
+{
+  uint64_t cycles;           //from the first fetch to the last write response
+  uint64_t instructions;     //instructions executed
+  uint64_t icache_misses;
+  uint64_t stall_cycles;     //cycles the thread waited for the MFIFO or AXI
+  uint64_t rd_bursts;
+  uint64_t rd_beats;
+  uint64_t rd_bytes;
+  uint64_t rd_busy;          //cycles with data in the read channel
+  uint64_t wr_bursts;
+  uint64_t wr_beats;
+  uint64_t wr_bytes;
+  uint64_t wr_busy;          //cycles with data in the write channel
+  uint64_t bursts_4k;        //bursts crossing a 4kB boundary
+  uint32_t mfifo_max;        //max Bytes in the MFIFO
+  uint64_t mfifo_sum;        //Bytes in the MFIFO added in each instruction
+  uint64_t region_rd[PL330_SIM_MAX_REGIONS]; //Bytes read of each region
+  uint64_t region_wr[PL330_SIM_MAX_REGIONS]; //Bytes written of each region
+  uint32_t events;           //bit i set if DMASEV i was executed
+  uint32_t sar;              //registers at the end
+  uint32_t dar;
+  uint32_t ccr;
+  bool ended;                //the program reached DMAEND
+  const char* fault;         //reason of the fault or NULL
+  uint32_t fault_pc;         //offset of the instruction with the fault
+}
+PL330_SIM_STATS_t;
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Configuration of the DE1-SoC: regions of the address map with approximate
+//latencies, MFIFO and outstanding bursts of the DMAC of Cyclone V
+void pl330_sim_default_config(PL330_SIM_CONFIG_t* cfg);
+
+//Add a region or change the region with the same name. Returns false if
+//there is no space for more regions.
+bool pl330_sim_set_region(PL330_SIM_CONFIG_t* cfg, const char* name,
+  uint32_t start, uint32_t size, uint32_t width, uint32_t rd_latency,
+  uint32_t wr_latency);
+
+PL330_SIM_MEM_t* pl330_sim_mem_create(void);
+void pl330_sim_mem_destroy(PL330_SIM_MEM_t* mem);
+void pl330_sim_mem_read(PL330_SIM_MEM_t* mem, uint32_t addr, uint8_t* buf,
+  uint32_t len);
+void pl330_sim_mem_write(PL330_SIM_MEM_t* mem, uint32_t addr,
+  const uint8_t* buf, uint32_t len);
+
+//Execute the microcode (size Bytes) in a channel. Returns true if the
+//program ended with DMAEND and false if the channel faulted (stats->fault).
+bool pl330_sim_run(const PL330_SIM_CONFIG_t* cfg, PL330_SIM_MEM_t* mem,
+  const uint8_t* code, uint32_t size, PL330_SIM_STATS_t* stats);
+
+//Write the statistics of a simulation
+void pl330_sim_print_stats(FILE* out, const PL330_SIM_CONFIG_t* cfg,
+  const PL330_SIM_STATS_t* stats);
+
+#endif
@@ -0,0 +1,416 @@
+//Simulator of PL330 microcode in the host PC. It can simulate:
+//-A dump of microcode or of a ALT_DMA_PROGRAM_t (as pl330_disasm).
+//-The program generated by alt_dma.c for a memory to memory transfer (-g).
+// The source is filled with a pattern and the destiny is checked after the
+// simulation, also the Bytes around it. Then the program is patched with
+// alt_dma_memory_to_memory_patch() (as the cache of programs of the driver)
+// to other addresses of the same alignment and simulated and checked again.
+//-A regression of the generator of alt_dma.c (-t): transfers of many sizes,
+// alignments and bursts are generated, validated, simulated and checked
+// (also patched, as in -g). It prints the cycles of each burst, so the
+// performance of two versions of alt_dma.c can be compared.
+//Returns 0 if all is right, 1 if there are faults or wrong data and 2 if the
+//arguments or the dump are wrong.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "pl330_sim.h"
+#include "alt_dma.h"
+
+#define MAX_DUMP_SIZE 65536 //largest program buffer supported by hwlib
+#define GUARD_SIZE    64    //Bytes checked before and after the destiny
+#define PATCH_OFFSET  0x20000 //added to src and dst to test the patch
+
+//Regression: source in SDRAM, destiny in the HPS-to-FPGA bridge
+#define TEST_SRC 0x00100000
+#define TEST_DST 0xC0000000
+
+static const uint32_t test_sizes[] = {
+  1, 2, 3, 7, 8, 9, 15, 16, 17, 31, 64, 127, 128, 129, 255, 256, 1000, 4095,
+  4096, 4097, 32768, 65539
+};
+
+static const ALT_DMA_BURST_t test_bursts[] = {
+  {8, 16}, {8, 8}, {8, 4}, {8, 1}, {4, 16}, {4, 4}, {2, 16}, {1, 16}, {1, 1}
+};
+
+static void usage(const char* name)
+{
+  fprintf(stderr,
+    "Usage: %s [options] [-p] [-x] file\n"
+    "       %s [options] -g dst,src,size[,beat,length]\n"
+    "       %s [options] -t\n"
+    "  file     dump of microcode to simulate (- for stdin)\n"
+    "  -p       the dump is a ALT_DMA_PROGRAM_t, not raw microcode\n"
+    "  -x       the dump is hexadecimal text (i.e. from xxd -p or hexdump)\n"
+    "  -g       simulate the program of alt_dma.c for a memory to memory\n"
+    "           transfer with bursts of length beats of beat Bytes (8,16)\n"
+    "  -t       regression of the programs of alt_dma.c\n"
+    "options:\n"
+    "  -r name,start,size,width,rd_latency,wr_latency\n"
+    "           add a region of the address map or change it\n"
+    "  -m bytes MFIFO size (256)\n"
+    "  -o reads,writes  outstanding bursts of the channel (8,8)\n"
+    "  -c mhz   clock of the DMAC (100)\n"
+    "  -a addr  hardware address of the microcode (0xFFFF0020)\n"
+    "  -v       print each instruction executed\n",
+    name, name, name);
+}
+
+//Read the hexadecimal digits of the text in buf (as pl330_disasm)
+static size_t parse_hex(const char* text, size_t len, uint8_t* buf, size_t max)
+{
+  size_t n = 0;
+  size_t i = 0;
+
+  while ((i < len) && (n < max))
+  {
+    if ((text[i] == '0') && (i + 1 < len) &&
+      ((text[i+1] == 'x') || (text[i+1] == 'X')))
+    {
+      i += 2;
+      continue;
+    }
+    if (isxdigit((unsigned char) text[i]) && (i + 1 < len) &&
+      isxdigit((unsigned char) text[i+1]))
+    {
+      char byte[3] = {text[i], text[i+1], 0};
+      buf[n++] = (uint8_t) strtoul(byte, NULL, 16);
+      i += 2;
+      continue;
+    }
+    i++;
+  }
+  return n;
+}
+
+//Program of alt_dma.c for a transfer. The struct is placed as in the driver
+//(16B + a multiple of 32B) so the microcode starts in a line of the cache.
+static ALT_DMA_PROGRAM_t* generate(uint32_t dst, uint32_t src, uint32_t size,
+  const ALT_DMA_BURST_t* burst)
+{
+  static uint8_t space[sizeof(ALT_DMA_PROGRAM_t) + 64]
+    __attribute__((aligned(32)));
+  ALT_DMA_PROGRAM_t* pgm = (ALT_DMA_PROGRAM_t*) (space + 16);
+  ALT_STATUS_CODE status;
+
+  status = alt_dma_memory_to_memory_only_prepare_program_burst(
+    ALT_DMA_CHANNEL_0, pgm, pgm, (void*) (uintptr_t) dst,
+    (const void*) (uintptr_t) src, size, false, ALT_DMA_EVENT_0, burst);
+  return (status == ALT_E_SUCCESS) ? pgm : NULL;
+}
+
+static uint8_t pattern(uint32_t i)
+{
+  return (uint8_t) (i*7 + (i >> 8) + 1);
+}
+
+//Fill the source and the guards of the destiny
+static void prepare_data(PL330_SIM_MEM_t* mem, uint32_t dst, uint32_t src,
+  uint32_t size, uint8_t* buf)
+{
+  uint32_t i;
+
+  for (i = 0; i < size; i++)
+    buf[i] = pattern(i);
+  pl330_sim_mem_write(mem, src, buf, size);
+  memset(buf, 0xA5, size + 2*GUARD_SIZE);
+  pl330_sim_mem_write(mem, dst - GUARD_SIZE, buf, size + 2*GUARD_SIZE);
+}
+
+//Bytes wrong in the destiny and its guards
+static uint32_t check_data(PL330_SIM_MEM_t* mem, uint32_t dst, uint32_t size,
+  uint8_t* buf)
+{
+  uint32_t wrong = 0;
+  uint32_t i;
+
+  pl330_sim_mem_read(mem, dst - GUARD_SIZE, buf, size + 2*GUARD_SIZE);
+  for (i = 0; i < size + 2*GUARD_SIZE; i++)
+  {
+    if ((i < GUARD_SIZE) || (i >= GUARD_SIZE + size))
+      wrong += (buf[i] != 0xA5);
+    else
+      wrong += (buf[i] != pattern(i - GUARD_SIZE));
+  }
+  return wrong;
+}
+
+//Patch the SAR and DAR of a program, simulate it and check the data
+static bool run_patched(const PL330_SIM_CONFIG_t* cfg, PL330_SIM_MEM_t* mem,
+  ALT_DMA_PROGRAM_t* pgm, uint32_t dst, uint32_t src, uint32_t size,
+  const ALT_DMA_BURST_t* burst, uint8_t* buf, bool verbose)
+{
+  PL330_SIM_STATS_t sim;
+  const uint8_t* code;
+  uint32_t code_size;
+  uint32_t wrong;
+  bool ok;
+
+  if (alt_dma_memory_to_memory_patch(pgm, (void*) (uintptr_t) dst,
+    (const void*) (uintptr_t) src) != ALT_E_SUCCESS)
+  {
+    printf("dst 0x%08x src 0x%08x size %u burst %ux%u: patch refused\n",
+      dst, src, size, burst->length, burst->size);
+    return false;
+  }
+
+  prepare_data(mem, dst, src, size, buf);
+  code = pl330_program_code(pgm, &code_size);
+  ok = pl330_sim_run(cfg, mem, code, code_size, &sim);
+  wrong = check_data(mem, dst, size, buf);
+  ok = ok && (wrong == 0);
+  if (!ok || verbose)
+  {
+    printf("patched to dst 0x%08x src 0x%08x size %u burst %ux%u: %s, %u Bytes wrong\n",
+      dst, src, size, burst->length, burst->size,
+      (sim.fault != NULL) ? sim.fault : "DMAEND", wrong);
+  }
+  return ok;
+}
+
+//Generate, validate, simulate and check one transfer, and again after
+//patching its addresses. Returns false if any step fails (printing why if
+//verbose).
+static bool run_transfer(const PL330_SIM_CONFIG_t* cfg, PL330_SIM_MEM_t* mem,
+  uint32_t dst, uint32_t src, uint32_t size, const ALT_DMA_BURST_t* burst,
+  uint8_t* buf, bool verbose, PL330_SIM_STATS_t* sim)
+{
+  ALT_DMA_PROGRAM_t* pgm;
+  PL330_STATS_t stats;
+  const uint8_t* code;
+  uint32_t code_size;
+  uint32_t wrong;
+  bool ok = true;
+
+  pgm = generate(dst, src, size, burst);
+  if (pgm == NULL)
+  {
+    printf("dst 0x%08x src 0x%08x size %u burst %ux%u: alt_dma.c fails\n",
+      dst, src, size, burst->length, burst->size);
+    return false;
+  }
+  if (pl330_validate_program(pgm, cfg->prog_addr -
+    (uint32_t) offsetof(ALT_DMA_PROGRAM_t, program), verbose ? stdout : NULL,
+    &stats) != 0)
+    ok = false;
+  if (verbose)
+  {
+    pl330_disassemble(stdout, pl330_program_code(pgm, &code_size),
+      pgm->code_size, cfg->prog_addr);
+    printf("\n");
+  }
+
+  prepare_data(mem, dst, src, size, buf);
+  code = pl330_program_code(pgm, &code_size);
+  if (!pl330_sim_run(cfg, mem, code, code_size, sim))
+    ok = false;
+  wrong = check_data(mem, dst, size, buf);
+  if (wrong != 0)
+    ok = false;
+
+  if (!ok || verbose)
+  {
+    printf("dst 0x%08x src 0x%08x size %u burst %ux%u: %u errors, %s, %u Bytes wrong\n",
+      dst, src, size, burst->length, burst->size, stats.errors,
+      (sim->fault != NULL) ? sim->fault : "DMAEND", wrong);
+  }
+  if (!ok)
+    return false;
+
+  //A change of the 8-byte alignment must be refused without touching the
+  //program. The same alignment must move the data to the new addresses.
+  if (alt_dma_memory_to_memory_patch(pgm, (void*) (uintptr_t) (dst + 1),
+    (const void*) (uintptr_t) src) != ALT_E_BAD_ARG)
+  {
+    printf("dst 0x%08x src 0x%08x size %u burst %ux%u: patch with other alignment not refused\n",
+      dst, src, size, burst->length, burst->size);
+    return false;
+  }
+  return run_patched(cfg, mem, pgm, dst + PATCH_OFFSET, src + PATCH_OFFSET,
+    size, burst, buf, verbose);
+}
+
+//Regression of the generator of alt_dma.c
+static int regression(const PL330_SIM_CONFIG_t* cfg, PL330_SIM_MEM_t* mem,
+  uint8_t* buf)
+{
+  PL330_SIM_STATS_t sim;
+  uint32_t nsizes = sizeof(test_sizes)/sizeof(test_sizes[0]);
+  uint32_t nbursts = sizeof(test_bursts)/sizeof(test_bursts[0]);
+  uint32_t b, s, so, dof;
+  uint32_t cases;
+  uint32_t failures;
+  uint32_t total_failures = 0;
+  uint64_t cycles;
+  uint64_t bytes;
+
+  for (b = 0; b < nbursts; b++)
+  {
+    cases = 0;
+    failures = 0;
+    cycles = 0;
+    bytes = 0;
+    for (s = 0; s < nsizes; s++)
+      for (so = 0; so < 8; so++)
+        for (dof = 0; dof < 8; dof++)
+        {
+          cases++;
+          if (!run_transfer(cfg, mem, TEST_DST + dof, TEST_SRC + so,
+            test_sizes[s], &test_bursts[b], buf, false, &sim))
+            failures++;
+          cycles += sim.cycles;
+          bytes += sim.wr_bytes;
+        }
+    printf("burst %2ux%u: %u transfers, %u failures, %llu Bytes in %llu cycles (%.3f Bytes/cycle)\n",
+      test_bursts[b].length, test_bursts[b].size, cases, failures,
+      (unsigned long long) bytes, (unsigned long long) cycles,
+      (cycles == 0) ? 0.0 : (double) bytes/cycles);
+    total_failures += failures;
+  }
+  printf("%u failures\n", total_failures);
+  return (total_failures == 0) ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+  static uint8_t raw[2*MAX_DUMP_SIZE];
+  static uint8_t dump[MAX_DUMP_SIZE];
+  PL330_SIM_CONFIG_t cfg;
+  PL330_SIM_STATS_t sim;
+  PL330_SIM_MEM_t* mem;
+  ALT_DMA_PROGRAM_t pgm;
+  ALT_DMA_BURST_t burst = {8, 16};
+  const uint8_t* code;
+  uint8_t* buf;
+  FILE* f;
+  size_t len;
+  uint32_t size;
+  uint32_t dst, src, tsize;
+  uint32_t a, b, c, d, e;
+  char name[16];
+  const char* gen = NULL;
+  int is_program = 0;
+  int is_hex = 0;
+  int test = 0;
+  int ret;
+  int opt;
+
+  pl330_sim_default_config(&cfg);
+  while ((opt = getopt(argc, argv, "pxg:tr:m:o:c:a:v")) != -1)
+  {
+    switch (opt)
+    {
+      case 'p': is_program = 1; break;
+      case 'x': is_hex = 1; break;
+      case 'g': gen = optarg; break;
+      case 't': test = 1; break;
+      case 'r':
+        if ((sscanf(optarg, "%15[^,],%i,%i,%u,%u,%u", name, &a, &b, &c, &d,
+          &e) != 6) || !pl330_sim_set_region(&cfg, name, a, b, c, d, e))
+        {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 'm': cfg.mfifo_size = (uint32_t) strtoul(optarg, NULL, 0); break;
+      case 'o':
+        if (sscanf(optarg, "%u,%u", &cfg.max_reads, &cfg.max_writes) != 2)
+        {
+          usage(argv[0]);
+          return 2;
+        }
+        break;
+      case 'c': cfg.clock_mhz = (uint32_t) strtoul(optarg, NULL, 0); break;
+      case 'a': cfg.prog_addr = (uint32_t) strtoul(optarg, NULL, 0); break;
+      case 'v': cfg.trace = stdout; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if ((cfg.clock_mhz == 0) || (test + (gen != NULL) + (optind < argc) != 1))
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  mem = pl330_sim_mem_create();
+  buf = malloc(2*MAX_DUMP_SIZE + 2*GUARD_SIZE);
+  if ((mem == NULL) || (buf == NULL))
+  {
+    fprintf(stderr, "No memory for the simulation\n");
+    return 2;
+  }
+
+  if (test)
+  {
+    cfg.trace = NULL;
+    ret = regression(&cfg, mem, buf);
+  }
+  else if (gen != NULL)
+  {
+    if ((sscanf(gen, "%i,%i,%i,%u,%u", &dst, &src, &tsize, &burst.size,
+      &burst.length) < 3) || (tsize > 2*MAX_DUMP_SIZE) ||
+      (dst < GUARD_SIZE))
+    {
+      usage(argv[0]);
+      return 2;
+    }
+    ret = run_transfer(&cfg, mem, dst, src, tsize, &burst, buf, true, &sim) ?
+      0 : 1;
+    printf("\n");
+    pl330_sim_print_stats(stdout, &cfg, &sim);
+  }
+  else
+  {
+    //Read the dump
+    if (strcmp(argv[optind], "-") == 0)
+      f = stdin;
+    else
+      f = fopen(argv[optind], "rb");
+    if (f == NULL)
+    {
+      perror(argv[optind]);
+      return 2;
+    }
+    len = fread(raw, 1, sizeof(raw), f);
+    if (f != stdin)
+      fclose(f);
+    if (is_hex)
+      len = parse_hex((const char*) raw, len, dump, sizeof(dump));
+    else
+    {
+      if (len > sizeof(dump))
+        len = sizeof(dump);
+      memcpy(dump, raw, len);
+    }
+    if (is_program)
+    {
+      memset(&pgm, 0, sizeof(pgm));
+      if (len > sizeof(pgm))
+        len = sizeof(pgm);
+      memcpy(&pgm, dump, len);
+      if ((len < offsetof(ALT_DMA_PROGRAM_t, program)) ||
+        (pgm.buffer_start >= ALT_DMA_PROGRAM_CACHE_LINE_SIZE) ||
+        (pgm.code_size > ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE))
+      {
+        fprintf(stderr, "The dump is not a ALT_DMA_PROGRAM_t\n");
+        return 2;
+      }
+      code = pl330_program_code(&pgm, &size);
+    }
+    else
+    {
+      code = dump;
+      size = (uint32_t) len;
+    }
+    ret = pl330_sim_run(&cfg, mem, code, size, &sim) ? 0 : 1;
+    pl330_sim_print_stats(stdout, &cfg, &sim);
+  }
+
+  free(buf);
+  pl330_sim_mem_destroy(mem);
+  return ret;
+}
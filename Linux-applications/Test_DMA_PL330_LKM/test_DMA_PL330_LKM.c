@@ -6,6 +6,11 @@
 #include <sys/mman.h>
 #include <errno.h>
 #include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <poll.h>
+
+#include "dma_pl330_ioctl.h" //mmap offsets and ioctls of DMA_PL330_LKM
 
 //Constants to do mmap and get access to FPGA peripherals
 #define HPS_FPGA_BRIDGE_BASE 0xC0000000
@@ -27,6 +32,13 @@
 //1 prepare microcode when open. It saves microcode preparation time 
 //later when calling read and write
 #define PREPARE_MICROCODE_WHEN_OPEN 0 
+//NUM_RECORDS: records moved with writev(), readv() and the batch ioctl. They
+//divide DMA_TRANSFER_SIZE
+#define NUM_RECORDS 4
+//CAPTURE_PERIODS and CAPTURE_PERIOD_SIZE: ring of the cyclic capture. The
+//period size must be a multiple of DMA_PL330_CAPTURE_BURST
+#define CAPTURE_PERIODS 4
+#define CAPTURE_PERIOD_SIZE 1024
 
 
 void printbuff(char* buff, int size)
@@ -42,6 +54,23 @@ void printbuff(char* buff, int size)
   printf("\n");
 }
 
+//Configure the open file f of the driver in a single ioctl
+int set_config(int f)
+{
+  struct dma_pl330_config config;
+  config.fpga_addr = DMA_BUFF_PADD;
+  config.use_acp = USE_ACP;
+  config.prepare_microcode = PREPARE_MICROCODE_WHEN_OPEN;
+  config.transfer_size = DMA_TRANSFER_SIZE;
+  config.sched_class = DMA_PL330_CLASS_BULK;
+  config.burst = 0; //profile of the address window
+  if (ioctl(f, DMA_PL330_IOC_SET_CONFIG, &config) < 0){
+    perror("Failed to configure /dev/dma_pl330.");
+    return -1;
+  }
+  return 0;
+}
+
 int main() {
   int i;
     
@@ -103,50 +132,10 @@ int main() {
   printf("Reset On-Chip RAM OK\n");
  
 
-  //----------------CONFIGURE THE DMA DRIVER THROUGH SYSFS---------------//
-  //Configure the driver through sysfs
-  int f_sysfs;
-  char d[14];
-  
-  printf("\nConfig. DMA_PL330 module using sysfs entries in /sys/dma_pl330\n");
-  sprintf(d, "%u", (uint32_t) DMA_BUFF_PADD);
-  f_sysfs = open("/sys/dma_pl330/pl330_lkm_attrs/dma_buff_padd", O_WRONLY);
-  if (f_sysfs < 0){
-    printf("Failed to open sysfs for dma_buff_padd.\n");
-    return errno;
-  }
-  write (f_sysfs, &d, 14);
-  close(f_sysfs);	
-  
-  sprintf(d, "%d", (int) USE_ACP);
-  f_sysfs = open("/sys/dma_pl330/pl330_lkm_attrs/use_acp", O_WRONLY);
-  if (f_sysfs < 0){
-    printf("Failed to open sysfs for use_acp.\n");
-    return errno;
-  }
-  write (f_sysfs, &d, 14);
-  close(f_sysfs);
-  
-  sprintf(d, "%d", (int) PREPARE_MICROCODE_WHEN_OPEN);
-  f_sysfs = open("/sys/dma_pl330/pl330_lkm_attrs/prepare_microcode_in_open", 
-    O_WRONLY);
-  if (f_sysfs < 0){
-    printf("Failed to open sysfs for prepare_microcode_in_open.\n");
-    return errno;
-  }
-  write (f_sysfs, &d,14);
-  close(f_sysfs);
-  
-  sprintf(d, "%d", (int) DMA_TRANSFER_SIZE);
-  f_sysfs = open("/sys/dma_pl330/pl330_lkm_attrs/dma_transfer_size", O_WRONLY);
-  if (f_sysfs < 0){
-    printf("Failed to open sysfs for dma_transfer_size.\n");
-    return errno;
-  }
-  write (f_sysfs, &d, 14);
-  close(f_sysfs);
-  printf("Sysfs configuration correct.\n");
-  printf("Sysfs values:");
+  //----------------CONFIGURATION OF THE DMA DRIVER---------------------//
+  //The driver is configured with ioctl(DMA_PL330_IOC_SET_CONFIG) after each
+  //open() (see set_config()). The configuration only affects that file.
+  printf("\nConfig. of DMA_PL330 module with ioctl(DMA_PL330_IOC_SET_CONFIG):");
   printf(" dma_buff_p:0x%x,", (unsigned int) DMA_BUFF_PADD);
   printf(" use_acp:%d,", USE_ACP);
   printf(" prepare_microcode_in_open:%d,", PREPARE_MICROCODE_WHEN_OPEN);
@@ -171,6 +160,7 @@ int main() {
     perror("Failed to open /dev/dma_pl330 on write...");
     return errno;
   }
+  if (set_config(f) < 0) return errno;
 	int ret = write(f, buffer, DMA_TRANSFER_SIZE);
 	if (ret < 0){
 	  perror("Failed to write the message to the device.");
@@ -205,6 +195,7 @@ int main() {
     perror("Failed to open /dev/dma_pl330 on read...");
     return errno;
   }
+  if (set_config(f) < 0) return errno;
   ret = read(f, buffer, DMA_TRANSFER_SIZE);
   if (ret < 0){
     perror("Failed to read the message from the device.");
@@ -223,6 +214,344 @@ int main() {
     printf("Read Error. Buffers are not equal\n");
 
 
+  //------------ZERO-COPY WRITE AND READ USING MMAP AND IOCTL-------------//
+  //The buffer of the driver is mapped into the application so no copy is
+  //needed between application and driver buffers
+  printf("\nZERO-COPY: Write and read %d Bytes using mmap and ioctl\n",
+    (int) DMA_TRANSFER_SIZE);
+  f=open("/dev/dma_pl330",O_RDWR);
+  if (f < 0){
+    perror("Failed to open /dev/dma_pl330 on zero-copy...");
+    return errno;
+  }
+  if (set_config(f) < 0) return errno;
+  uint32_t map_offset = (USE_ACP == 1) ?
+    DMA_PL330_MMAP_CACHED : DMA_PL330_MMAP_NON_CACHED;
+  size_t map_size = (DMA_TRANSFER_SIZE + getpagesize() - 1) &
+    ~(getpagesize() - 1);
+  char* dma_buff = (char*) mmap(NULL, map_size, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, map_offset);
+  if (dma_buff == MAP_FAILED){
+    perror("Failed to mmap /dev/dma_pl330.");
+    return errno;
+  }
+  struct dma_pl330_xfer xfer;
+  xfer.offset = map_offset;
+  xfer.len = DMA_TRANSFER_SIZE;
+  xfer.fpga_addr = 0; //use the fpga_addr of the configuration
+
+  //Write the mapped buffer to FPGA
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) dma_buff[i] = 4;
+  xfer.dir = DMA_PL330_DIR_TO_FPGA;
+  ret = ioctl(f, DMA_PL330_IOC_XFER, &xfer);
+  if (ret < 0){
+    perror("Failed to do zero-copy write.");
+    return errno;
+  }
+  if(memcmp((void*)dma_buff, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Zero-copy Write Successful!\n");
+  else
+    printf("Zero-copy Write Error. Buffers are not equal\n");
+
+  //Read from FPGA to the mapped buffer
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) dma_buff[i] = 5;
+  xfer.dir = DMA_PL330_DIR_FROM_FPGA;
+  ret = ioctl(f, DMA_PL330_IOC_XFER, &xfer);
+  if (ret < 0){
+    perror("Failed to do zero-copy read.");
+    return errno;
+  }
+  if(memcmp((void*)dma_buff, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Zero-copy Read Successful!\n");
+  else
+    printf("Zero-copy Read Error. Buffers are not equal\n");
+  munmap(dma_buff, map_size);
+
+  //------------WRITE AND READ A MALLOC BUFFER (SCATTER-GATHER)-------------//
+  //The driver pins the pages of the buffer and the DMA accesses them directly
+  printf("\nSCATTER-GATHER: Write and read %d Bytes from a malloc buffer\n",
+    (int) DMA_TRANSFER_SIZE);
+  char* user_buff = (char*) malloc(DMA_TRANSFER_SIZE);
+  if (user_buff == NULL){
+    printf("Failed to allocate the buffer for scatter-gather\n");
+    return 1;
+  }
+  struct dma_pl330_xfer_user xfer_user;
+  xfer_user.addr = (uintptr_t) user_buff;
+  xfer_user.len = DMA_TRANSFER_SIZE;
+  xfer_user.fpga_addr = DMA_BUFF_PADD;
+  xfer_user.reserved = 0;
+
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) user_buff[i] = 6;
+  xfer_user.dir = DMA_PL330_DIR_TO_FPGA;
+  ret = ioctl(f, DMA_PL330_IOC_XFER_USER, &xfer_user);
+  if (ret < 0){
+    perror("Failed to do scatter-gather write.");
+    return errno;
+  }
+  if(memcmp((void*)user_buff, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Scatter-gather Write Successful!\n");
+  else
+    printf("Scatter-gather Write Error. Buffers are not equal\n");
+
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) user_buff[i] = 7;
+  xfer_user.dir = DMA_PL330_DIR_FROM_FPGA;
+  ret = ioctl(f, DMA_PL330_IOC_XFER_USER, &xfer_user);
+  if (ret < 0){
+    perror("Failed to do scatter-gather read.");
+    return errno;
+  }
+  if(memcmp((void*)user_buff, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Scatter-gather Read Successful!\n");
+  else
+    printf("Scatter-gather Read Error. Buffers are not equal\n");
+  free(user_buff);
+
+  //------------WRITE AND READ RECORDS WITH WRITEV, READV AND BATCH----------//
+  //All the records of one call are moved with one DMA program
+  printf("\nVECTORED: Write and read %d records of %d Bytes\n",
+    NUM_RECORDS, (int) (DMA_TRANSFER_SIZE/NUM_RECORDS));
+  char records[NUM_RECORDS][DMA_TRANSFER_SIZE/NUM_RECORDS];
+  struct iovec iov[NUM_RECORDS];
+  for (i=0; i<NUM_RECORDS; i++){
+    memset(records[i], 8+i, sizeof(records[i]));
+    iov[i].iov_base = records[i];
+    iov[i].iov_len = sizeof(records[i]);
+  }
+  ret = writev(f, iov, NUM_RECORDS);
+  if (ret < 0){
+    perror("Failed to do writev.");
+    return errno;
+  }
+  if(memcmp((void*)records, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Writev Successful!\n");
+  else
+    printf("Writev Error. Buffers are not equal\n");
+
+  memset(records, 0, sizeof(records));
+  ret = readv(f, iov, NUM_RECORDS);
+  if (ret < 0){
+    perror("Failed to do readv.");
+    return errno;
+  }
+  if(memcmp((void*)records, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Readv Successful!\n");
+  else
+    printf("Readv Error. Buffers are not equal\n");
+
+  //The records are written in reverse order in the mapped buffer and the
+  //batch puts each one in its place in the FPGA
+  dma_buff = (char*) mmap(NULL, map_size, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, map_offset);
+  if (dma_buff == MAP_FAILED){
+    perror("Failed to mmap /dev/dma_pl330.");
+    return errno;
+  }
+  struct dma_pl330_xfer batch_xfers[NUM_RECORDS];
+  struct dma_pl330_batch batch;
+  int rec_size = DMA_TRANSFER_SIZE/NUM_RECORDS;
+  for (i=0; i<NUM_RECORDS; i++){
+    memset(dma_buff + (NUM_RECORDS-1-i)*rec_size, 12+i, rec_size);
+    batch_xfers[i].offset = map_offset + (NUM_RECORDS-1-i)*rec_size;
+    batch_xfers[i].len = rec_size;
+    batch_xfers[i].dir = DMA_PL330_DIR_TO_FPGA;
+    batch_xfers[i].fpga_addr = DMA_BUFF_PADD + i*rec_size;
+  }
+  batch.xfers = (uintptr_t) batch_xfers;
+  batch.count = NUM_RECORDS;
+  batch.reserved = 0;
+  ret = ioctl(f, DMA_PL330_IOC_XFER_BATCH, &batch);
+  if (ret < 0){
+    perror("Failed to do batch write.");
+    return errno;
+  }
+  for (i=0; i<NUM_RECORDS; i++)
+    if (memcmp(dma_buff + (NUM_RECORDS-1-i)*rec_size,
+      (char*)on_chip_RAM_vaddr_void + i*rec_size, rec_size) != 0) break;
+  if (i == NUM_RECORDS)
+    printf("Batch Write Successful!\n");
+  else
+    printf("Batch Write Error. Buffers are not equal\n");
+  munmap(dma_buff, map_size);
+
+  //------------COPY INSIDE THE FPGA (DEVICE-TO-DEVICE)-------------//
+  //The data is copied from the start of the FPGA memory to the next
+  //DMA_TRANSFER_SIZE Bytes without going through processor memory
+  printf("\nDEVICE-TO-DEVICE: Copy %d Bytes inside the FPGA memory\n",
+    (int) DMA_TRANSFER_SIZE);
+  struct dma_pl330_p2p p2p;
+  p2p.src = DMA_BUFF_PADD;
+  p2p.dst = DMA_BUFF_PADD + DMA_TRANSFER_SIZE;
+  p2p.len = DMA_TRANSFER_SIZE;
+  p2p.reserved = 0;
+  ret = ioctl(f, DMA_PL330_IOC_XFER_P2P, &p2p);
+  if (ret < 0){
+    perror("Failed to do device-to-device transfer.");
+    return errno;
+  }
+  if(memcmp(on_chip_RAM_vaddr_void, (char*)on_chip_RAM_vaddr_void +
+    DMA_TRANSFER_SIZE, (size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Device-to-device Successful!\n");
+  else
+    printf("Device-to-device Error. Buffers are not equal\n");
+  close(f);
+
+  //------------NON-BLOCKING WRITE AND READ WITH POLL-------------//
+  //write() and read() return at once and poll() tells when the DMA finished
+  printf("\nNON-BLOCKING: Write and read %d Bytes with O_NONBLOCK and poll\n",
+    (int) DMA_TRANSFER_SIZE);
+  f=open("/dev/dma_pl330",O_RDWR | O_NONBLOCK);
+  if (f < 0){
+    perror("Failed to open /dev/dma_pl330 on non-blocking...");
+    return errno;
+  }
+  if (set_config(f) < 0) return errno;
+  struct pollfd pfd;
+  pfd.fd = f;
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) buffer[i] = 20;
+  ret = write(f, buffer, DMA_TRANSFER_SIZE);
+  if (ret < 0){
+    perror("Failed to start non-blocking write.");
+    return errno;
+  }
+  pfd.events = POLLOUT;
+  poll(&pfd, 1, 1000);
+  if(memcmp((void*)buffer, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Non-blocking Write Successful!\n");
+  else
+    printf("Non-blocking Write Error. Buffers are not equal\n");
+
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) buffer[i] = 21;
+  ret = read(f, buffer, DMA_TRANSFER_SIZE);//starts the transfer
+  if ((ret < 0) && (errno != EAGAIN)){
+    perror("Failed to start non-blocking read.");
+    return errno;
+  }
+  pfd.events = POLLIN;
+  poll(&pfd, 1, 1000);
+  ret = read(f, buffer, DMA_TRANSFER_SIZE);//gets the data
+  if (ret < 0){
+    perror("Failed to finish non-blocking read.");
+    return errno;
+  }
+  if(memcmp((void*)buffer, on_chip_RAM_vaddr_void,(size_t)DMA_TRANSFER_SIZE)==0)
+    printf("Non-blocking Read Successful!\n");
+  else
+    printf("Non-blocking Read Error. Buffers are not equal\n");
+  close(f);
+
+  //-------------CYCLIC CAPTURE FROM A FIXED FPGA ADDRESS----------------//
+  //The DMA reads the first 8 Bytes of the FPGA memory again and again and
+  //fills the ring period after period until the capture is stopped
+  printf("\nCAPTURE: Capture %d periods of %d Bytes from the FPGA\n",
+    2*CAPTURE_PERIODS, CAPTURE_PERIOD_SIZE);
+  f=open("/dev/dma_pl330",O_RDWR);
+  if (f < 0){
+    perror("Failed to open /dev/dma_pl330 on capture...");
+    return errno;
+  }
+  if (set_config(f) < 0) return errno;
+  for (i=0; i<8; i++) ((char*)on_chip_RAM_vaddr_void)[i] = 22;
+  size_t ring_size = CAPTURE_PERIODS*CAPTURE_PERIOD_SIZE;
+  char* ring = (char*) mmap(NULL, ring_size, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, map_offset);
+  if (ring == MAP_FAILED){
+    perror("Failed to mmap /dev/dma_pl330.");
+    return errno;
+  }
+  memset(ring, 0, ring_size);
+  struct dma_pl330_capture capture;
+  capture.offset = map_offset;
+  capture.period_size = CAPTURE_PERIOD_SIZE;
+  capture.periods = CAPTURE_PERIODS;
+  capture.fpga_addr = 0; //use the fpga_addr of the configuration
+  if (ioctl(f, DMA_PL330_IOC_CAPTURE_START, &capture) < 0){
+    perror("Failed to start capture.");
+    return errno;
+  }
+  struct dma_pl330_capture_hdr* hdr = (struct dma_pl330_capture_hdr*)
+    mmap(NULL, getpagesize(), (PROT_READ | PROT_WRITE), MAP_SHARED, f,
+    DMA_PL330_MMAP_CAPTURE);
+  if (hdr == MAP_FAILED){
+    perror("Failed to mmap capture header.");
+    return errno;
+  }
+  //consume the periods as they arrive
+  int captured = 0;
+  int capture_ok = 1;
+  pfd.fd = f;
+  pfd.events = POLLIN;
+  while (captured < 2*CAPTURE_PERIODS){
+    if (poll(&pfd, 1, 1000) <= 0) break;
+    while (hdr->tail != hdr->head){
+      char* period = ring + (hdr->tail % CAPTURE_PERIODS)*CAPTURE_PERIOD_SIZE;
+      for (i=0; i<CAPTURE_PERIOD_SIZE; i++)
+        if (period[i] != 22) capture_ok = 0;
+      hdr->tail++;
+      captured++;
+    }
+  }
+  if (ioctl(f, DMA_PL330_IOC_CAPTURE_STOP) < 0){
+    perror("Failed to stop capture.");
+    return errno;
+  }
+  if ((captured >= 2*CAPTURE_PERIODS) && capture_ok)
+    printf("Capture Successful! %d periods\n", captured);
+  else
+    printf("Capture Error. %d periods captured\n", captured);
+  munmap(hdr, getpagesize());
+  munmap(ring, ring_size);
+  close(f);
+
+  //-------------FILL THE MAPPED BUFFER WITH THE DMA----------------//
+  //The buffer is cleared and filled with a pattern without memset()
+  printf("\nFILL: Zero and pattern fill of %d Bytes\n", (int) DMA_TRANSFER_SIZE);
+  f=open("/dev/dma_pl330",O_RDWR);
+  if (f < 0){
+    perror("Failed to open /dev/dma_pl330 on fill...");
+    return errno;
+  }
+  dma_buff = (char*) mmap(NULL, map_size, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, map_offset);
+  if (dma_buff == MAP_FAILED){
+    perror("Failed to mmap /dev/dma_pl330.");
+    return errno;
+  }
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) dma_buff[i] = 23;
+  struct dma_pl330_fill fill;
+  fill.offset = map_offset;
+  fill.len = DMA_TRANSFER_SIZE;
+  fill.mode = DMA_PL330_FILL_ZERO;
+  fill.reserved = 0;
+  fill.pattern = 0;
+  if (ioctl(f, DMA_PL330_IOC_FILL, &fill) < 0){
+    perror("Failed to do zero fill.");
+    return errno;
+  }
+  int fill_ok = 1;
+  for (i=0; i<DMA_TRANSFER_SIZE;i++) if (dma_buff[i] != 0) fill_ok = 0;
+  if (fill_ok)
+    printf("Zero fill Successful!\n");
+  else
+    printf("Zero fill Error. Buffer is not zero\n");
+
+  fill.mode = DMA_PL330_FILL_PATTERN;
+  fill.len = DMA_TRANSFER_SIZE & ~7;
+  fill.pattern = 0x0123456789ABCDEFULL;
+  if (ioctl(f, DMA_PL330_IOC_FILL, &fill) < 0){
+    perror("Failed to do pattern fill.");
+    return errno;
+  }
+  fill_ok = 1;
+  for (i=0; i<fill.len/8; i++)
+    if (((uint64_t*)dma_buff)[i] != fill.pattern) fill_ok = 0;
+  if (fill_ok)
+    printf("Pattern fill Successful!\n");
+  else
+    printf("Pattern fill Error. Buffer does not have the pattern\n");
+  munmap(dma_buff, map_size);
+  close(f);
+
 	// --------------clean up our memory mapping and exit -----------------//
 	if( munmap( virtual_base, HW_REGS_SPAN ) != 0 ) {
 		printf( "ERROR: munmap() failed...\n" );
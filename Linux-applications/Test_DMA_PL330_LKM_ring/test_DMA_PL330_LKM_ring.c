@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "dma_pl330_ioctl.h" //mmap offsets and ioctls of DMA_PL330_LKM
+
+//MACROS TO CONTROL THE TRANSFERS
+#define NUM_TRANSFERS   16   //number of descriptors submitted at once
+#define TRANSFER_SIZE   1024 //size of each transfer in Bytes
+#define RING_ENTRIES    16   //entries in the submission queue
+//DMA_BUFF_PADD:
+//physical address in the FPGA used in the transfers. Transfer i uses
+//DMA_BUFF_PADD + i*TRANSFER_SIZE. In this address there should be a memory
+//with enough space (i.e. FPGA_OCR_256K). When the module is inserted with
+//mock_dma=1 the mock FPGA memory starts in dma_buff_padd (0xC0000000 default).
+#define DMA_BUFF_PADD   0xC0000000
+//Size of the mapped staging buffer: data to write in first half and data read
+//in second half
+#define BUFF_SIZE       (2*NUM_TRANSFERS*TRANSFER_SIZE)
+
+//Pointers to the ring shared with the driver
+struct dma_pl330_ring_hdr* hdr;
+struct dma_pl330_sqe* sq;
+struct dma_pl330_cqe* cq;
+struct dma_pl330_ring_params params;
+
+//Post a descriptor in the submission queue
+void post_sqe(uint32_t src, uint32_t dst, uint32_t len, uint32_t flags,
+  uint64_t user_data)
+{
+  struct dma_pl330_sqe* sqe = &sq[hdr->sq_tail & (params.sq_entries - 1)];
+  sqe->src = src;
+  sqe->dst = dst;
+  sqe->len = len;
+  sqe->flags = flags;
+  sqe->user_data = user_data;
+  __sync_synchronize(); //the descriptor must be written before the new tail
+  hdr->sq_tail++;
+}
+
+//Read all available completions. Returns number of errors found.
+int reap_cqes(int* reaped)
+{
+  int errors = 0;
+  while (hdr->cq_head != hdr->cq_tail)
+  {
+    __sync_synchronize(); //read the completion after the tail
+    struct dma_pl330_cqe* cqe = &cq[hdr->cq_head & (params.cq_entries - 1)];
+    if (cqe->res != 0)
+    {
+      printf("Transfer %d failed with error %d\n", (int) cqe->user_data, cqe->res);
+      errors++;
+    }
+    __sync_synchronize();
+    hdr->cq_head++;
+    (*reaped)++;
+  }
+  return errors;
+}
+
+//Submit all posted descriptors and wait until num completions are reaped
+int submit_and_wait(int f, int num)
+{
+  struct dma_pl330_ring_enter enter;
+  int reaped = 0;
+  int errors = 0;
+  while (reaped < num)
+  {
+    enter.to_submit = hdr->sq_tail - hdr->sq_head;
+    enter.min_complete = 1;
+    if (ioctl(f, DMA_PL330_IOC_RING_ENTER, &enter) < 0)
+    {
+      perror("Failed to enter the ring.");
+      return -1;
+    }
+    errors += reap_cqes(&reaped);
+  }
+  return errors;
+}
+
+int main() {
+  int i;
+
+  //------------------OPEN THE DRIVER AND CREATE THE RING-----------------//
+  int f=open("/dev/dma_pl330",O_RDWR);
+  if (f < 0){
+    perror("Failed to open /dev/dma_pl330...");
+    return errno;
+  }
+
+  params.sq_entries = RING_ENTRIES;
+  if (ioctl(f, DMA_PL330_IOC_RING_SETUP, &params) < 0){
+    perror("Failed to setup the ring.");
+    return errno;
+  }
+  printf("Ring created: sq_entries=%u cq_entries=%u size=%u\n",
+    params.sq_entries, params.cq_entries, params.ring_size);
+
+  char* ring = (char*) mmap(NULL, params.ring_size, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, DMA_PL330_MMAP_RING);
+  if (ring == MAP_FAILED){
+    perror("Failed to mmap the ring.");
+    return errno;
+  }
+  hdr = (struct dma_pl330_ring_hdr*) ring;
+  sq = (struct dma_pl330_sqe*)(ring + params.sq_off);
+  cq = (struct dma_pl330_cqe*)(ring + params.cq_off);
+
+  char* dma_buff = (char*) mmap(NULL, BUFF_SIZE, (PROT_READ | PROT_WRITE),
+    MAP_SHARED, f, DMA_PL330_MMAP_NON_CACHED);
+  if (dma_buff == MAP_FAILED){
+    perror("Failed to mmap the staging buffer.");
+    return errno;
+  }
+
+  //---------------WRITE THE FPGA USING THE RING-----------------------//
+  printf("\nWRITE: %d transfers of %d Bytes to FPGA using the ring\n",
+    NUM_TRANSFERS, TRANSFER_SIZE);
+  for (i=0; i<BUFF_SIZE/2; i++) dma_buff[i] = (char) (i*7);
+  for (i=BUFF_SIZE/2; i<BUFF_SIZE; i++) dma_buff[i] = 0;
+
+  for (i=0; i<NUM_TRANSFERS; i++)
+    post_sqe(DMA_PL330_MMAP_NON_CACHED + i*TRANSFER_SIZE,
+      DMA_BUFF_PADD + i*TRANSFER_SIZE, TRANSFER_SIZE, DMA_PL330_DIR_TO_FPGA, i);
+  if (submit_and_wait(f, NUM_TRANSFERS) != 0){
+    printf("Write Error\n");
+    return 1;
+  }
+  printf("Write finished\n");
+
+  //---------------READ THE FPGA USING THE RING------------------------//
+  printf("\nREAD: %d transfers of %d Bytes from FPGA using the ring\n",
+    NUM_TRANSFERS, TRANSFER_SIZE);
+  for (i=0; i<NUM_TRANSFERS; i++)
+    post_sqe(DMA_BUFF_PADD + i*TRANSFER_SIZE,
+      DMA_PL330_MMAP_NON_CACHED + BUFF_SIZE/2 + i*TRANSFER_SIZE,
+      TRANSFER_SIZE, DMA_PL330_DIR_FROM_FPGA, NUM_TRANSFERS + i);
+  if (submit_and_wait(f, NUM_TRANSFERS) != 0){
+    printf("Read Error\n");
+    return 1;
+  }
+
+  if(memcmp(dma_buff, dma_buff + BUFF_SIZE/2, BUFF_SIZE/2)==0)
+    printf("Write and Read Successful!\n");
+  else
+    printf("Error. Data read is not equal to data written\n");
+
+  // --------------clean up our memory mapping and exit -----------------//
+  munmap(dma_buff, BUFF_SIZE);
+  munmap(ring, params.ring_size);
+  close(f);
+
+  return( 0 );
+}
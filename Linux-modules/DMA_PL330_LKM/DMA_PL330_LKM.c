@@ -19,11 +19,23 @@
 #include <linux/device.h>   // Header to support the kernel Driver Model
 #include <linux/fs.h>       // Header for the Linux file system support
 #include <asm/uaccess.h>    // Required for the copy to user function
+#include <linux/mm.h>       // To use remap_pfn_range in mmap
+#include <linux/moduleparam.h> // To use module parameters
+#include <linux/interrupt.h> // To use request_irq and the IRQ handler
+#include <linux/completion.h> // To sleep until the DMA interrupt arrives
+#include <linux/ktime.h>    // To measure the spin time in hybrid mode
+#include <linux/jiffies.h>  // For msecs_to_jiffies
+#include <linux/version.h>  // For LINUX_VERSION_CODE
+#include <linux/mutex.h>    // To protect the allocation of channels
+#include <linux/poll.h>     // To wait for the end of non-blocking transfers
+
+#include "dma_pl330_ioctl.h" //mmap offsets and ioctl commands shared with apps
 
 #include "hwlib_socal_linux.h"
 #include "alt_dma.h"
 #include "alt_dma_common.h"
 #include "alt_address_space.h" //ACP configuration
+#include "DMA_PL330_LKM.h" //declarations shared between the files of the module
 
 //data available with modinfo command
 MODULE_LICENSE("GPL");//< The license type
@@ -40,11 +52,23 @@ static void* hps_ocr_vaddress;       //virtual address
 //Non cached DMAable physically contiguous buffer in main RAM
 static void* non_cached_mem_v; 	//virtual address, to be used in module
 static dma_addr_t non_cached_mem_h; //hardware address, to be used in hardware
-#define NON_CACHED_MEM_SIZE (2*1024*1024) //Size. Max using dma_alloc_coherent in Angstrom and CycloneVSoC is 4MB
 //Cached physically contiguous buffer in main RAM. DMAable only through ACP
 static void* cached_mem_v; 	//virtual address, to be used in module
 static phys_addr_t cached_mem_h; //hardware address, to be used in hardware
-#define CACHED_MEM_SIZE (2*1024*1024) //Size. Max using kmalloc in Angstrom and CycloneVSoC is 4MB
+//Size of each buffer. dma_alloc_coherent() and kmalloc() are limited to 4MB
+//in Angstrom and CycloneVSoC. dma_alloc_coherent() gives more if the kernel
+//has a CMA pool (CONFIG_DMA_CMA and cma= in the boot arguments). Bigger
+//cached buffers need a region of SDRAM not used by Linux (reserved_mem_addr).
+static unsigned int staging_size = 2*1024*1024;
+module_param(staging_size, uint, 0444);
+MODULE_PARM_DESC(staging_size, "Size in Bytes of the cached and uncached buffers (default 2MB)");
+//Physical address of a region of 2*staging_size Bytes of SDRAM not used by
+//Linux (i.e. after the memory given with mem= in the boot arguments). The
+//first half is the uncached buffer and the second half the cached buffer.
+//0 to allocate the buffers with dma_alloc_coherent() and kmalloc().
+static unsigned long reserved_mem_addr = 0;
+module_param(reserved_mem_addr, ulong, 0444);
+MODULE_PARM_DESC(reserved_mem_addr, "Physical address of 2*staging_size Bytes of SDRAM reserved for the buffers (default 0, not used)");
 
 //-------------VARIABLES TO DO DMA TRANSFER----------------//
 //IMPORTANT!!!!!
@@ -60,17 +84,89 @@ static phys_addr_t cached_mem_h; //hardware address, to be used in hardware
 // buffers like HPS-OCR or FPGA we must take care of this. In our case we aligned the
 // FPGA-OCR with the start of the HPS-FPGA bridge that is GB aligned so we ensure a
 // problem related to this arises.
-#define DMA_PROG_WR_V (hps_ocr_vaddress+16)//virtual address of the DMAC microcode program
-#define DMA_PROG_WR_H (HPS_OCR_HADDRESS+16)//hardware address of the DMAC microcode program
-#define DMA_PROG_RD_V (hps_ocr_vaddress+256+16)//virtual address of the DMAC microcode program
-#define DMA_PROG_RD_H (HPS_OCR_HADDRESS+256+16)//hardware address of the DMAC microcode program
-static ALT_DMA_CHANNEL_t Dma_Channel; //dma channel to be used in transfers
+//-Each channel has its own slot of DMA_PROG_SLOT_SIZE Bytes in HPS OCR. The
+// program for writes starts in the slot and the program for reads 1kB later.
+#define DMA_PROG_SLOT_SIZE 2048
+#define DMA_PROG_WR_V(ch) (hps_ocr_vaddress+(ch)*DMA_PROG_SLOT_SIZE+16)//virtual address of the DMAC microcode program
+#define DMA_PROG_WR_H(ch) (HPS_OCR_HADDRESS+(ch)*DMA_PROG_SLOT_SIZE+16)//hardware address of the DMAC microcode program
+#define DMA_PROG_RD_V(ch) (hps_ocr_vaddress+(ch)*DMA_PROG_SLOT_SIZE+1024+16)//virtual address of the DMAC microcode program
+#define DMA_PROG_RD_H(ch) (HPS_OCR_HADDRESS+(ch)*DMA_PROG_SLOT_SIZE+1024+16)//hardware address of the DMAC microcode program
+//-The 8 Bytes before the program for reads (not used by the program for
+// writes) hold the pattern of DMA_PL330_IOC_FILL (see DMA_PL330_LKM_fill.c).
+#define DMA_PATTERN_V(ch) (hps_ocr_vaddress+(ch)*DMA_PROG_SLOT_SIZE+1024-8)//virtual address of the fill pattern
+#define DMA_PATTERN_H(ch) (HPS_OCR_HADDRESS+(ch)*DMA_PROG_SLOT_SIZE+1024-8)//hardware address of the fill pattern
+//-The rest of HPS OCR (after the slots of the 8 channels) is used to cache
+// prepared programs (see DMA_PL330_LKM_progcache.c).
+#define DMA_PROG_CACHE_OFFSET (8*DMA_PROG_SLOT_SIZE)
+
+//---------VARIABLES FOR EACH OPEN FILE-----------------//
+//Each open() reserves a DMA channel, the microcode slot of that channel and
+//a part of the cached and uncached buffers (see struct dma_client).
+static int dma_channels = 8;
+module_param(dma_channels, int, 0444);
+MODULE_PARM_DESC(dma_channels, "Max number of files open at the same time (1-8, default 8)");
+unsigned int sub_buff_size; //size of the part of the buffers for each open file
+static DEFINE_MUTEX(channel_alloc_mutex); //protects channel allocation in open and release
+
+//---------VARIABLES FOR THE PERIPHERAL REQUEST INTERFACE---------//
+//The PL330 has 8 peripheral request interfaces with the FPGA (FPGA_0 to
+//FPGA_7) used by the transfers with flow control (DMA_PL330_LKM_periph.c).
+//FPGA_4 to FPGA_7 are shared with CAN0 and CAN1: bit n of periph_mux gives
+//FPGA_4+n to the FPGA (1) or to CAN (0).
+static int periph_mux = 0xF;
+module_param(periph_mux, int, 0444);
+MODULE_PARM_DESC(periph_mux, "Bit n gives peripheral request FPGA_4+n to FPGA (1) or CAN (0) (default 0xF)");
+
+//---------VARIABLES FOR THE TEST MODE-----------------//
+//When mock_dma=1 the DMAC is not used. The transfers of the submission/
+//completion ring are done with memcpy() to a mock FPGA memory (see
+//DMA_PL330_LKM_ring.c), so the ring can be tested without DMAC and FPGA.
+//read(), write() and ioctl(DMA_PL330_IOC_XFER) are not available.
+int mock_dma = 0;
+module_param(mock_dma, int, 0444);
+MODULE_PARM_DESC(mock_dma, "Mock the DMA channels with memcpy() for testing (default 0)");
+static unsigned int mock_channels = 0; //channels in use when mock_dma=1 (bit n is channel n)
+
+//---------VARIABLES TO WAIT FOR THE END OF DMA TRANSFERS---------//
+//completion_mode selects how the driver waits for the end of a transfer:
+//-COMPLETION_POLL: the state of the channel is read in a loop until it stops.
+// It has the lowest latency but the CPU is busy during the whole transfer.
+//-COMPLETION_IRQ: the microcode sends an event (DMASEV) at the end of the
+// transfer. The PL330 raises irq[n] (n is the channel), the IRQ handler clears
+// it and wakes up the driver, that sleeps in wait_for_completion meanwhile.
+//-COMPLETION_HYBRID: poll during hybrid_spin_us microseconds and sleep until
+// the interrupt arrives if the transfer did not finish yet. Small transfers
+// keep the latency of polling and big ones do not waste the CPU.
+//If the IRQs cannot be requested in module init the driver always polls.
+#define COMPLETION_POLL   0
+#define COMPLETION_IRQ    1
+#define COMPLETION_HYBRID 2
+static int completion_mode = COMPLETION_HYBRID;
+module_param(completion_mode, int, 0644);
+MODULE_PARM_DESC(completion_mode, "Wait for end of transfers: 0 poll, 1 irq, 2 hybrid (default)");
+static int hybrid_spin_us = 20;
+module_param(hybrid_spin_us, int, 0644);
+MODULE_PARM_DESC(hybrid_spin_us, "Microseconds polling before sleeping in hybrid mode (default 20)");
+static int dma_irq = 136;//Linux IRQ number of PL330 irq[0] (GIC SPI 104)
+module_param(dma_irq, int, 0444);
+MODULE_PARM_DESC(dma_irq, "IRQ number of PL330 irq[0]. irq[n] is dma_irq+n (default 136)");
+static int dma_timeout_ms = 1000;
+module_param(dma_timeout_ms, int, 0644);
+MODULE_PARM_DESC(dma_timeout_ms, "Max time to wait for a transfer in irq and hybrid modes (default 1000)");
+#define DMA_IRQ_NUM 8 //PL330 has one irq output per event (irq[0]-irq[7])
+static struct completion dma_done[DMA_IRQ_NUM];//one per channel (channel n uses event n)
+static wait_queue_head_t dma_wq[DMA_IRQ_NUM];//woken with dma_done, used by poll()
+bool dma_irq_ok = false; //true when IRQs were requested successfully
+//reinit_completion() appeared in kernel 3.13. Before it was INIT_COMPLETION()
+#if LINUX_VERSION_CODE < KERNEL_VERSION(3,13,0)
+#define reinit_completion(x) INIT_COMPLETION(*(x))
+#endif
 
 //---------VARIABLES TO EXPORT USING SYSFS-----------------//
-static int use_acp = 1; //to use acp for DMA transfers
+int use_acp = 1; //to use acp for DMA transfers (2 selects by transfer size)
 static int prepare_microcode_in_open = 0;//microcode program is prepared when opening char driver
 //when prepare_microcode_in_open the following vars are used to prepare DMA microcodes in open() func
-static void* dma_buff_padd = (void*) 0xC0000000;//physical address of buff to use in write and read from application
+void* dma_buff_padd = (void*) 0xC0000000;//physical address of buff to use in write and read from application
 static int dma_transfer_size = 0; //transfer size in Bytes of the DMA transaction
 static int lockdown_cpu = 0; //L2 cache controller lockdown value for CPU0 and 1
 static int lockdown_acp = 0; //L2 cache controller lockdown value for ACP port
@@ -90,6 +186,8 @@ static int     dev_open(struct inode *, struct file *);
 static int     dev_release(struct inode *, struct file *);
 static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
 static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
+static int     dev_mmap(struct file *, struct vm_area_struct *);
+static long    dev_ioctl(struct file *, unsigned int, unsigned long);
 
 //-------------VARIABLES TO DO LOCKDOWN ON L2 CACHE CONTROLLER---------//
 //This is the memory-mapped address of the L2 cache controller (L2C-310) on the
@@ -107,12 +205,19 @@ static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
 #define MPWEIGHT_0_4 0x50B0
 #define MPWEIGHT_1_4 0x50B4
 
-//available operations on char device driver: open, read, write and close
+//available operations on char device driver: open, read, write, readv and
+//writev (aio_read and aio_write, see DMA_PL330_LKM_batch.c), poll (see
+//DMA_PL330_LKM_nonblock.c), mmap, ioctl and close
 static struct file_operations fops =
 {
    .open = dev_open,
    .read = dev_read,
    .write = dev_write,
+   .aio_read = dma_batch_aio_read,
+   .aio_write = dma_batch_aio_write,
+   .poll = dma_nb_poll,
+   .mmap = dev_mmap,
+   .unlocked_ioctl = dev_ioctl,
    .release = dev_release,
 };
 
@@ -155,7 +260,8 @@ ALT_STATUS_CODE PL330_init(void)
   }
   for (i = 0; i < 4; ++i)
   {
-     dma_config.periph_mux[i] = ALT_DMA_PERIPH_MUX_DEFAULT;
+     dma_config.periph_mux[i] = (periph_mux & (1 << i)) ?
+       ALT_DMA_PERIPH_MUX_FPGA : ALT_DMA_PERIPH_MUX_CAN;
   }
 
   //------Initialize DMAC--------//
@@ -245,6 +351,96 @@ static ssize_t prepare_microcode_in_open_show(struct kobject *kobj,
    return sprintf(buf, "%d\n", prepare_microcode_in_open);
 }
 
+static ssize_t acp_crossover_store(struct kobject *kobj,
+  struct kobj_attribute *attr, const char *buf, size_t count)
+{
+  sscanf(buf, "%u", &acp_crossover);
+  return count;
+}
+
+static ssize_t acp_crossover_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "%u\n", acp_crossover);
+}
+
+static ssize_t acp_decisions_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "acp:%u direct:%u\n", acp_decisions_acp,
+     acp_decisions_direct);
+}
+
+static ssize_t prog_cache_enable_store(struct kobject *kobj,
+  struct kobj_attribute *attr, const char *buf, size_t count)
+{
+  sscanf(buf, "%du", &prog_cache_enable);
+  if (!prog_cache_enable)
+    dma_prog_cache_flush();
+  return count;
+}
+
+static ssize_t prog_cache_enable_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "%d\n", prog_cache_enable);
+}
+
+static ssize_t prog_cache_hits_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "%u\n", prog_cache_hits);
+}
+
+static ssize_t prog_cache_misses_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "%u\n", prog_cache_misses);
+}
+
+static ssize_t prog_cache_patches_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return sprintf(buf, "%u\n", prog_cache_patches);
+}
+
+static ssize_t bench_store(struct kobject *kobj,
+  struct kobj_attribute *attr, const char *buf, size_t count)
+{
+  return dma_bench_store(buf, count);
+}
+
+static ssize_t bench_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return dma_bench_show(buf);
+}
+
+static ssize_t burst_profiles_store(struct kobject *kobj,
+  struct kobj_attribute *attr, const char *buf, size_t count)
+{
+  return dma_burst_store(buf, count);
+}
+
+static ssize_t burst_profiles_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return dma_burst_show(buf);
+}
+
+static ssize_t sched_stats_store(struct kobject *kobj,
+  struct kobj_attribute *attr, const char *buf, size_t count)
+{
+  dma_sched_reset();
+  return count;
+}
+
+static ssize_t sched_stats_show(struct kobject *kobj,
+  struct kobj_attribute *attr, char *buf)
+{
+   return dma_sched_show(buf);
+}
+
 static ssize_t dma_transfer_size_store(struct kobject *kobj,
   struct kobj_attribute *attr, const char *buf, size_t count)
 {
@@ -421,6 +617,24 @@ static struct kobj_attribute dma_buff_padd_attr = __ATTR(dma_buff_padd, 0666, dm
 static struct kobj_attribute use_acp_attr = __ATTR(use_acp, 0666, use_acp_show, use_acp_store);
 static struct kobj_attribute prepare_microcode_in_open_attr = __ATTR(prepare_microcode_in_open, 0666,
   prepare_microcode_in_open_show, prepare_microcode_in_open_store);
+static struct kobj_attribute acp_crossover_attr = __ATTR(acp_crossover, 0666,
+  acp_crossover_show, acp_crossover_store);
+static struct kobj_attribute acp_decisions_attr = __ATTR(acp_decisions, 0444,
+  acp_decisions_show, NULL);
+static struct kobj_attribute prog_cache_enable_attr = __ATTR(prog_cache_enable, 0666,
+  prog_cache_enable_show, prog_cache_enable_store);
+static struct kobj_attribute prog_cache_hits_attr = __ATTR(prog_cache_hits, 0444,
+  prog_cache_hits_show, NULL);
+static struct kobj_attribute prog_cache_misses_attr = __ATTR(prog_cache_misses, 0444,
+  prog_cache_misses_show, NULL);
+static struct kobj_attribute prog_cache_patches_attr = __ATTR(prog_cache_patches, 0444,
+  prog_cache_patches_show, NULL);
+static struct kobj_attribute bench_attr = __ATTR(bench, 0644,
+  bench_show, bench_store);
+static struct kobj_attribute burst_profiles_attr = __ATTR(burst_profiles, 0644,
+  burst_profiles_show, burst_profiles_store);
+static struct kobj_attribute sched_stats_attr = __ATTR(sched_stats, 0644,
+  sched_stats_show, sched_stats_store);
 static struct kobj_attribute dma_transfer_size_attr = __ATTR(dma_transfer_size, 0666,
   dma_transfer_size_show, dma_transfer_size_store);
 static struct kobj_attribute lockdown_cpu_attr = __ATTR(lockdown_cpu, 0666,
@@ -440,7 +654,16 @@ static struct kobj_attribute sdramc_weight1_attr = __ATTR(sdramc_weight1, 0666,
 static struct attribute *pl330_lkm_attrs[] = {
       &dma_buff_padd_attr.attr,
       &use_acp_attr.attr,
+      &acp_crossover_attr.attr,
+      &acp_decisions_attr.attr,
       &prepare_microcode_in_open_attr.attr,
+      &prog_cache_enable_attr.attr,
+      &prog_cache_hits_attr.attr,
+      &prog_cache_misses_attr.attr,
+      &prog_cache_patches_attr.attr,
+      &bench_attr.attr,
+      &burst_profiles_attr.attr,
+      &sched_stats_attr.attr,
       &dma_transfer_size_attr.attr,
       &lockdown_cpu_attr.attr,
       &lockdown_acp_attr.attr,
@@ -462,134 +685,722 @@ static struct attribute_group attr_group = {
 static struct kobject *pl330_lkm_kobj;
 
 
+//-----------------FUNCTIONS TO WAIT FOR DMA TRANSFERS-------------------//
+//IRQ handler for the PL330 irq[n] outputs. The event n is sent by the DMASEV
+//at the end of the microcode of channel n.
+static irqreturn_t dma_irq_handler(int irq, void *dev_id)
+{
+  ALT_DMA_EVENT_t evt = (ALT_DMA_EVENT_t)((struct completion*)dev_id - dma_done);
+
+  if (alt_dma_int_status_get(evt) != ALT_E_TRUE)
+    return IRQ_NONE;
+
+  alt_dma_int_clear(evt);
+  dma_capture_irq(evt);
+  complete(&dma_done[evt]);
+  wake_up_interruptible(&dma_wq[evt]);
+  return IRQ_HANDLED;
+}
+
+//Route the events of the DMAC to irq[n] and request the IRQs. If it fails the
+//driver keeps working in polling mode.
+static void dma_irq_init(void)
+{
+  int i, j;
+
+  for (i = 0; i < DMA_IRQ_NUM; i++)
+  {
+    init_completion(&dma_done[i]);
+    init_waitqueue_head(&dma_wq[i]);
+    alt_dma_int_clear((ALT_DMA_EVENT_t)i);
+    alt_dma_event_int_select((ALT_DMA_EVENT_t)i, ALT_DMA_EVENT_SELECT_SIG_IRQ);
+    if (request_irq(dma_irq + i, dma_irq_handler, 0, DEVICE_NAME, &dma_done[i]))
+    {
+      printk(KERN_INFO "DMA LKM: failed to request IRQ %d. Using polling\n", dma_irq + i);
+      for (j = 0; j < i; j++)
+        free_irq(dma_irq + j, &dma_done[j]);
+      for (j = 0; j <= i; j++)
+        alt_dma_event_int_select((ALT_DMA_EVENT_t)j, ALT_DMA_EVENT_SELECT_SEND_EVT);
+      return;
+    }
+  }
+  dma_irq_ok = true;
+  printk(KERN_INFO "DMA LKM: IRQs %d-%d requested successfully\n", dma_irq, dma_irq + DMA_IRQ_NUM - 1);
+}
+
+static void dma_irq_uninit(void)
+{
+  int i;
+
+  if (!dma_irq_ok) return;
+  for (i = 0; i < DMA_IRQ_NUM; i++)
+  {
+    alt_dma_event_int_select((ALT_DMA_EVENT_t)i, ALT_DMA_EVENT_SELECT_SEND_EVT);
+    free_irq(dma_irq + i, &dma_done[i]);
+  }
+  dma_irq_ok = false;
+}
+
+//Must be called before starting a transfer in the channel so the completion
+//signaled by the IRQ handler belongs to this transfer
+void arm_dma_completion(ALT_DMA_CHANNEL_t channel)
+{
+  if (dma_irq_ok)
+    reinit_completion(&dma_done[channel]);
+}
+
+//Wait until the transfer started in the channel finishes. status is the value
+//returned by the function that started the transfer. Depending on
+//completion_mode the channel state is polled, the driver sleeps until the IRQ
+//arrives or both. Returns ALT_E_SUCCESS if the transfer finished correctly and
+//ALT_E_ERROR or ALT_E_TMO otherwise.
+ALT_STATUS_CODE wait_dma_transfer(ALT_DMA_CHANNEL_t channel,
+  ALT_STATUS_CODE status)
+{
+  ALT_DMA_CHANNEL_STATE_t channel_state;
+  ALT_DMA_CHANNEL_FAULT_t fault;
+  ktime_t start;
+
+  if (status != ALT_E_SUCCESS)
+  {
+    printk(KERN_INFO "DMA LKM: ERROR! DMA Transfer failed!\n");
+    return ALT_E_ERROR;
+  }
+
+  channel_state = ALT_DMA_CHANNEL_STATE_EXECUTING;
+  if (dma_irq_ok && (completion_mode != COMPLETION_POLL))
+  {
+    //In hybrid mode spin some time before sleeping
+    if (completion_mode == COMPLETION_HYBRID)
+    {
+      start = ktime_get();
+      do {
+        alt_dma_channel_state_get(channel, &channel_state);
+      } while ((channel_state != ALT_DMA_CHANNEL_STATE_STOPPED) &&
+        (channel_state != ALT_DMA_CHANNEL_STATE_FAULTING) &&
+        (ktime_us_delta(ktime_get(), start) < hybrid_spin_us));
+    }
+
+    //Sleep until the DMASEV at the end of the program raises the IRQ
+    if ((channel_state != ALT_DMA_CHANNEL_STATE_STOPPED) &&
+      (channel_state != ALT_DMA_CHANNEL_STATE_FAULTING))
+    {
+      if (wait_for_completion_timeout(&dma_done[channel],
+        msecs_to_jiffies(dma_timeout_ms)) == 0)
+      {
+        alt_dma_channel_state_get(channel, &channel_state);
+        if ((channel_state != ALT_DMA_CHANNEL_STATE_STOPPED) &&
+          (channel_state != ALT_DMA_CHANNEL_STATE_FAULTING))
+        {
+          printk(KERN_INFO "DMA LKM: ERROR! DMA Transfer timeout. Killing channel %d\n", (int)channel);
+          alt_dma_channel_kill(channel);
+          return ALT_E_TMO;
+        }
+      }
+    }
+  }
+
+  //Poll until the channel stops. After the IRQ the channel only has to
+  //execute the DMAEND so this loop is very short in irq and hybrid modes.
+  while((status == ALT_E_SUCCESS) && (channel_state != ALT_DMA_CHANNEL_STATE_STOPPED))
+  {
+    status = alt_dma_channel_state_get(channel, &channel_state);
+    if(channel_state == ALT_DMA_CHANNEL_STATE_FAULTING)
+    {
+      alt_dma_channel_fault_status_get(channel, &fault);
+      printk(KERN_INFO "DMA LKM: ERROR! DMA Channel Fault: %d\n", (int)fault);
+      return ALT_E_ERROR;
+    }
+  }
+
+  return status;
+}
+
+//True if the transfer started in the channel finished (or failed). It does
+//not wait, so it can be used in poll().
+bool dma_transfer_done(ALT_DMA_CHANNEL_t channel)
+{
+  ALT_DMA_CHANNEL_STATE_t channel_state;
+
+  if (dma_irq_ok && completion_done(&dma_done[channel]))
+    return true;
+  alt_dma_channel_state_get(channel, &channel_state);
+  return (channel_state == ALT_DMA_CHANNEL_STATE_STOPPED) ||
+    (channel_state == ALT_DMA_CHANNEL_STATE_FAULTING);
+}
+
+//Add the wait queue of the channel to the poll table
+void dma_poll_wait(struct file *filep, ALT_DMA_CHANNEL_t channel,
+  poll_table *wait)
+{
+  poll_wait(filep, &dma_wq[channel], wait);
+}
+
 //-----------------LKM CHAR DEVICE DRIVER INTERFACE FUNCTIONS---------------//
+//Wait for the non-blocking transfer of the file before using the channel
+static void client_nb_finish(struct dma_client *client)
+{
+  mutex_lock(&client->lock);
+  dma_nb_finish(client);
+  mutex_unlock(&client->lock);
+}
+
+//Use ACP (cached buffer) for a transfer of len Bytes of the client. With
+//use_acp=2 the path is selected by size (see DMA_PL330_LKM_acp.c).
+static int client_use_acp(struct dma_client *client, size_t len)
+{
+  if (client->use_acp == USE_ACP_AUTO)
+    return dma_acp_auto(len);
+  return client->use_acp;
+}
+
+//Count the path of a transfer of len Bytes of the client in auto mode. Called
+//once for each transfer of the application, not for each chunk or program.
+void client_acp_count(struct dma_client *client, size_t len)
+{
+  if (client->use_acp == USE_ACP_AUTO)
+    dma_acp_count(dma_acp_auto(len));
+}
+
+//Hardware address of the part of the buffers of the client used by the DMAC
+//for a transfer of len Bytes. The cached buffer is accessed through ACP.
+void* client_buff_h(struct dma_client *client, size_t len)
+{
+  if (client_use_acp(client, len) == 0) //not use use_acp
+    return (void*) client->non_cached_h;
+  else //use acp
+    return (void*)((char*)client->cached_h + 0x80000000);
+}
+
+//Virtual address of the part of the buffers of the client used by the module
+//for a transfer of len Bytes
+void* client_buff_v(struct dma_client *client, size_t len)
+{
+  if (client_use_acp(client, len) == 0) //not use use_acp
+    return client->non_cached_v;
+  else //use acp
+    return client->cached_v;
+}
+
+//Get the virtual and hardware addresses of the data in the part of the
+//buffers of the client from a mmap offset (see dma_pl330_ioctl.h). The cached
+//buffer is accessed through ACP. Returns -EINVAL if the data does not fit.
+int client_offset_to_buff(struct dma_client *client, uint32_t offset,
+  uint32_t len, void** buff_v, void** buff_h)
+{
+  uint32_t buff_offset = offset & (DMA_PL330_MMAP_CACHED - 1);
+
+  if ((len == 0) || (len > sub_buff_size) ||
+      (buff_offset > sub_buff_size - len))
+    return -EINVAL;
+
+  if ((offset & ~(DMA_PL330_MMAP_CACHED - 1)) == DMA_PL330_MMAP_NON_CACHED)
+  {
+    *buff_v = (char*)client->non_cached_v + buff_offset;
+    *buff_h = (void*)(client->non_cached_h + buff_offset);
+  }
+  else if ((offset & ~(DMA_PL330_MMAP_CACHED - 1)) == DMA_PL330_MMAP_CACHED)
+  {
+    *buff_v = (char*)client->cached_v + buff_offset;
+    *buff_h = (void*)((char*)client->cached_h + 0x80000000 + buff_offset);//use acp
+  }
+  else
+    return -EINVAL;
+
+  return 0;
+}
+
+//Physical regions where the FPGA addresses given by the application can be.
+//HPS OCR is not included because it contains the microcode of the channels.
+static const struct {
+  uint32_t start;
+  uint32_t size;
+} fpga_windows[] = {
+  {0xC0000000, 0x3C000000}, //HPS-to-FPGA bridge
+  {0xFF200000, 0x00200000}, //lightweight HPS-to-FPGA bridge
+};
+
+static int fpga_in_window(uint32_t addr, uint32_t len)
+{
+  int i;
+
+  for (i = 0; i < ARRAY_SIZE(fpga_windows); i++)
+  {
+    if ((addr >= fpga_windows[i].start) &&
+      (addr - fpga_windows[i].start < fpga_windows[i].size) &&
+      (len <= fpga_windows[i].size - (addr - fpga_windows[i].start)))
+      return 1;
+  }
+  return 0;
+}
+
+//Get in fpga_padd the FPGA address of a transfer of len Bytes of the client:
+//addr, or the fpga_addr of the file if addr is 0. The addresses given by the
+//application (addr or the fpga_addr of ioctl(DMA_PL330_IOC_SET_CONFIG)) must
+//be inside a bridge window for the whole transfer. dma_buff_padd of sysfs is
+//not checked. Returns -EINVAL if the range is not allowed.
+int client_fpga_addr(struct dma_client *client, uint32_t addr, uint32_t len,
+  uint32_t* fpga_padd)
+{
+  bool user = (addr != 0) || client->fpga_user;
+
+  if (addr == 0)
+    addr = (uint32_t) client->fpga_padd;
+  if (user && !fpga_in_window(addr, len))
+    return -EINVAL;
+  *fpga_padd = addr;
+  return 0;
+}
+
+//Prepare the programs for read() and write() of transfer_size Bytes in the
+//slot of the channel of the client. They are executed directly in each call.
+static int client_prepare_microcode(struct dma_client *client)
+{
+  ALT_STATUS_CODE status;
+  ALT_DMA_BURST_t burst;
+  uint32_t fpga_padd;
+
+  if ((client->transfer_size == 0) || (client->transfer_size > sub_buff_size))
+  {
+    printk(KERN_INFO "DMA LKM: dma_transfer_size must be between 1 and %u\n", sub_buff_size);
+    return -EINVAL;
+  }
+  if (client_fpga_addr(client, 0, client->transfer_size, &fpga_padd) != 0)
+    return -EINVAL;
+
+  //Both programs access the FPGA so they use the same burst profile
+  dma_burst_select(client, client->fpga_padd, client->fpga_padd, &burst);
+
+  //Prepare program for writes (WR)
+  status = alt_dma_memory_to_memory_only_prepare_program_burst(
+    client->channel,
+    client->prog_wr_v,
+    client->prog_wr_h,
+    client->fpga_padd,
+    client_buff_h(client, client->transfer_size),
+    (size_t) client->transfer_size,
+    dma_irq_ok,
+    (ALT_DMA_EVENT_t) client->channel,
+    &burst);
+
+  //Prepare program for reads (RD)
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_memory_to_memory_only_prepare_program_burst(
+      client->channel,
+      client->prog_rd_v,
+      client->prog_rd_h,
+      client_buff_h(client, client->transfer_size),
+      client->fpga_padd,
+      (size_t) client->transfer_size,
+      dma_irq_ok,
+      (ALT_DMA_EVENT_t) client->channel,
+      &burst);
+
+  client->prog_prepared = (status == ALT_E_SUCCESS);
+  if (!client->prog_prepared)
+    return -EINVAL;
+  return 0;
+}
+
+//Reserve a free DMA channel. The channel number n selects the microcode slot
+//in HPS OCR and the part n of the cached and uncached buffers. Returns the
+//channel or -EBUSY if all dma_channels channels are in use.
+int dma_channel_reserve(void)
+{
+   ALT_STATUS_CODE status = ALT_E_ERROR;
+   int ch;
+
+   mutex_lock(&channel_alloc_mutex);
+   for (ch = 0; ch < dma_channels; ch++)
+   {
+     if (mock_dma)
+     {
+       if (!(mock_channels & (1 << ch)))
+       {
+         mock_channels |= (1 << ch);
+         status = ALT_E_SUCCESS;
+         break;
+       }
+     }
+     else
+     {
+       status = alt_dma_channel_alloc((ALT_DMA_CHANNEL_t)ch);
+       if (status == ALT_E_SUCCESS) break;
+     }
+   }
+   mutex_unlock(&channel_alloc_mutex);
+   if (status != ALT_E_SUCCESS)
+     return -EBUSY;
+   return ch;
+}
+
+//Free a channel reserved with dma_channel_reserve()
+void dma_channel_release(ALT_DMA_CHANNEL_t channel)
+{
+   ALT_DMA_CHANNEL_STATE_t channel_state;
+
+   mutex_lock(&channel_alloc_mutex);
+   //Kill the channel if a transfer was left running
+   if (!mock_dma)
+   {
+     alt_dma_channel_state_get(channel, &channel_state);
+     if (channel_state != ALT_DMA_CHANNEL_STATE_STOPPED)
+       alt_dma_channel_kill(channel);
+   }
+   if (mock_dma)
+     mock_channels &= ~(1 << channel);
+   else if (alt_dma_channel_free(channel) != ALT_E_SUCCESS)
+     printk(KERN_INFO "DMA LKM: failed to free DMA channel %d\n", (int)channel);
+   mutex_unlock(&channel_alloc_mutex);
+}
+
+//Reserve all the channels so nobody else uses the buffers, the slots and the
+//program cache (see DMA_PL330_LKM_bench.c). Returns -EBUSY if a channel is
+//in use.
+int dma_channel_reserve_all(void)
+{
+   int ch;
+
+   mutex_lock(&channel_alloc_mutex);
+   for (ch = 0; ch < dma_channels; ch++)
+   {
+     if (alt_dma_channel_alloc((ALT_DMA_CHANNEL_t)ch) != ALT_E_SUCCESS)
+     {
+       while (ch-- > 0)
+         alt_dma_channel_free((ALT_DMA_CHANNEL_t)ch);
+       mutex_unlock(&channel_alloc_mutex);
+       return -EBUSY;
+     }
+   }
+   mutex_unlock(&channel_alloc_mutex);
+   return 0;
+}
+
+//Free the channels reserved with dma_channel_reserve_all()
+void dma_channel_release_all(void)
+{
+   int ch;
+
+   mutex_lock(&channel_alloc_mutex);
+   for (ch = 0; ch < dma_channels; ch++)
+     alt_dma_channel_free((ALT_DMA_CHANNEL_t)ch);
+   mutex_unlock(&channel_alloc_mutex);
+}
+
+//Initialize a client using the reserved channel ch. The configuration is
+//taken from the sysfs variables.
+void dma_client_init(struct dma_client *client, int ch)
+{
+   client->channel = (ALT_DMA_CHANNEL_t)ch;
+   client->prog_wr_v = (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V(ch);
+   client->prog_wr_h = (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H(ch);
+   client->prog_rd_v = (ALT_DMA_PROGRAM_t*) DMA_PROG_RD_V(ch);
+   client->prog_rd_h = (ALT_DMA_PROGRAM_t*) DMA_PROG_RD_H(ch);
+   client->pattern_v = DMA_PATTERN_V(ch);
+   client->pattern_h = (void*) DMA_PATTERN_H(ch);
+   client->non_cached_v = (char*)non_cached_mem_v + ch*sub_buff_size;
+   client->non_cached_h = non_cached_mem_h + ch*sub_buff_size;
+   client->cached_v = (char*)cached_mem_v + ch*sub_buff_size;
+   client->cached_h = cached_mem_h + ch*sub_buff_size;
+   mutex_init(&client->lock);
+   client->ring = NULL;
+   client->prog_entry = NULL;
+   client->capture = NULL;
+
+   client->fpga_padd = dma_buff_padd;
+   client->fpga_user = false;
+   client->use_acp = use_acp;
+   client->prepare_microcode = prepare_microcode_in_open;
+   client->transfer_size = (dma_transfer_size > 0) ? dma_transfer_size : 0;
+   client->prog_prepared = false;
+   client->sched_class = DMA_PL330_CLASS_BULK;
+   client->burst = 0;
+   client->nb_state = DMA_NB_IDLE;
+   client->nb_result = 0;
+}
 
 /** @brief The device open function that is called each time the device is opened
- *  This will only increment the numberOpens counter in this case.
+ *  It reserves a free DMA channel for this file. The channel number n selects
+ *  the microcode slot in HPS OCR and the part n of the cached and uncached
+ *  buffers. When all dma_channels channels are in use it returns -EBUSY.
  *  @param inodep A pointer to an inode object (defined in linux/fs.h)
  *  @param filep A pointer to a file object (defined in linux/fs.h)
  */
 static int dev_open(struct inode *inodep, struct file *filep){
-   void* dma_transfer_src_h;//hardware address of the source buffer
-   void* dma_transfer_dst_h;//hardware address of the destiny buffer
-   ALT_STATUS_CODE status;
+   struct dma_client *client;
+   int ch;
+
+   client = kmalloc(sizeof(struct dma_client), GFP_KERNEL);
+   if (client == NULL)
+     return -ENOMEM;
 
+   //Reserve a free channel
+   ch = dma_channel_reserve();
+   if (ch < 0)
+   {
+     printk(KERN_INFO "DMA LKM: no free DMA channel in open\n");
+     kfree(client);
+     return -EBUSY;
+   }
+   mutex_lock(&channel_alloc_mutex);
    numberOpens++;
+   mutex_unlock(&channel_alloc_mutex);
 
-   //A good module would get a resource de device cannot be open a second time before closing it
+   dma_client_init(client, ch);
+   filep->private_data = client;
 
-   if (prepare_microcode_in_open == 1)
+   if (client->prepare_microcode == 1)
    {
-      //Prepare program for writes (WR)
-      dma_transfer_dst_h = dma_buff_padd;
-      if (use_acp == 0) //not use use_acp
-        dma_transfer_src_h = (void*) non_cached_mem_h;
-      else //use acp
-        dma_transfer_src_h = (void*)((char*)cached_mem_h + 0x80000000);
-
-      status = alt_dma_memory_to_memory_only_prepare_program(
-        Dma_Channel,
-	       (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V,
-	       (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H,
-	       dma_transfer_dst_h,
-	       dma_transfer_src_h,
-	       (size_t) dma_transfer_size,
-	       false,
-	       (ALT_DMA_EVENT_t)0);
-
-      //Prepare program for reads (RD)
-      dma_transfer_src_h = dma_buff_padd;
-      if (use_acp == 0) //not use use_acp
-	       dma_transfer_dst_h = (void*) non_cached_mem_h;
-      else //use acp
-	       dma_transfer_dst_h = (void*)((char*)cached_mem_h + 0x80000000);
-
-      status = alt_dma_memory_to_memory_only_prepare_program(
-	       Dma_Channel,
-	       (ALT_DMA_PROGRAM_t*) DMA_PROG_RD_V,
-	       (ALT_DMA_PROGRAM_t*) DMA_PROG_RD_H,
-	       dma_transfer_dst_h,
-	       dma_transfer_src_h,
-	       (size_t) dma_transfer_size,
-	       false,
-	       (ALT_DMA_EVENT_t)0);
+      if (client_prepare_microcode(client) != 0)
+      {
+        dev_release(inodep, filep);
+        return -EINVAL;
+      }
    }
 
    return 0;
 }
 
+//---------PIPELINED TRANSFERS IN READ AND WRITE---------//
+//Transfers bigger than half the buffer of the file are split in chunks of half
+//the buffer. The two halves are used alternately so the copy between the
+//application and one half overlaps with the DMA transfer of the other half.
+//The FPGA address advances with each chunk, so transfers bigger than the
+//buffer of the file are possible.
+static void* client_half_v(struct dma_client *client, int half, size_t len)
+{
+  return (char*) client_buff_v(client, len) +
+    half*((sub_buff_size/2) & PAGE_MASK);
+}
+
+static void* client_half_h(struct dma_client *client, int half, size_t len)
+{
+  return (char*) client_buff_h(client, len) +
+    half*((sub_buff_size/2) & PAGE_MASK);
+}
+
+//Write len Bytes from the application to the FPGA. copy_from_user() of chunk
+//N+1 is done while the DMA moves chunk N.
+static ssize_t dev_write_pipelined(struct dma_client *client,
+  const char *buffer, size_t len)
+{
+  size_t chunk = (sub_buff_size/2) & PAGE_MASK;
+  size_t pos = 0;
+  size_t n = min(chunk, len);
+  size_t next_n;
+  int cur = 0;
+  int error_count;
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  mutex_lock(&client->lock);
+  t = dma_stats_start();
+  error_count = copy_from_user(client_half_v(client, cur, len), buffer, n);
+  dma_stats_end(DMA_STAGE_COPY, n, t);
+  if (error_count != 0)
+  {
+    mutex_unlock(&client->lock);
+    return -EFAULT;
+  }
+
+  while (1)
+  {
+    dma_sched_enter(client);
+    arm_dma_completion(client->channel);
+    status = dma_prog_cache_exec(client, client->prog_wr_v, client->prog_wr_h,
+      (char*) client->fpga_padd + pos, client_half_h(client, cur, len), n);
+
+    //copy next chunk to the other half while the DMA moves this one
+    next_n = min(chunk, len - pos - n);
+    error_count = 0;
+    if (next_n > 0)
+    {
+      t = dma_stats_start();
+      error_count = copy_from_user(client_half_v(client, cur ^ 1, len),
+        buffer + pos + n, next_n);
+      dma_stats_end(DMA_STAGE_COPY, next_n, t);
+    }
+
+    t = dma_stats_start();
+    status = wait_dma_transfer(client->channel, status);
+    dma_stats_end(DMA_STAGE_WAIT, n, t);
+    dma_prog_cache_done(client);
+    dma_sched_leave(client);
+    if (status != ALT_E_SUCCESS)
+    {
+      mutex_unlock(&client->lock);
+      return -EIO;
+    }
+    if (error_count != 0)
+    {
+      mutex_unlock(&client->lock);
+      printk(KERN_INFO "DMA LKM: Failed to copy %d characters from the user in write function\n", error_count);
+      return -EFAULT;
+    }
+    if (next_n == 0)
+      break;
+    pos += n;
+    n = next_n;
+    cur ^= 1;
+  }
+  mutex_unlock(&client->lock);
+
+  return 0;
+}
+
+//Read len Bytes from the FPGA to the application. The DMA moves chunk N+1
+//while copy_to_user() of chunk N is done.
+static ssize_t dev_read_pipelined(struct dma_client *client, char *buffer,
+  size_t len)
+{
+  size_t chunk = (sub_buff_size/2) & PAGE_MASK;
+  size_t pos = 0;
+  size_t n = min(chunk, len);
+  size_t next_n;
+  int cur = 0;
+  int error_count;
+  ALT_STATUS_CODE status;
+  ALT_STATUS_CODE next_status = ALT_E_SUCCESS;
+  u32 t;
+
+  mutex_lock(&client->lock);
+  dma_sched_enter(client);
+  arm_dma_completion(client->channel);
+  status = dma_prog_cache_exec(client, client->prog_rd_v, client->prog_rd_h,
+    client_half_h(client, cur, len), (char*) client->fpga_padd + pos, n);
+
+  while (1)
+  {
+    t = dma_stats_start();
+    status = wait_dma_transfer(client->channel, status);
+    dma_stats_end(DMA_STAGE_WAIT, n, t);
+    dma_prog_cache_done(client);
+    dma_sched_leave(client);
+    if (status != ALT_E_SUCCESS)
+    {
+      mutex_unlock(&client->lock);
+      return -EIO;
+    }
+
+    //start next chunk in the other half before copying this one
+    next_n = min(chunk, len - pos - n);
+    if (next_n > 0)
+    {
+      dma_sched_enter(client);
+      arm_dma_completion(client->channel);
+      next_status = dma_prog_cache_exec(client, client->prog_rd_v,
+        client->prog_rd_h, client_half_h(client, cur ^ 1, len),
+        (char*) client->fpga_padd + pos + n, next_n);
+    }
+
+    t = dma_stats_start();
+    error_count = copy_to_user(buffer + pos, client_half_v(client, cur, len), n);
+    dma_stats_end(DMA_STAGE_COPY, n, t);
+    if (error_count != 0)
+    {
+      if (next_n > 0)
+      {
+        wait_dma_transfer(client->channel, next_status);
+        dma_prog_cache_done(client);
+        dma_sched_leave(client);
+      }
+      mutex_unlock(&client->lock);
+      printk(KERN_INFO "DMA LKM: Failed to send %d characters to the user in read function\n", error_count);
+      return -EFAULT;
+    }
+    if (next_n == 0)
+      break;
+    pos += n;
+    n = next_n;
+    cur ^= 1;
+    status = next_status;
+  }
+  mutex_unlock(&client->lock);
+
+  return 0;
+}
+
 /** @brief This function is called whenever fpga is being read from user space.
  *  when called, a DMA transfer from FPGA to a non_cached buffer in kernel space
  *  is done. Later this buffer is copied to the user space using copy_to_user()
- *  function.
+ *  function. Transfers bigger than half the buffer of the file are pipelined
+ *  (see dev_read_pipelined()).
  *  @param filep A pointer to a file object (defined in linux/fs.h)
  *  @param buffer The ptr to the buffer to which this function writes the data
  *  @param len The length of the b
  *  @param offset The offset if required
  */
 static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset){
+  struct dma_client *client = filep->private_data;
   ALT_STATUS_CODE status;
-  ALT_DMA_CHANNEL_STATE_t channel_state;
-  ALT_DMA_CHANNEL_FAULT_t fault;
   int error_count = 0;
   void* dma_transfer_src_h;//hardware address of the source buffer
   void* dma_transfer_dst_h;//hardware address of the destiny buffer
+  uint32_t fpga_padd;
+  u32 t;//start time of the stages for the statistics
+
+  if (mock_dma)
+    return -ENODEV;
+  if (dma_capture_busy(client))
+    return -EBUSY;
+  if (client_fpga_addr(client, 0, len, &fpga_padd) != 0)
+    return -EINVAL;
+  //with O_NONBLOCK the transfer is started and poll() reports its end
+  if ((filep->f_flags & O_NONBLOCK) && dma_irq_ok)
+    return dma_nb_read(client, buffer, len);
+  client_nb_finish(client);
+  client_acp_count(client, len);
+  //the program prepared in open() is used when the data fits in the buffer
+  if ((len > sub_buff_size) ||
+    ((client->prepare_microcode == 0) && (len > sub_buff_size/2)))
+    return dev_read_pipelined(client, buffer, len);
 
   //Copy data from hardware buffer (FPGA) to the application memory
-  if (prepare_microcode_in_open == 1)
+  mutex_lock(&client->lock);
+  dma_sched_enter(client);
+  arm_dma_completion(client->channel);
+  if ((client->prepare_microcode == 1) &&
+    (client->prog_prepared || (client_prepare_microcode(client) == 0)))
   {
     //execute the program prepared in the open
-    status = alt_dma_channel_exec(Dma_Channel, (ALT_DMA_PROGRAM_t*) DMA_PROG_RD_H);
+    t = dma_stats_start();
+    status = alt_dma_channel_exec(client->channel, client->prog_rd_h);
+    dma_stats_end(DMA_STAGE_EXEC, len, t);
   }
   else
   {
     //generate and execute a new program using the len as size
 
     //Prepare program for reads (RD)
-    dma_transfer_src_h = dma_buff_padd;
-    if (use_acp == 0) //not use use_acp
-      dma_transfer_dst_h = (void*)non_cached_mem_h;
-    else //use acp
-      dma_transfer_dst_h = (void*)((char*)cached_mem_h + 0x80000000);
-
-    status = alt_dma_memory_to_memory(
-  	Dma_Channel,
-  	(ALT_DMA_PROGRAM_t*) DMA_PROG_RD_V,
-  	(ALT_DMA_PROGRAM_t*) DMA_PROG_RD_H,
+    dma_transfer_src_h = client->fpga_padd;
+    dma_transfer_dst_h = client_buff_h(client, len);
+
+    status = dma_prog_cache_exec(
+  	client,
+  	client->prog_rd_v,
+  	client->prog_rd_h,
   	dma_transfer_dst_h,
   	dma_transfer_src_h,
-  	len,
-  	false,
-  	(ALT_DMA_EVENT_t)0);
+  	len);
   }
 
   //Wait for the transfer to be finished
-  channel_state = ALT_DMA_CHANNEL_STATE_EXECUTING;
-
-  if (status == ALT_E_SUCCESS)
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, len, t);
+  dma_prog_cache_done(client);
+  dma_sched_leave(client);
+  if (status != ALT_E_SUCCESS)
   {
-    while((status == ALT_E_SUCCESS) && (channel_state != ALT_DMA_CHANNEL_STATE_STOPPED))
-      {
-	status = alt_dma_channel_state_get(Dma_Channel, &channel_state);
-	if(channel_state == ALT_DMA_CHANNEL_STATE_FAULTING)
-	{
-	  alt_dma_channel_fault_status_get(Dma_Channel, &fault);
-	  printk(KERN_INFO "DMA LKM: ERROR! DMA Channel Fault: %d\n", (int)fault);
-	  return ALT_E_ERROR;
-	}
-      }
-   }
-   else
-   {
-     printk(KERN_INFO "DMA LKM: ERROR! DMA Transfer failed!\n");
-     return ALT_E_ERROR;
-   }
+    mutex_unlock(&client->lock);
+    return ALT_E_ERROR;
+  }
 
    //Copy the software buffer into user (application) space
-   if (use_acp == 0) //not use use_acp
-      error_count = copy_to_user(buffer, non_cached_mem_v, len);
-   else //use acp
-      error_count = copy_to_user(buffer, cached_mem_v, len);
+   t = dma_stats_start();
+   error_count = copy_to_user(buffer, client_buff_v(client, len), len);
+   dma_stats_end(DMA_STAGE_COPY, len, t);
+   mutex_unlock(&client->lock);
 
    if (error_count!=0){ // if true then have success
       printk(KERN_INFO "DMA LKM: Failed to send %d characters to the user in read function\n", error_count);
@@ -602,7 +1413,8 @@ static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *of
 /** @brief This function is called whenever fpga is being written from user
  *  space. When called, data is copied from user space to a non-cached buffer
  *  in kernel space using copy_from_user() function. Later a DMA transfer from
- *  that buffer to the FPGA takes place.
+ *  that buffer to the FPGA takes place. Transfers bigger than half the buffer
+ *  of the file are pipelined (see dev_write_pipelined()).
  *  @param filep A pointer to a file object
  *  @param buffer The buffer to that contains the string to write to the device
  *  @param len The length of the array of data that is being passed in the const
@@ -610,108 +1422,449 @@ static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *of
  *  @param offset The offset if required
  */
 static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset){
+  struct dma_client *client = filep->private_data;
   ALT_STATUS_CODE status;
-  ALT_DMA_CHANNEL_STATE_t channel_state;
-  ALT_DMA_CHANNEL_FAULT_t fault;
   int error_count = 0;
   void* dma_transfer_src_h;//hardware address of the source buffer
   void* dma_transfer_dst_h;//hardware address of the destiny buffer
-  int i;
-
-  /*if (use_acp==1) printk("offset=%d len=%d\n", (int) offset, (int)len);
-
-  if (use_acp==1){
-    printk("Cached buff before copy_from_user=[");
-    for (i=0; i<len+2; i++) printk("%d,",*((char*)(cached_mem_v)+i));
-    printk("]\n");
-  }*/
+  uint32_t fpga_padd;
+  u32 t;//start time of the stages for the statistics
+
+  if (mock_dma)
+    return -ENODEV;
+  if (dma_capture_busy(client))
+    return -EBUSY;
+  if (client_fpga_addr(client, 0, len, &fpga_padd) != 0)
+    return -EINVAL;
+  //with O_NONBLOCK the transfer is started and poll() reports its end
+  if ((filep->f_flags & O_NONBLOCK) && dma_irq_ok)
+    return dma_nb_write(client, buffer, len);
+  client_nb_finish(client);
+  client_acp_count(client, len);
+  //the program prepared in open() is used when the data fits in the buffer
+  if ((len > sub_buff_size) ||
+    ((client->prepare_microcode == 0) && (len > sub_buff_size/2)))
+    return dev_write_pipelined(client, buffer, len);
 
   //Copy data from user (application) space to a DMAble buffer
-   if (use_acp == 0) //not use use_acp
-      error_count = copy_from_user(non_cached_mem_v, buffer, len);
-   else //use acp
-      error_count = copy_from_user(cached_mem_v, buffer, len);
+   mutex_lock(&client->lock);
+   t = dma_stats_start();
+   error_count = copy_from_user(client_buff_v(client, len), buffer, len);
+   dma_stats_end(DMA_STAGE_COPY, len, t);
 
    if (error_count!=0){ // if true then have success
+      mutex_unlock(&client->lock);
       printk(KERN_INFO "DMA LKM: Failed to copy %d characters from the user in write function\n", error_count);
       return -EFAULT;  // Failed -- return a bad address message (i.e. -14)
    }
 
-  /*if (use_acp==1){
-    printk("Cached buff after copy_from_user=[");
-    for (i=0; i<len+2; i++) printk("%d,",*((char*)(cached_mem_v)+i));
-    printk("]\n");
-  }*/
-
   //Copy data DMAble buffer in kernel space to the FPGA
-  if (prepare_microcode_in_open == 1)
+  dma_sched_enter(client);
+  arm_dma_completion(client->channel);
+  if ((client->prepare_microcode == 1) &&
+    (client->prog_prepared || (client_prepare_microcode(client) == 0)))
   {
     //execute the program prepared in the open
-    status = alt_dma_channel_exec(Dma_Channel, (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H);
+    t = dma_stats_start();
+    status = alt_dma_channel_exec(client->channel, client->prog_wr_h);
+    dma_stats_end(DMA_STAGE_EXEC, len, t);
   }
   else
   {
     //generate and execute a new program using the len as size
     //Prepare program for writes (WR)
-    dma_transfer_dst_h = dma_buff_padd;
-    if (use_acp == 0) //not use use_acp
-      dma_transfer_src_h = (void*) non_cached_mem_h;
-    else //use acp
-      dma_transfer_src_h = (void*)((char*)cached_mem_h + 0x80000000);
-
-    status = alt_dma_memory_to_memory(
-    	Dma_Channel,
-    	(ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V,
-    	(ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H,
+    dma_transfer_dst_h = client->fpga_padd;
+    dma_transfer_src_h = client_buff_h(client, len);
+
+    status = dma_prog_cache_exec(
+    	client,
+    	client->prog_wr_v,
+    	client->prog_wr_h,
     	dma_transfer_dst_h,
     	dma_transfer_src_h,
-    	len,
-    	false,
-    	(ALT_DMA_EVENT_t)0);
+    	len);
   }
 
   //Wait for the transfer to be finished
-  channel_state = ALT_DMA_CHANNEL_STATE_EXECUTING;
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, len, t);
+  dma_prog_cache_done(client);
+  dma_sched_leave(client);
+  mutex_unlock(&client->lock);
+  if (status != ALT_E_SUCCESS)
+    return ALT_E_ERROR;
 
-  if (status == ALT_E_SUCCESS)
+  return 0;
+}
+
+/** @brief This function is called when the application uses mmap() on the
+ *  device. It maps the part of one of the DMAble buffers reserved for this file
+ *  into the application so data can be written or read directly there and
+ *  later moved with the DMA using ioctl(DMA_PL330_IOC_XFER), avoiding
+ *  copy_from_user()/copy_to_user(). The offset passed to mmap() selects the
+ *  buffer: DMA_PL330_MMAP_NON_CACHED for the uncached buffer or
+ *  DMA_PL330_MMAP_CACHED for the cached one.
+ *  @param filep A pointer to a file object
+ *  @param vma The virtual memory area of the application to be mapped
+ */
+static int dev_mmap(struct file *filep, struct vm_area_struct *vma){
+  struct dma_client *client = filep->private_data;
+  unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+  unsigned long size = vma->vm_end - vma->vm_start;
+  unsigned long pfn;
+
+  if (offset == DMA_PL330_MMAP_RING)
+    return dma_ring_mmap(client, vma);
+  if (offset == DMA_PL330_MMAP_CAPTURE)
+    return dma_capture_mmap(client, vma);
+
+  if (size > sub_buff_size) return -EINVAL;
+
+  if (offset == DMA_PL330_MMAP_NON_CACHED)
   {
-    while((status == ALT_E_SUCCESS) && (channel_state != ALT_DMA_CHANNEL_STATE_STOPPED))
-    {
-    	status = alt_dma_channel_state_get(Dma_Channel, &channel_state);
-    	if(channel_state == ALT_DMA_CHANNEL_STATE_FAULTING)
-    	{
-    	  alt_dma_channel_fault_status_get(Dma_Channel, &fault);
-    	  printk(KERN_INFO "DMA LKM: ERROR! DMA Channel Fault: %d\n", (int)fault);
-    	  return ALT_E_ERROR;
-    	}
-    }
+    //same attributes used by dma_alloc_coherent() for the kernel mapping
+    vma->vm_page_prot = pgprot_writecombine(vma->vm_page_prot);
+    pfn = client->non_cached_h >> PAGE_SHIFT;
+  }
+  else if (offset == DMA_PL330_MMAP_CACHED)
+  {
+    //cached mapping. The DMAC always accesses this buffer through ACP so it
+    //is coherent with the processor caches
+    pfn = client->cached_h >> PAGE_SHIFT;
+  }
+  else
+  {
+    printk(KERN_INFO "DMA LKM: mmap with wrong offset 0x%lx\n", offset);
+    return -EINVAL;
+  }
+
+  if (remap_pfn_range(vma, vma->vm_start, pfn, size, vma->vm_page_prot))
+  {
+    printk(KERN_INFO "DMA LKM: remap_pfn_range failed in mmap\n");
+    return -EAGAIN;
+  }
+
+  return 0;
+}
+
+//ioctl(DMA_PL330_IOC_SET_CONFIG): change the configuration of the file
+static long dev_set_config(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_config config;
+  long ret = 0;
+
+  if (copy_from_user(&config, (void*) arg, sizeof(config)) != 0)
+    return -EFAULT;
+  if ((config.use_acp > USE_ACP_AUTO) || (config.prepare_microcode > 1) ||
+    (config.sched_class >= DMA_PL330_CLASS_NUM) ||
+    !dma_burst_config_valid(config.burst))
+    return -EINVAL;
+  //the whole range is checked in each transfer
+  if ((config.fpga_addr != 0) && !fpga_in_window(config.fpga_addr, 1))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  client->fpga_padd = (config.fpga_addr != 0) ? (void*) config.fpga_addr :
+    dma_buff_padd;
+  client->fpga_user = (config.fpga_addr != 0);
+  client->use_acp = config.use_acp;
+  client->prepare_microcode = config.prepare_microcode;
+  client->transfer_size = config.transfer_size;
+  client->sched_class = config.sched_class;
+  client->burst = config.burst;
+  client->prog_prepared = false;
+  if ((client->prepare_microcode == 1) && !mock_dma)
+    ret = client_prepare_microcode(client);
+  mutex_unlock(&client->lock);
+
+  return ret;
+}
+
+//ioctl(DMA_PL330_IOC_GET_CONFIG): read the configuration of the file
+static long dev_get_config(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_config config;
+
+  mutex_lock(&client->lock);
+  config.fpga_addr = (__u32) client->fpga_padd;
+  config.use_acp = client->use_acp;
+  config.prepare_microcode = client->prepare_microcode;
+  config.transfer_size = client->transfer_size;
+  config.sched_class = client->sched_class;
+  config.burst = client->burst;
+  mutex_unlock(&client->lock);
+
+  if (copy_to_user((void*) arg, &config, sizeof(config)) != 0)
+    return -EFAULT;
+  return 0;
+}
+
+//ioctl(DMA_PL330_IOC_XFER_P2P): move data between two physical regions
+//without using the staging buffers in SDRAM. Both regions must be in the
+//bridge windows, as any FPGA address given by the application. HPS On-Chip
+//RAM is refused: the microcode of the channels and the cache of programs use
+//all of it. dma_sched_xfer() moves it with one program if it fits.
+static long dev_xfer_p2p(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_p2p p2p;
+  ALT_STATUS_CODE status;
+
+  if (mock_dma)
+    return -ENODEV;
+  if (copy_from_user(&p2p, (void*) arg, sizeof(p2p)) != 0)
+    return -EFAULT;
+  if (p2p.len == 0)
+    return -EINVAL;
+  if ((p2p.src >= HPS_OCR_HADDRESS) || (p2p.dst >= HPS_OCR_HADDRESS))
+  {
+    printk(KERN_INFO "DMA LKM: HPS On-Chip RAM is used by the microcode, not allowed in P2P transfers\n");
+    return -EINVAL;
   }
- else
- {
-   printk(KERN_INFO "DMA LKM: ERROR! DMA Transfer failed!\n");
-   return ALT_E_ERROR;
- }
+  if (!fpga_in_window(p2p.src, p2p.len) || !fpga_in_window(p2p.dst, p2p.len))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  status = dma_sched_xfer(client, client->prog_wr_v, client->prog_wr_h,
+    (void*) p2p.dst, (void*) p2p.src, p2p.len);
+  mutex_unlock(&client->lock);
 
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
   return 0;
 }
+
+/** @brief This function is called when the application uses ioctl() on the
+ *  device. The commands are:
+ *  -DMA_PL330_IOC_XFER moves len Bytes between a mapped buffer and
+ *   the FPGA. The data is not copied from or to the application because
+ *   it is already in the mapped buffer.
+ *  -DMA_PL330_IOC_RING_SETUP and DMA_PL330_IOC_RING_ENTER create the
+ *   submission/completion ring of the file and submit descriptors to it (see
+ *   DMA_PL330_LKM_ring.c).
+ *  -DMA_PL330_IOC_XFER_USER moves len Bytes between a buffer of the
+ *   application and the FPGA, accessing the pages of the buffer directly
+ *   (see DMA_PL330_LKM_sg.c).
+ *  -DMA_PL330_IOC_XFER_BATCH moves an array of descriptors like the one of
+ *   DMA_PL330_IOC_XFER with one DMA program (see DMA_PL330_LKM_batch.c).
+ *  -DMA_PL330_IOC_XFER_P2P moves len Bytes between two physical regions of
+ *   the FPGA bridges without using the buffers in SDRAM.
+ *  -DMA_PL330_IOC_FILL writes zeros or a 64-bit pattern in a mapped buffer
+ *   with the DMA (see DMA_PL330_LKM_fill.c).
+ *  -DMA_PL330_IOC_SET_CONFIG and DMA_PL330_IOC_GET_CONFIG change and read the
+ *   configuration of the file (FPGA address, use of ACP, prepared
+ *   microcode, priority class, burst profile), that is taken from sysfs in
+ *   open().
+ *  @param filep A pointer to a file object
+ *  @param cmd The ioctl command (see dma_pl330_ioctl.h)
+ *  @param arg Pointer to the argument of the command in application space
+ */
+static long dev_ioctl(struct file *filep, unsigned int cmd, unsigned long arg){
+  struct dma_client *client = filep->private_data;
+  ALT_STATUS_CODE status;
+  struct dma_pl330_xfer xfer;
+  void* buff_v;//virtual address of the data in the mapped buffer
+  void* buff_h;//hardware address of the data in the mapped buffer
+  void* fpga_h;//address of the data in the FPGA
+  uint32_t fpga_padd;
+  long ret;
+
+  //the channel runs the capture until it is stopped
+  if (dma_capture_busy(client) && (cmd != DMA_PL330_IOC_CAPTURE_STOP) &&
+    (cmd != DMA_PL330_IOC_GET_CONFIG))
+    return -EBUSY;
+  client_nb_finish(client);
+  switch (cmd)
+  {
+  case DMA_PL330_IOC_XFER:
+    break;
+  case DMA_PL330_IOC_RING_SETUP:
+    mutex_lock(&client->lock);
+    ret = dma_ring_setup(client, arg);
+    mutex_unlock(&client->lock);
+    return ret;
+  case DMA_PL330_IOC_RING_ENTER:
+    return dma_ring_enter(client, arg);
+  case DMA_PL330_IOC_XFER_USER:
+    return dma_sg_xfer_user(client, arg);
+  case DMA_PL330_IOC_XFER_BATCH:
+    return dma_batch_xfer(client, arg);
+  case DMA_PL330_IOC_XFER_P2P:
+    return dev_xfer_p2p(client, arg);
+  case DMA_PL330_IOC_XFER_PERIPH:
+    return dma_periph_xfer(client, arg);
+  case DMA_PL330_IOC_FILL:
+    return dma_fill(client, arg);
+  case DMA_PL330_IOC_CAPTURE_START:
+    return dma_capture_start(client, arg);
+  case DMA_PL330_IOC_CAPTURE_STOP:
+    return dma_capture_stop(client);
+  case DMA_PL330_IOC_SET_CONFIG:
+    return dev_set_config(client, arg);
+  case DMA_PL330_IOC_GET_CONFIG:
+    return dev_get_config(client, arg);
+  default:
+    return -ENOTTY;
+  }
+
+  if (mock_dma)
+    return -ENODEV;
+
+  if (copy_from_user(&xfer, (void*) arg, sizeof(xfer)) != 0)
+    return -EFAULT;
+
+  //Get the hardware address of the data from the offset
+  if (client_offset_to_buff(client, xfer.offset, xfer.len, &buff_v, &buff_h) != 0)
+    return -EINVAL;
+  if ((xfer.dir != DMA_PL330_DIR_TO_FPGA) && (xfer.dir != DMA_PL330_DIR_FROM_FPGA))
+    return -EINVAL;
+
+  //Get the program from the cache (or generate it) and execute it in slices
+  //if the file is in the bulk class
+  mutex_lock(&client->lock);
+  if (client_fpga_addr(client, xfer.fpga_addr, xfer.len, &fpga_padd) != 0)
+  {
+    mutex_unlock(&client->lock);
+    return -EINVAL;
+  }
+  fpga_h = (void*) fpga_padd;
+  if (xfer.dir == DMA_PL330_DIR_TO_FPGA)
+    status = dma_sched_xfer(client, client->prog_wr_v,
+      client->prog_wr_h, fpga_h, buff_h, (size_t) xfer.len);
+  else
+    status = dma_sched_xfer(client, client->prog_rd_v,
+      client->prog_rd_h, buff_h, fpga_h, (size_t) xfer.len);
+  mutex_unlock(&client->lock);
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+
+  return 0;
+}
+
 /** @brief The device release function that is called whenever the device is closed/released by
- *  the userspace program
+ *  the userspace program. It frees the DMA channel of the file so it can be
+ *  used by the next open().
  */
 static int dev_release(struct inode *inodep, struct file *filep){
-   //in a decent driver unlock here the driver so the resource is free
+   struct dma_client *client = filep->private_data;
+
+   //Stop the ring, the capture and the non-blocking transfer before freeing
+   //the channel
+   dma_ring_release(client);
+   dma_capture_release(client);
+   client_nb_finish(client);
+
+   dma_channel_release(client->channel);
+   mutex_lock(&channel_alloc_mutex);
+   numberOpens--;
+   mutex_unlock(&channel_alloc_mutex);
+
+   kfree(client);
    return 0;
 }
 
+//--------------ALLOCATION OF THE UNCACHED AND CACHED BUFFERS---------------//
+//Get the buffers of staging_size Bytes from the reserved region or from the
+//kernel. Returns 0 if success. Each channel needs 2 pages at least, so the
+//halves used by the pipelined read() and write() have one page or more.
+static int dma_staging_alloc(void)
+{
+   if ((staging_size < 2*dma_channels*PAGE_SIZE) ||
+     (staging_size > DMA_PL330_MMAP_CACHED) || (staging_size & ~PAGE_MASK))
+   {
+     printk(KERN_INFO "DMA LKM: staging_size must be multiple of the page, from %lu Bytes to 256MB\n",
+       2*dma_channels*PAGE_SIZE);
+     return -EINVAL;
+   }
+
+   if (reserved_mem_addr != 0)
+   {
+     //The region is not in the memory of Linux so it is mapped with the same
+     //attributes used in mmap(): write combine (as dma_alloc_coherent()) for
+     //the uncached buffer and write-back for the cached buffer. The cached
+     //buffer must be in the first GB, the one seen by the DMAC through ACP.
+     if ((reserved_mem_addr & ~PAGE_MASK) ||
+       (reserved_mem_addr >= 0x40000000) ||
+       (2*staging_size > 0x40000000 - reserved_mem_addr))
+     {
+       printk(KERN_INFO "DMA LKM: reserved_mem_addr must be page aligned and the region inside the first GB of SDRAM\n");
+       return -EINVAL;
+     }
+     non_cached_mem_h = reserved_mem_addr;
+     non_cached_mem_v = ioremap_wc(non_cached_mem_h, staging_size);
+     cached_mem_h = reserved_mem_addr + staging_size;
+     cached_mem_v = ioremap_cached(cached_mem_h, staging_size);
+     if ((non_cached_mem_v == NULL) || (cached_mem_v == NULL))
+     {
+       printk(KERN_INFO "DMA LKM: ioremap of the reserved region failed\n");
+       if (non_cached_mem_v != NULL) iounmap(non_cached_mem_v);
+       if (cached_mem_v != NULL) iounmap(cached_mem_v);
+       return -ENOMEM;
+     }
+     printk(KERN_INFO "DMA LKM: buffers of %u Bytes in reserved region at 0x%lx\n",
+       staging_size, reserved_mem_addr);
+     return 0;
+   }
+
+   //--Allocate uncached buffer--//
+   //The dma_alloc_coherent() function allocates non-cached physically
+   //contiguous memory. Accesses to the memory by the CPU are the same
+   //as a cache miss when the cache is used. The CPU does not have to
+   //invalidate or flush the cache which can be time consuming.
+   //Without CMA the max in Angstrom and CycloneVSoC is 4MB.
+   non_cached_mem_v = dma_alloc_coherent(NULL, staging_size,
+     &non_cached_mem_h, GFP_KERNEL);
+   if (non_cached_mem_v == NULL) {
+	printk(KERN_INFO "DMA LKM: allocation of non-cached buffer failed\n");
+	return -ENOMEM;
+   }else{
+      printk(KERN_INFO "DMA LKM: allocation of non-cached buffer successful\n");
+   }
+
+   //--Allocate cached buffer--//
+   //kmalloc() function allocates cached memory which is
+   //physically contiguous. Use kmalloc with ACP transactions
+   if (staging_size > KMALLOC_MAX_SIZE)
+     cached_mem_v = NULL;
+   else
+     cached_mem_v = kmalloc(staging_size, (GFP_DMA | GFP_ATOMIC));
+   if (cached_mem_v == NULL) {
+	printk(KERN_INFO "DMA LKM: allocation of cached buffer failed (use reserved_mem_addr for big buffers)\n");
+	dma_free_coherent(NULL, staging_size, non_cached_mem_v, non_cached_mem_h);
+	return -ENOMEM;
+   }else{
+      printk(KERN_INFO "DMA LKM: allocation of cached buffer successful\n");
+   }
+   //get the physical address of this buffer
+   cached_mem_h = virt_to_phys((volatile void*) cached_mem_v);
+   return 0;
+}
+
+static void dma_staging_free(void)
+{
+   if (reserved_mem_addr != 0)
+   {
+     iounmap(cached_mem_v);
+     iounmap(non_cached_mem_v);
+   }
+   else
+   {
+     kfree(cached_mem_v);
+     dma_free_coherent(NULL, staging_size, non_cached_mem_v, non_cached_mem_h);
+   }
+}
+
 //------------------------LKM init and exit functions-----------------------//
 /** @brief The LKM initialization function
  *  The static keyword restricts the visibility of the function to within this C file. The __init
  *  macro means that for a built-in driver (not a LKM) the function is only used at initialization
  *  time and that it can be discarded and its memory freed up after that point.
- *  @return returns 0 if successful
+ *  @return returns 0 if successful or a negative errno (nothing is left initialized)
  */
 static int __init DMA_PL330_LKM_init(void){
    ALT_STATUS_CODE status;
    int result = 0;
+   int ret;
    const uint32_t ARUSER = 0b11111; //acpidmap:coherent cacheable reads
    const uint32_t AWUSER = 0b11111; //acpidmap:coherent cacheable writes
    int var = 0;
@@ -719,25 +1872,35 @@ static int __init DMA_PL330_LKM_init(void){
    printk(KERN_INFO "DMA LKM: Initializing module!!\n");
 
    //--Initialize DMA Controller--//
-   status = PL330_init();
+   //In test mode (mock_dma=1) the DMAC is not used
+   if (mock_dma)
+       status = dma_ring_mock_init();
+   else
+       status = PL330_init();
    if(status == ALT_E_SUCCESS)
    {
        printk(KERN_INFO "DMA LKM: DMAC init was successful\n");
    }else{
        printk(KERN_INFO "DMA LKM: DMAC init failed\n");
-       goto error_HPS_ioremap;
+       ret = -ENODEV;
+       goto error_dmac_init;
    }
 
-   //--Allocate DMA Channel--//
-   status = alt_dma_channel_alloc_any(&Dma_Channel);
-   if (status == ALT_E_SUCCESS)
+   //--Divide the buffers between the channels--//
+   //DMA channels are allocated in open() (one per file)
+   if ((dma_channels < 1) || (dma_channels > 8))
    {
-       printk(KERN_INFO "DMA LKM: DMA channel allocation successful.\n");
+       printk(KERN_INFO "DMA LKM: dma_channels must be between 1 and 8. Using 8.\n");
+       dma_channels = 8;
    }
-   else{
-       printk(KERN_INFO "DMA LKM: DMA channel allocation failed.\n");
-       goto error_HPS_ioremap;
-  }
+   sub_buff_size = (staging_size / dma_channels) & PAGE_MASK;
+
+   //--Request the DMAC IRQs used to signal the end of transfers--//
+   if (!mock_dma)
+       dma_irq_init();
+
+   //--Create the latency statistics in debugfs (not needed to work)--//
+   dma_stats_init();
 
     //--ioremap HPS On-Chip memory--//
    //To ioremap the OCM in the HPS so we can access from kernel space
@@ -745,51 +1908,76 @@ static int __init DMA_PL330_LKM_init(void){
     if (hps_ocr_vaddress == NULL)
     {
       printk(KERN_INFO "DMA LKM: error doing HPS OCR ioremap\n");
+      ret = -ENOMEM;
       goto error_HPS_ioremap;
     }
     else
     {
       printk(KERN_INFO "DMA LKM: HPS OCR ioremap success\n");
     }
+    dma_prog_cache_init(hps_ocr_vaddress + DMA_PROG_CACHE_OFFSET,
+      (void*) (HPS_OCR_HADDRESS + DMA_PROG_CACHE_OFFSET),
+      HPS_OCR_SIZE - DMA_PROG_CACHE_OFFSET);
 
-   //--Allocate uncached buffer--//
-   //The dma_alloc_coherent() function allocates non-cached physically
-   //contiguous memory. Accesses to the memory by the CPU are the same
-   //as a cache miss when the cache is used. The CPU does not have to
-   //invalidate or flush the cache which can be time consuming.
+   //--Allocate the uncached and cached buffers--//
+   ret = dma_staging_alloc();
+   if (ret != 0)
+     goto error_dma_alloc_coherent;
 
-   non_cached_mem_v = dma_alloc_coherent(
-		      //&pdev,
-		      NULL,
-		      //PAGE_SIZE,
-		      (NON_CACHED_MEM_SIZE), ////Max in Angstrom and CycloneVSoC is 4MB
-		      &non_cached_mem_h, //address to use from DMAC
-		      GFP_KERNEL);
-   if (non_cached_mem_v == NULL) {
-	printk(KERN_INFO "DMA LKM: allocation of non-cached buffer failed\n");
-	goto error_dma_alloc_coherent;
-   }else{
-      printk(KERN_INFO "DMA LKM: allocation of non-cached buffer successful\n");
-   }
-
-   //--Allocate cached buffer--//
-   //kmalloc() function allocates cached memory which is
-   //physically contiguous. Use kmalloc with ACP transactions
-   cached_mem_v = kmalloc(CACHED_MEM_SIZE, (GFP_DMA | GFP_ATOMIC));
-   if (cached_mem_v == NULL) {
-	printk(KERN_INFO "DMA LKM: allocation of cached buffer failed\n");
-	goto error_kmalloc;
-   }else{
-      printk(KERN_INFO "DMA LKM: allocation of cached buffer successful\n");
-   }
-   //get the physical address of this buffer
-   cached_mem_h = virt_to_phys((volatile void*) cached_mem_v);
+  //--ACP configuration--//
+  if (!mock_dma)
+  {
+    //Do ioremap to be able to acess hw regs from inside the module
+    alt_acpidmap_iomap();
+    //print_acpidmap_regs();
+    result = 1;
+    //Set output ID3 for dynamic reads and ID4 for dynamic writes
+    status = alt_acp_id_map_dynamic_read_set(ALT_ACP_ID_OUT_DYNAM_ID_3);
+    if (status!=ALT_E_SUCCESS) result = 0;
+    status = alt_acp_id_map_dynamic_write_set(ALT_ACP_ID_OUT_DYNAM_ID_4);
+    if (status!=ALT_E_SUCCESS) result = 0;
+    //Configure the page and user write sideband signal options that are applied
+    //to all write transactions that have their input IDs dynamically mapped.
+    status = alt_acp_id_map_dynamic_read_options_set(ALT_ACP_ID_MAP_PAGE_0, ARUSER);
+    if (status!=ALT_E_SUCCESS) result = 0;
+    status = alt_acp_id_map_dynamic_write_options_set(ALT_ACP_ID_MAP_PAGE_0, AWUSER);
+    if (status!=ALT_E_SUCCESS) result = 0;
+    //print_acpidmap_regs();
+    if (result==1)
+      printk(KERN_INFO "DMA LKM: ACP ID Mapper successfully configured.\n");
+    else
+      printk(KERN_INFO
+        "DMA LKM: Some ERROR configuring ACP ID Mapper. ACP access may fail.\n");
+    alt_acpidmap_iounmap();
+
+    //--Measure ACP and direct paths for use_acp=2--//
+    //Done before creating /dev/dma_pl330 and the sysfs entries, so channel 0
+    //and its program slot are not used by anybody else
+    dma_acp_calibrate(non_cached_mem_v, non_cached_mem_h, cached_mem_v,
+      cached_mem_h, staging_size, (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V(0),
+      (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H(0));
+
+    //--Memories of the CPU vs DMA benchmark (sysfs entry bench)--//
+    //Set before the sysfs entries exist. The measures reserve all channels.
+    dma_bench_init(hps_ocr_vaddress + DMA_PROG_CACHE_OFFSET,
+      (void*) (HPS_OCR_HADDRESS + DMA_PROG_CACHE_OFFSET),
+      HPS_OCR_SIZE - DMA_PROG_CACHE_OFFSET, non_cached_mem_v,
+      non_cached_mem_h, cached_mem_v, cached_mem_h, staging_size,
+      (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V(0),
+      (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H(0));
+
+    //--Buffers of the tuner of the burst profiles (sysfs burst_profiles)--//
+    dma_burst_init(non_cached_mem_h, cached_mem_h, staging_size,
+      (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_V(0),
+      (ALT_DMA_PROGRAM_t*) DMA_PROG_WR_H(0));
+  }
 
    //--export some variables using sysfs--//
    // create the kobject sysfs entry at /sys/dma_pl330
    pl330_lkm_kobj = kobject_create_and_add("dma_pl330", kernel_kobj->parent); // kernel_kobj points to /sys/kernel
    if(!pl330_lkm_kobj){
       printk(KERN_INFO "DMA LKM:failed to create kobject mapping\n");
+      ret = -ENOMEM;
       goto error_kobject_mapping;
    }else{
       printk(KERN_INFO "DMA LKM: kobject creation successful\n");
@@ -798,6 +1986,7 @@ static int __init DMA_PL330_LKM_init(void){
    result = sysfs_create_group(pl330_lkm_kobj, &attr_group);
    if(result) {
       printk(KERN_INFO "DMA LKM:failed to create sysfs group\n");
+      ret = result;
       goto error_kobject_group;
    }else{
       printk(KERN_INFO "DMA LKM: sysfs creation successfull\n");
@@ -808,6 +1997,7 @@ static int __init DMA_PL330_LKM_init(void){
    majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
    if (majorNumber<0){
       printk(KERN_INFO "DMA LKM: failed to register a major number\n");
+      ret = majorNumber;
       goto error_kobject_group;
    }
    printk(KERN_INFO "DMA LKM: char device registered correctly with major number %d\n", majorNumber);
@@ -815,6 +2005,7 @@ static int __init DMA_PL330_LKM_init(void){
    dma_Class = class_create(THIS_MODULE, CLASS_NAME);
    if (IS_ERR(dma_Class)){                // Check for error and clean up if there is
       printk(KERN_INFO "DMA LKM: Failed to register device class\n");
+      ret = PTR_ERR(dma_Class);
       goto error_create_dev_class;
    }
    printk(KERN_INFO "DMA LKM: char device class registered correctly\n");
@@ -823,35 +2014,18 @@ static int __init DMA_PL330_LKM_init(void){
    if (IS_ERR(dma_Device)){               // Clean up if there is an error
 
       printk(KERN_INFO "DMA LKM: Failed to create the device\n");
+      ret = PTR_ERR(dma_Device);
       goto error_create_dev;
    }
    printk(KERN_INFO "DMA LKM: device successfully created in node: /dev/%s\n", DEVICE_NAME);
    //printk(KERN_INFO DEVICE_NAME);
    //printk(KERN_INFO "\n");
 
-  //--ACP configuration--//
-  //Do ioremap to be able to acess hw regs from inside the module
-  alt_acpidmap_iomap();
-  //print_acpidmap_regs();
-  result = 1;
-  //Set output ID3 for dynamic reads and ID4 for dynamic writes
-  status = alt_acp_id_map_dynamic_read_set(ALT_ACP_ID_OUT_DYNAM_ID_3);
-  if (status!=ALT_E_SUCCESS) result = 0;
-  status = alt_acp_id_map_dynamic_write_set(ALT_ACP_ID_OUT_DYNAM_ID_4);
-  if (status!=ALT_E_SUCCESS) result = 0;
-  //Configure the page and user write sideband signal options that are applied
-  //to all write transactions that have their input IDs dynamically mapped.
-  status = alt_acp_id_map_dynamic_read_options_set(ALT_ACP_ID_MAP_PAGE_0, ARUSER);
-  if (status!=ALT_E_SUCCESS) result = 0;
-  status = alt_acp_id_map_dynamic_write_options_set(ALT_ACP_ID_MAP_PAGE_0, AWUSER);
-  if (status!=ALT_E_SUCCESS) result = 0;
-  //print_acpidmap_regs();
-  if (result==1)
-    printk(KERN_INFO "DMA LKM: ACP ID Mapper successfully configured.\n");
-  else
-    printk(KERN_INFO
-      "DMA LKM: Some ERROR configuring ACP ID Mapper. ACP access may fail.\n");
-  alt_acpidmap_iounmap();
+  //--Register the channels in dmaengine for other drivers--//
+  //Optional: the char device works without it (dma_eng_uninit() in exit
+  //only undoes what was registered)
+  if (dma_eng_init() != 0)
+    printk(KERN_INFO "DMA LKM: dmaengine channels not available\n");
 
   //--Enable PMU from user space setting PMUSERENR.EN bit--//
   //read PMUSERENR
@@ -880,13 +2054,18 @@ error_create_dev_class:
 error_kobject_group:
   kobject_put(pl330_lkm_kobj);
 error_kobject_mapping:
-  kfree(cached_mem_v);
-error_kmalloc:
-  dma_free_coherent(NULL, (NON_CACHED_MEM_SIZE), non_cached_mem_v, non_cached_mem_h);
+  dma_staging_free();
 error_dma_alloc_coherent:
    iounmap(hps_ocr_vaddress);
 error_HPS_ioremap:
-   return 0;
+   dma_stats_uninit();
+   dma_irq_uninit();
+   if (mock_dma)
+     dma_ring_mock_uninit();
+   else
+     PL330_uninit();
+error_dmac_init:
+   return ret;
 }
 
 /** @brief The LKM cleanup function
@@ -899,15 +2078,20 @@ static void __exit DMA_PL330_LKM_exit(void){
     (unsigned int) dma_buff_padd, use_acp, prepare_microcode_in_open, dma_transfer_size);
    printk(KERN_INFO "DMA LKM: Exiting module!!\n");
    //Undo what init did
+   dma_eng_uninit();
    device_destroy(dma_Class, MKDEV(majorNumber, 0));     // remove the device
    class_unregister(dma_Class);                          // unregister the device class
    class_destroy(dma_Class);                             // remove the device class
    unregister_chrdev(majorNumber, DEVICE_NAME);             // unregister the major number
    kobject_put(pl330_lkm_kobj);
-   kfree(cached_mem_v);
-   dma_free_coherent(NULL, (NON_CACHED_MEM_SIZE), non_cached_mem_v, non_cached_mem_h);
+   dma_staging_free();
    iounmap(hps_ocr_vaddress);
-   PL330_uninit();
+   dma_stats_uninit();
+   dma_irq_uninit();
+   if (mock_dma)
+     dma_ring_mock_uninit();
+   else
+     PL330_uninit();
 }
 
 /** @brief A module must use the module_init() module_exit() macros from linux/init.h, which
@@ -0,0 +1,226 @@
+/**
+ * @file    DMA_PL330_LKM.h
+ * @brief  Declarations shared between the files of the DMA_PL330_LKM module.
+ *
+ * DMA_PL330_LKM.c implements the char device driver and the functions to do
+ * and wait for transfers. The other DMA_PL330_LKM_*.c files implement extra
+ * features on top of them.
+*/
+#ifndef __DMA_PL330_LKM_H__
+#define __DMA_PL330_LKM_H__
+
+#include <linux/types.h>
+#include <linux/mm.h>
+#include <linux/mutex.h>
+
+#include "hwlib_socal_linux.h"
+#include "alt_dma.h"
+
+//---------VARIABLES FOR EACH OPEN FILE-----------------//
+//Each open() reserves a DMA channel, the microcode slot of that channel and
+//a part of the cached and uncached buffers, so up to dma_channels applications
+//can use the driver at the same time. The buffers are divided in dma_channels
+//parts of sub_buff_size Bytes. Channel n uses part n.
+struct dma_ring;
+struct dma_prog_entry;
+struct dma_capture;
+struct dma_client {
+  ALT_DMA_CHANNEL_t channel; //dma channel to be used in transfers
+  ALT_DMA_PROGRAM_t* prog_wr_v; //virtual address of the program for writes
+  ALT_DMA_PROGRAM_t* prog_wr_h; //hardware address of the program for writes
+  ALT_DMA_PROGRAM_t* prog_rd_v; //virtual address of the program for reads
+  ALT_DMA_PROGRAM_t* prog_rd_h; //hardware address of the program for reads
+  void* pattern_v; //virtual address of the fill pattern in the slot
+  void* pattern_h; //hardware address of the fill pattern in the slot
+  void* non_cached_v; //virtual address of the part of the uncached buffer
+  dma_addr_t non_cached_h; //hardware address of the part of the uncached buffer
+  void* cached_v; //virtual address of the part of the cached buffer
+  phys_addr_t cached_h; //hardware address of the part of the cached buffer
+  struct mutex lock; //only one transfer at a time in the channel
+  struct dma_ring* ring; //submission/completion ring (NULL if not set up)
+  struct dma_prog_entry* prog_entry; //cached program being executed (or NULL)
+  //Configuration of the file. Taken from sysfs in open() and changed with
+  //ioctl(DMA_PL330_IOC_SET_CONFIG)
+  void* fpga_padd; //physical address in the FPGA used by read() and write()
+  bool fpga_user; //fpga_padd was given by the application (checked in each
+                  //transfer, see client_fpga_addr())
+  int use_acp; //read() and write() use the cached buffer through ACP (1),
+               //the uncached buffer (0) or select by size (2)
+  int prepare_microcode; //read() and write() use the prepared programs
+  unsigned int transfer_size; //size of the prepared programs
+  bool prog_prepared; //the prepared programs are in the slot of the channel
+  int sched_class; //DMA_PL330_CLASS_* (see DMA_PL330_LKM_sched.c)
+  uint32_t burst; //DMA_PL330_BURST() or 0 (see DMA_PL330_LKM_burst.c)
+  //Transfer started by read() or write() with O_NONBLOCK
+  int nb_state; //DMA_NB_* (see DMA_PL330_LKM_nonblock.c)
+  size_t nb_len; //size of the transfer
+  int nb_result; //0 or error of the last finished transfer
+  struct dma_capture* capture; //cyclic capture (NULL if never started)
+};
+
+//AxCACHE bits of the CCR used in all the programs (ALT_DMA_RC_ON and
+//ALT_DMA_WC_ON in alt_dma.c) so the accesses through ACP are coherent
+#define DMA_CCR_RC_ON 0x00003800
+#define DMA_CCR_WC_ON 0x0E000000
+
+//---------VARIABLES AND FUNCTIONS IN DMA_PL330_LKM.c-----------------//
+extern void* dma_buff_padd;
+extern unsigned int sub_buff_size;
+extern bool dma_irq_ok;
+extern int mock_dma;
+
+void client_acp_count(struct dma_client *client, size_t len);
+void* client_buff_h(struct dma_client *client, size_t len);
+void* client_buff_v(struct dma_client *client, size_t len);
+int client_offset_to_buff(struct dma_client *client, uint32_t offset,
+  uint32_t len, void** buff_v, void** buff_h);
+int client_fpga_addr(struct dma_client *client, uint32_t addr, uint32_t len,
+  uint32_t* fpga_padd);
+void arm_dma_completion(ALT_DMA_CHANNEL_t channel);
+ALT_STATUS_CODE wait_dma_transfer(ALT_DMA_CHANNEL_t channel,
+  ALT_STATUS_CODE status);
+bool dma_transfer_done(ALT_DMA_CHANNEL_t channel);
+struct file;
+struct poll_table_struct;
+void dma_poll_wait(struct file *filep, ALT_DMA_CHANNEL_t channel,
+  struct poll_table_struct *wait);
+int dma_channel_reserve(void);
+void dma_channel_release(ALT_DMA_CHANNEL_t channel);
+void dma_client_init(struct dma_client *client, int ch);
+int dma_channel_reserve_all(void);
+void dma_channel_release_all(void);
+
+//---------SUBMISSION/COMPLETION RING (DMA_PL330_LKM_ring.c)-----------//
+int dma_ring_mock_init(void);
+void dma_ring_mock_uninit(void);
+long dma_ring_setup(struct dma_client *client, unsigned long arg);
+long dma_ring_enter(struct dma_client *client, unsigned long arg);
+int dma_ring_mmap(struct dma_client *client, struct vm_area_struct *vma);
+void dma_ring_release(struct dma_client *client);
+int mock_dma_transfer(void* buff_v, uint32_t fpga_padd, uint32_t len,
+  uint32_t dir);
+
+//---------SCATTER-GATHER FROM APPLICATION BUFFERS (DMA_PL330_LKM_sg.c)------//
+long dma_sg_xfer_user(struct dma_client *client, unsigned long arg);
+
+//---------VECTORED TRANSFERS (DMA_PL330_LKM_batch.c)-----------------//
+struct kiocb;
+struct iovec;
+//Many segments moved with one program built in the write slot of a client
+struct dma_batch {
+  struct dma_client *client;
+  int segments;       //segments in the program not executed yet
+  size_t size;        //Bytes in the program not executed yet
+  //segment being built (merging contiguous descriptors)
+  char* dst;
+  char* src;
+  uint32_t len;
+};
+
+void dma_batch_begin(struct dma_batch *b, struct dma_client *client);
+int dma_batch_add(struct dma_batch *b, void* dst, void* src, uint32_t len);
+int dma_batch_end(struct dma_batch *b);
+long dma_batch_xfer(struct dma_client *client, unsigned long arg);
+ssize_t dma_batch_aio_write(struct kiocb *iocb, const struct iovec *iov,
+  unsigned long nr_segs, loff_t pos);
+ssize_t dma_batch_aio_read(struct kiocb *iocb, const struct iovec *iov,
+  unsigned long nr_segs, loff_t pos);
+
+//---------CACHE OF DMA PROGRAMS (DMA_PL330_LKM_progcache.c)-----------//
+extern int prog_cache_enable;
+extern unsigned int prog_cache_hits;
+extern unsigned int prog_cache_misses;
+extern unsigned int prog_cache_patches;
+
+void dma_prog_cache_init(void* base_v, void* base_h, unsigned int size);
+void dma_prog_cache_flush(void);
+ALT_STATUS_CODE dma_prog_cache_exec(struct dma_client *client,
+  ALT_DMA_PROGRAM_t* progv, ALT_DMA_PROGRAM_t* progh, void* dst,
+  const void* src, size_t size);
+void dma_prog_cache_done(struct dma_client *client);
+
+//---------LATENCY STATISTICS IN DEBUGFS (DMA_PL330_LKM_stats.c)------//
+//Stages of a transfer measured
+#define DMA_STAGE_PREPARE 0 //generation of the microcode
+#define DMA_STAGE_EXEC    1 //alt_dma_channel_exec()
+#define DMA_STAGE_WAIT    2 //wait_dma_transfer()
+#define DMA_STAGE_COPY    3 //copy_from_user()/copy_to_user()
+#define DMA_STAGE_NUM     4
+
+int dma_stats_init(void);
+void dma_stats_uninit(void);
+u32 dma_stats_start(void);
+void dma_stats_end(int stage, size_t size, u32 start);
+
+//---------SELECTION OF ACP OR DIRECT PATH (DMA_PL330_LKM_acp.c)-------//
+#define USE_ACP_AUTO 2 //use_acp value to select the path by transfer size
+extern unsigned int acp_crossover;
+extern unsigned int acp_decisions_acp;
+extern unsigned int acp_decisions_direct;
+
+void dma_acp_calibrate(void* non_cached_v, dma_addr_t non_cached_h,
+  void* cached_v, phys_addr_t cached_h, size_t buff_size,
+  ALT_DMA_PROGRAM_t* prog_v, ALT_DMA_PROGRAM_t* prog_h);
+int dma_acp_auto(size_t len);
+void dma_acp_count(int acp);
+
+//---------NON-BLOCKING READ AND WRITE (DMA_PL330_LKM_nonblock.c)-----//
+#define DMA_NB_IDLE      0 //no transfer running
+#define DMA_NB_WRITE     1 //write to the FPGA running
+#define DMA_NB_READ      2 //read from the FPGA running
+#define DMA_NB_READ_DONE 3 //read finished, data not taken by read() yet
+
+ssize_t dma_nb_write(struct dma_client *client, const char *buffer,
+  size_t len);
+ssize_t dma_nb_read(struct dma_client *client, char *buffer, size_t len);
+void dma_nb_finish(struct dma_client *client);
+unsigned int dma_nb_poll(struct file *filep, struct poll_table_struct *wait);
+
+//---------CYCLIC CAPTURE FROM THE FPGA (DMA_PL330_LKM_capture.c)-----//
+void dma_capture_irq(ALT_DMA_EVENT_t evt);
+long dma_capture_start(struct dma_client *client, unsigned long arg);
+long dma_capture_stop(struct dma_client *client);
+bool dma_capture_busy(struct dma_client *client);
+unsigned int dma_capture_poll(struct file *filep,
+  struct poll_table_struct *wait);
+int dma_capture_mmap(struct dma_client *client, struct vm_area_struct *vma);
+void dma_capture_release(struct dma_client *client);
+
+//---------TRANSFERS WITH FLOW CONTROL (DMA_PL330_LKM_periph.c)-------//
+long dma_periph_xfer(struct dma_client *client, unsigned long arg);
+
+//---------FILL OF THE STAGING BUFFERS (DMA_PL330_LKM_fill.c)---------//
+long dma_fill(struct dma_client *client, unsigned long arg);
+
+//---------CPU VS DMA BENCHMARK IN SYSFS (DMA_PL330_LKM_bench.c)-------//
+void dma_bench_init(void* ocr_v, void* ocr_h, size_t ocr_size,
+  void* non_cached_v, dma_addr_t non_cached_h, void* cached_v,
+  phys_addr_t cached_h, size_t buff_size, ALT_DMA_PROGRAM_t* prog_v,
+  ALT_DMA_PROGRAM_t* prog_h);
+ssize_t dma_bench_store(const char *buf, size_t count);
+ssize_t dma_bench_show(char *buf);
+
+//---------PRIORITY CLASSES OF THE FILES (DMA_PL330_LKM_sched.c)------//
+void dma_sched_enter(struct dma_client *client);
+void dma_sched_leave(struct dma_client *client);
+ALT_STATUS_CODE dma_sched_xfer(struct dma_client *client,
+  ALT_DMA_PROGRAM_t* progv, ALT_DMA_PROGRAM_t* progh, void* dst,
+  const void* src, size_t size);
+ssize_t dma_sched_show(char *buf);
+void dma_sched_reset(void);
+
+//---------BURST PROFILES (DMA_PL330_LKM_burst.c)----------------------//
+void dma_burst_init(dma_addr_t non_cached_h, phys_addr_t cached_h,
+  size_t buff_size, ALT_DMA_PROGRAM_t* prog_v, ALT_DMA_PROGRAM_t* prog_h);
+void dma_burst_select(struct dma_client *client, const void* dst,
+  const void* src, ALT_DMA_BURST_t* burst);
+size_t dma_burst_max_len(const ALT_DMA_BURST_t* burst);
+bool dma_burst_config_valid(uint32_t burst);
+ssize_t dma_burst_store(const char *buf, size_t count);
+ssize_t dma_burst_show(char *buf);
+
+//---------DMAENGINE PROVIDER (DMA_PL330_LKM_dmaengine.c)-------------//
+int dma_eng_init(void);
+void dma_eng_uninit(void);
+
+#endif //__DMA_PL330_LKM_H__
@@ -0,0 +1,142 @@
+/**
+ * @file    DMA_PL330_LKM_acp.c
+ * @brief  Automatic selection between the ACP path and the direct path to
+ * SDRAM (use_acp=2).
+ *
+ * When the DMAC accesses the cached buffer through ACP the data is taken from
+ * (or put in) the L2 cache. This is faster while the data fits in the 512kB
+ * L2. For bigger transfers the data does not fit, ACP accesses produce cache
+ * misses and evictions, and the uncached buffer accessed through the
+ * L3-to-SDRAMC port is faster.
+ *
+ * When the module is inserted both paths are measured for sizes from 4kB to
+ * half of the buffer. Each measure fills the buffer with the CPU (as
+ * copy_from_user() does in write()) and moves it with the DMA to the other
+ * half of the same buffer. The crossover is the smallest size from which the
+ * direct path is always faster. Transfers of files with use_acp=2 smaller
+ * than the crossover use ACP and the others the direct path.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <asm/div64.h>
+
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR THE CALIBRATION------------------//
+static int acp_calibrate = 1;
+module_param(acp_calibrate, int, 0444);
+MODULE_PARM_DESC(acp_calibrate, "Measure ACP and direct paths when inserting the module (default 1)");
+
+#define ACP_CAL_MIN_SIZE (4*1024)
+#define ACP_CAL_SIZES 10 //4kB to 2MB (limited to half of the buffer)
+#define ACP_CAL_REPS 4   //measures of each size (the mean is used)
+
+//Transfers smaller than acp_crossover use ACP when use_acp=2. By default
+//(no calibration) the L2 size.
+unsigned int acp_crossover = 512*1024;
+unsigned int acp_decisions_acp = 0;    //transfers sent through ACP in auto mode
+unsigned int acp_decisions_direct = 0; //transfers sent to SDRAMC in auto mode
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Mean time in ns to fill size Bytes of the buffer with the CPU and move them
+//with the DMA to the second half of the buffer. Returns 0 if DMA failed.
+static u64 dma_acp_measure(ALT_DMA_CHANNEL_t channel, ALT_DMA_PROGRAM_t* prog_v,
+  ALT_DMA_PROGRAM_t* prog_h, void* buff_v, void* buff_h, size_t buff_size,
+  size_t size)
+{
+  ALT_STATUS_CODE status;
+  ktime_t start;
+  u64 total = 0;
+  int i;
+
+  for (i = 0; i < ACP_CAL_REPS; i++)
+  {
+    start = ktime_get();
+    memset(buff_v, i, size);
+    arm_dma_completion(channel);
+    status = alt_dma_memory_to_memory(channel, prog_v, prog_h,
+      (char*) buff_h + buff_size/2, buff_h, size, dma_irq_ok,
+      (ALT_DMA_EVENT_t) channel);
+    status = wait_dma_transfer(channel, status);
+    if (status != ALT_E_SUCCESS)
+      return 0;
+    total += ktime_to_ns(ktime_sub(ktime_get(), start));
+  }
+  do_div(total, ACP_CAL_REPS);
+  return total;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+//Measure both paths and compute acp_crossover. Called from module init before
+//the char device, the sysfs entries and the dmaengine channels are created,
+//so nobody else can use the channel and program slot given.
+void dma_acp_calibrate(void* non_cached_v, dma_addr_t non_cached_h,
+  void* cached_v, phys_addr_t cached_h, size_t buff_size,
+  ALT_DMA_PROGRAM_t* prog_v, ALT_DMA_PROGRAM_t* prog_h)
+{
+  ALT_DMA_CHANNEL_t channel = ALT_DMA_CHANNEL_0;
+  size_t sizes[ACP_CAL_SIZES];
+  u64 t_acp[ACP_CAL_SIZES];
+  u64 t_direct[ACP_CAL_SIZES];
+  unsigned int crossover = 0xFFFFFFFF;
+  size_t size;
+  int n = 0;
+  int i;
+
+  if (!acp_calibrate)
+    return;
+  if (alt_dma_channel_alloc(channel) != ALT_E_SUCCESS)
+  {
+    printk(KERN_INFO "DMA LKM: ACP calibration could not allocate channel\n");
+    return;
+  }
+
+  for (size = ACP_CAL_MIN_SIZE; (size <= buff_size/2) && (n < ACP_CAL_SIZES);
+    size *= 2)
+  {
+    sizes[n] = size;
+    t_acp[n] = dma_acp_measure(channel, prog_v, prog_h, cached_v,
+      (char*) cached_h + 0x80000000, buff_size, size);
+    t_direct[n] = dma_acp_measure(channel, prog_v, prog_h, non_cached_v,
+      (void*) non_cached_h, buff_size, size);
+    if ((t_acp[n] == 0) || (t_direct[n] == 0))
+    {
+      printk(KERN_INFO "DMA LKM: ACP calibration failed for %u Bytes\n",
+        (unsigned int) size);
+      alt_dma_channel_free(channel);
+      return;
+    }
+    printk(KERN_INFO "DMA LKM: ACP calibration %u Bytes: ACP %llu ns, direct %llu ns\n",
+      (unsigned int) size, t_acp[n], t_direct[n]);
+    n++;
+  }
+  alt_dma_channel_free(channel);
+
+  //smallest size from which the direct path is always faster
+  for (i = n - 1; i >= 0; i--)
+  {
+    if (t_direct[i] >= t_acp[i])
+      break;
+    crossover = sizes[i];
+  }
+  acp_crossover = crossover;
+  printk(KERN_INFO "DMA LKM: ACP crossover in %u Bytes\n", acp_crossover);
+}
+
+//Path for a transfer of len Bytes in auto mode. Returns 1 for ACP.
+int dma_acp_auto(size_t len)
+{
+  return (len < acp_crossover) ? 1 : 0;
+}
+
+//Count a decision taken in auto mode
+void dma_acp_count(int acp)
+{
+  if (acp)
+    acp_decisions_acp++;
+  else
+    acp_decisions_direct++;
+}
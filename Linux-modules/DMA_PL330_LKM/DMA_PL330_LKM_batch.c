@@ -0,0 +1,348 @@
+/**
+ * @file    DMA_PL330_LKM_batch.c
+ * @brief  Vectored transfers: readv()/writev() and ioctl DMA_PL330_IOC_XFER_BATCH.
+ *
+ * Moving many small records (tens of Bytes to some kB) with one read(),
+ * write() or ioctl(DMA_PL330_IOC_XFER) per record pays in each call the
+ * preparation of the program, the start of the channel and the wait for the
+ * end of the transfer. Here all the records of one call are moved with one
+ * program:
+ * -ioctl(DMA_PL330_IOC_XFER_BATCH) receives an array of struct dma_pl330_xfer.
+ *  The program has one segment per descriptor (descriptors contiguous in the
+ *  staging buffer and in the FPGA are merged in one segment), one after
+ *  another and ending in a single DMAEND. If the program buffer gets full the
+ *  program is executed and a new one is started.
+ * -writev() gathers the records of the iovec in the staging buffer of the file
+ *  and moves them to consecutive FPGA addresses (from fpga_addr of the file)
+ *  with one transfer. readv() does the opposite. In kernel 3.10 they are
+ *  implemented with aio_write and aio_read of the file operations.
+*/
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/aio.h>
+#include <linux/uio.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Finish the program, execute it and wait for it. A new empty program is left.
+static int dma_batch_run(struct dma_batch *b)
+{
+  struct dma_client *client = b->client;
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  if (b->segments == 0)
+    return 0;
+
+  arm_dma_completion(client->channel);
+  t = dma_stats_start();
+  status = alt_dma_memory_to_memory_finish(client->channel, client->prog_wr_v,
+    client->prog_wr_h, dma_irq_ok, (ALT_DMA_EVENT_t) client->channel);
+  dma_stats_end(DMA_STAGE_EXEC, b->size, t);
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, b->size, t);
+
+  alt_dma_program_init(client->prog_wr_v);
+  b->segments = 0;
+  b->size = 0;
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+  return 0;
+}
+
+//Append the segment being built to the program with the burst profile of its
+//addresses. If the program is full it is executed first. Merged segments
+//longer than one program (see dma_burst_max_len()) are appended in pieces.
+static int dma_batch_flush(struct dma_batch *b)
+{
+  ALT_DMA_BURST_t burst;
+  ALT_STATUS_CODE status;
+  uint32_t n;
+  int ret;
+  u32 t;
+
+  if (b->len == 0)
+    return 0;
+
+  dma_burst_select(b->client, b->dst, b->src, &burst);
+  while (b->len > 0)
+  {
+    n = min_t(size_t, b->len, dma_burst_max_len(&burst));
+    t = dma_stats_start();
+    status = alt_dma_memory_to_memory_append_burst(b->client->prog_wr_v,
+      b->dst, b->src, n, &burst);
+    dma_stats_end(DMA_STAGE_PREPARE, n, t);
+    if ((status == ALT_E_BUF_OVF) && (b->segments > 0))
+    {
+      ret = dma_batch_run(b);
+      if (ret != 0)
+        return ret;
+      t = dma_stats_start();
+      status = alt_dma_memory_to_memory_append_burst(b->client->prog_wr_v,
+        b->dst, b->src, n, &burst);
+      dma_stats_end(DMA_STAGE_PREPARE, n, t);
+    }
+    if (status != ALT_E_SUCCESS)
+    {
+      printk(KERN_INFO "DMA LKM: could not add segment of %u Bytes to batch\n",
+        n);
+      return -EIO;
+    }
+
+    b->segments++;
+    b->size += n;
+    b->dst += n;
+    b->src += n;
+    b->len -= n;
+  }
+  return 0;
+}
+
+//Copy len Bytes between buff and the iovec of the application, skipping the
+//first skip Bytes of the iovec. Returns the Bytes not copied.
+static unsigned long dma_batch_copy_iov(void* buff, const struct iovec *iov,
+  unsigned long nr_segs, size_t skip, size_t len, int to_user)
+{
+  unsigned long i;
+  size_t n;
+  unsigned long left;
+
+  for (i = 0; (i < nr_segs) && (len > 0); i++)
+  {
+    if (skip >= iov[i].iov_len)
+    {
+      skip -= iov[i].iov_len;
+      continue;
+    }
+    n = min(len, iov[i].iov_len - skip);
+    if (to_user)
+      left = copy_to_user((char*) iov[i].iov_base + skip, buff, n);
+    else
+      left = copy_from_user(buff, (char*) iov[i].iov_base + skip, n);
+    if (left != 0)
+      return left + len - n;
+    buff = (char*) buff + n;
+    len -= n;
+    skip = 0;
+  }
+  return len;
+}
+
+//Vectored read or write. The records are gathered in (or scattered from) the
+//buffer of the file, which is moved with one transfer per buffer size.
+static ssize_t dma_batch_rw_iov(struct dma_client *client,
+  const struct iovec *iov, unsigned long nr_segs, int dir)
+{
+  size_t total = iov_length(iov, nr_segs);
+  size_t done = 0;
+  size_t n;
+  void* buff_v;
+  void* buff_h;
+  char* fpga_h;
+  uint32_t fpga_padd;
+  ALT_STATUS_CODE status;
+  unsigned long left = 0;
+  u32 t;
+
+  if (mock_dma)
+    return -ENODEV;
+  if (dma_capture_busy(client))
+    return -EBUSY;
+  if (total == 0)
+    return 0;
+
+  mutex_lock(&client->lock);
+  if (client_fpga_addr(client, 0, total, &fpga_padd) != 0)
+  {
+    mutex_unlock(&client->lock);
+    return -EINVAL;
+  }
+  dma_nb_finish(client);
+  buff_v = client_buff_v(client, total);
+  buff_h = client_buff_h(client, total);
+  client_acp_count(client, total);
+  while (done < total)
+  {
+    n = min(total - done, (size_t) sub_buff_size);
+    fpga_h = (char*) fpga_padd + done;
+
+    if (dir == DMA_PL330_DIR_TO_FPGA)
+    {
+      t = dma_stats_start();
+      left = dma_batch_copy_iov(buff_v, iov, nr_segs, done, n, 0);
+      dma_stats_end(DMA_STAGE_COPY, n, t);
+      if (left != 0)
+        break;
+    }
+
+    arm_dma_completion(client->channel);
+    if (dir == DMA_PL330_DIR_TO_FPGA)
+      status = dma_prog_cache_exec(client, client->prog_wr_v,
+        client->prog_wr_h, fpga_h, buff_h, n);
+    else
+      status = dma_prog_cache_exec(client, client->prog_rd_v,
+        client->prog_rd_h, buff_h, fpga_h, n);
+    t = dma_stats_start();
+    status = wait_dma_transfer(client->channel, status);
+    dma_stats_end(DMA_STAGE_WAIT, n, t);
+    dma_prog_cache_done(client);
+    if (status != ALT_E_SUCCESS)
+    {
+      mutex_unlock(&client->lock);
+      return -EIO;
+    }
+
+    if (dir == DMA_PL330_DIR_FROM_FPGA)
+    {
+      t = dma_stats_start();
+      left = dma_batch_copy_iov(buff_v, iov, nr_segs, done, n, 1);
+      dma_stats_end(DMA_STAGE_COPY, n, t);
+      if (left != 0)
+        break;
+    }
+    done += n;
+  }
+  mutex_unlock(&client->lock);
+
+  if (left != 0)
+  {
+    printk(KERN_INFO "DMA LKM: Failed to copy %lu characters in vectored transfer\n", left);
+    return -EFAULT;
+  }
+  return total;
+}
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+//Start a batch in the write program of the client
+void dma_batch_begin(struct dma_batch *b, struct dma_client *client)
+{
+  b->client = client;
+  b->segments = 0;
+  b->size = 0;
+  b->len = 0;
+  alt_dma_program_init(client->prog_wr_v);
+  client->prog_prepared = false; //the slot of the channel is overwritten
+}
+
+//Add a descriptor to the batch. It is merged with the previous one if both
+//are contiguous in source and destiny.
+int dma_batch_add(struct dma_batch *b, void* dst, void* src,
+  uint32_t len)
+{
+  int ret;
+
+  if ((b->len > 0) && ((char*) dst == b->dst + b->len) &&
+    ((char*) src == b->src + b->len) && (b->len + len > b->len))
+  {
+    b->len += len;
+    return 0;
+  }
+  ret = dma_batch_flush(b);
+  if (ret != 0)
+    return ret;
+  b->dst = dst;
+  b->src = src;
+  b->len = len;
+  return 0;
+}
+
+//Execute the descriptors of the batch not executed yet and wait for them
+int dma_batch_end(struct dma_batch *b)
+{
+  int ret;
+
+  ret = dma_batch_flush(b);
+  if (ret == 0)
+    ret = dma_batch_run(b);
+  return ret;
+}
+
+long dma_batch_xfer(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_batch batch;
+  struct dma_pl330_xfer *xfers;
+  struct dma_batch b;
+  void* buff_v;
+  void* buff_h;
+  uint32_t fpga_padd;
+  long ret = 0;
+  __u32 i;
+
+  if (mock_dma)
+    return -ENODEV;
+
+  if (copy_from_user(&batch, (void*) arg, sizeof(batch)) != 0)
+    return -EFAULT;
+  if ((batch.count == 0) || (batch.count > DMA_PL330_BATCH_MAX))
+    return -EINVAL;
+
+  xfers = kmalloc(batch.count * sizeof(*xfers), GFP_KERNEL);
+  if (xfers == NULL)
+    return -ENOMEM;
+  if (copy_from_user(xfers, (void*)(unsigned long) batch.xfers,
+    batch.count * sizeof(*xfers)) != 0)
+  {
+    kfree(xfers);
+    return -EFAULT;
+  }
+  //check all the descriptors before moving anything
+  for (i = 0; i < batch.count; i++)
+  {
+    if ((client_offset_to_buff(client, xfers[i].offset, xfers[i].len,
+      &buff_v, &buff_h) != 0) || ((xfers[i].dir != DMA_PL330_DIR_TO_FPGA) &&
+      (xfers[i].dir != DMA_PL330_DIR_FROM_FPGA)))
+    {
+      kfree(xfers);
+      return -EINVAL;
+    }
+  }
+
+  mutex_lock(&client->lock);
+  //the FPGA addresses use the fpga_addr of the file, read with the lock
+  for (i = 0; i < batch.count; i++)
+  {
+    if (client_fpga_addr(client, xfers[i].fpga_addr, xfers[i].len,
+      &fpga_padd) != 0)
+    {
+      mutex_unlock(&client->lock);
+      kfree(xfers);
+      return -EINVAL;
+    }
+  }
+  dma_batch_begin(&b, client);
+  for (i = 0; (i < batch.count) && (ret == 0); i++)
+  {
+    client_offset_to_buff(client, xfers[i].offset, xfers[i].len, &buff_v,
+      &buff_h);
+    client_fpga_addr(client, xfers[i].fpga_addr, xfers[i].len, &fpga_padd);
+    if (xfers[i].dir == DMA_PL330_DIR_TO_FPGA)
+      ret = dma_batch_add(&b, (void*) fpga_padd, buff_h, xfers[i].len);
+    else
+      ret = dma_batch_add(&b, buff_h, (void*) fpga_padd, xfers[i].len);
+  }
+  if (ret == 0)
+    ret = dma_batch_end(&b);
+  mutex_unlock(&client->lock);
+
+  kfree(xfers);
+  return ret;
+}
+
+ssize_t dma_batch_aio_write(struct kiocb *iocb, const struct iovec *iov,
+  unsigned long nr_segs, loff_t pos)
+{
+  return dma_batch_rw_iov(iocb->ki_filp->private_data, iov, nr_segs,
+    DMA_PL330_DIR_TO_FPGA);
+}
+
+ssize_t dma_batch_aio_read(struct kiocb *iocb, const struct iovec *iov,
+  unsigned long nr_segs, loff_t pos)
+{
+  return dma_batch_rw_iov(iocb->ki_filp->private_data, iov, nr_segs,
+    DMA_PL330_DIR_FROM_FPGA);
+}
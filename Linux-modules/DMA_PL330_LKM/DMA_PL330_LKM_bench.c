@@ -0,0 +1,366 @@
+/**
+ * @file    DMA_PL330_LKM_bench.c
+ * @brief  Comparison of CPU memcpy(), NEON copy and DMA for each pair of
+ * memories, exported in sysfs (/sys/dma_pl330/pl330_lkm_attrs/bench).
+ *
+ * Writing "src dst" to the bench entry measures the copy from src to dst
+ * for sizes from 4B to 2MB (powers of 2) with:
+ * -memcpy: memcpy() of the kernel. ocr and fpga are mapped with ioremap()
+ *  (Device memory, where memcpy() may do unaligned or multiple accesses that
+ *  fault or tear), so pairs with them use memcpy_toio(), memcpy_fromio() or
+ *  a loop of 32-bit accesses if both are, and the method is called
+ *  memcpy_io.
+ * -neon: loop of vld1/vst1 of 64 Bytes, only between coherent and cached
+ *  (normal memory). Only built with CONFIG_KERNEL_MODE_NEON, that appears in
+ *  kernel 3.11, so it is always empty in the 3.10 kernel of the board.
+ * -dma: alt_dma_memory_to_memory() (preparation of the microcode, start of
+ *  the channel and wait for the end, as in read() and write()).
+ * The memories are:
+ * -ocr: HPS On-Chip RAM (the part used to cache programs, 48kB).
+ * -coherent: uncached buffer (dma_alloc_coherent), accessed by the DMA through
+ *  the L3-to-SDRAMC port.
+ * -cached: cached buffer (kmalloc), accessed by the DMA through ACP.
+ * -fpga: dma_buff_padd through the HPS-to-FPGA bridge (bench_fpga_size Bytes).
+ * When src and dst are the same memory the first half is copied to the second
+ * half. Sizes bigger than the memories are not measured.
+ *
+ * Reading the bench entry prints the mean time in ns of each method and size
+ * and the crossover: the smallest size from which the DMA is always faster
+ * than the best CPU copy.
+ *
+ * The measure needs all the channels (the buffers and the program cache are
+ * overwritten), so it returns -EBUSY if a file or a dmaengine client is
+ * using a channel.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <asm/io.h>
+#include <asm/div64.h>
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#endif
+
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR THE BENCHMARK--------------------//
+static unsigned int bench_fpga_size = 64*1024;
+module_param(bench_fpga_size, uint, 0644);
+MODULE_PARM_DESC(bench_fpga_size, "Bytes of FPGA memory in dma_buff_padd used by the benchmark (default 64kB)");
+
+#define BENCH_MIN_SIZE 4
+#define BENCH_SIZES 20 //4B to 2MB
+#define BENCH_REPS 16  //copies of each size (the mean is used)
+
+#define BENCH_MEMCPY 0
+#define BENCH_NEON   1
+#define BENCH_DMA    2
+#define BENCH_METHODS 3
+static const char* bench_method_names[BENCH_METHODS] =
+  {"memcpy", "neon", "dma"};
+#define BENCH_MEMCPY_IO_NAME "memcpy_io" //name of memcpy with ocr or fpga
+
+#define BENCH_OCR      0
+#define BENCH_COHERENT 1
+#define BENCH_CACHED   2
+#define BENCH_FPGA     3
+#define BENCH_MEMS     4
+static const char* bench_mem_names[BENCH_MEMS] =
+  {"ocr", "coherent", "cached", "fpga"};
+
+struct bench_mem {
+  void* v;     //virtual address for the CPU
+  void* h;     //hardware address for the DMA
+  size_t size;
+  bool io;     //mapped with ioremap(): Device memory
+};
+
+//Memories given in dma_bench_init(). The FPGA is mapped in each measure.
+static struct bench_mem bench_mems[BENCH_MEMS];
+static ALT_DMA_PROGRAM_t* bench_prog_v;
+static ALT_DMA_PROGRAM_t* bench_prog_h;
+
+//Result of the last measure (-1 if none). A time of 0 is not measured.
+static int bench_src = -1;
+static int bench_dst = -1;
+static u64 bench_ns[BENCH_METHODS][BENCH_SIZES];
+static DEFINE_MUTEX(bench_mutex);
+
+//-------------------------------FUNCTIONS-------------------------------//
+//CPU copy when src or dst is Device memory. Sizes and addresses of the
+//benchmark are multiple of 4.
+static void bench_io_copy(struct bench_mem *dst, struct bench_mem *src,
+  size_t size)
+{
+  size_t i;
+
+  if (!src->io)
+    memcpy_toio((void __iomem*) dst->v, src->v, size);
+  else if (!dst->io)
+    memcpy_fromio(dst->v, (const void __iomem*) src->v, size);
+  else
+    for (i = 0; i < size; i += 4)
+      writel_relaxed(readl_relaxed((char __iomem*) src->v + i),
+        (char __iomem*) dst->v + i);
+}
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+//Copy with the NEON registers in blocks of 64 Bytes
+static void bench_neon_copy(void* dst, const void* src, size_t size)
+{
+  size_t blocks = size / 64;
+
+  if (blocks > 0)
+  {
+    asm volatile(
+      "1: vld1.8 {d0-d7}, [%1]!\n"
+      "   vst1.8 {d0-d7}, [%0]!\n"
+      "   subs %2, %2, #1\n"
+      "   bne 1b\n"
+      : "+r" (dst), "+r" (src), "+r" (blocks)
+      :
+      : "d0", "d1", "d2", "d3", "d4", "d5", "d6", "d7", "cc", "memory");
+  }
+  memcpy(dst, src, size % 64);
+}
+#endif
+
+//Mean time in ns to copy size Bytes from src to dst with method. Returns 0
+//if the method is not available or the DMA failed.
+static u64 bench_measure(int method, struct bench_mem *dst,
+  struct bench_mem *src, size_t size)
+{
+  ALT_STATUS_CODE status;
+  ktime_t start;
+  u64 total;
+  int i;
+
+  //NEON is only used with normal memory
+  if ((method == BENCH_NEON) && (dst->io || src->io))
+    return 0;
+
+  start = ktime_get();
+  if ((method == BENCH_MEMCPY) && (dst->io || src->io))
+  {
+    for (i = 0; i < BENCH_REPS; i++)
+      bench_io_copy(dst, src, size);
+  }
+  else if (method == BENCH_MEMCPY)
+  {
+    for (i = 0; i < BENCH_REPS; i++)
+      memcpy(dst->v, src->v, size);
+  }
+  else if (method == BENCH_NEON)
+  {
+#ifdef CONFIG_KERNEL_MODE_NEON
+    kernel_neon_begin();
+    for (i = 0; i < BENCH_REPS; i++)
+      bench_neon_copy(dst->v, src->v, size);
+    kernel_neon_end();
+#else
+    return 0;
+#endif
+  }
+  else
+  {
+    for (i = 0; i < BENCH_REPS; i++)
+    {
+      arm_dma_completion(ALT_DMA_CHANNEL_0);
+      status = alt_dma_memory_to_memory(ALT_DMA_CHANNEL_0, bench_prog_v,
+        bench_prog_h, dst->h, src->h, size, dma_irq_ok,
+        (ALT_DMA_EVENT_t) ALT_DMA_CHANNEL_0);
+      status = wait_dma_transfer(ALT_DMA_CHANNEL_0, status);
+      if (status != ALT_E_SUCCESS)
+        return 0;
+    }
+  }
+  total = ktime_to_ns(ktime_sub(ktime_get(), start));
+  do_div(total, BENCH_REPS);
+  return total;
+}
+
+//Measure all the sizes of the pair src->dst. Called with all the channels
+//reserved.
+static void bench_run(int src, int dst)
+{
+  struct bench_mem s = bench_mems[src];
+  struct bench_mem d = bench_mems[dst];
+  size_t size;
+  int method;
+  int n;
+
+  //same memory: from the first half to the second half
+  if (src == dst)
+  {
+    s.size /= 2;
+    d.size /= 2;
+    d.v = (char*) d.v + d.size;
+    d.h = (char*) d.h + d.size;
+  }
+
+  memset(bench_ns, 0, sizeof(bench_ns));
+  for (n = 0, size = BENCH_MIN_SIZE; n < BENCH_SIZES; n++, size *= 2)
+  {
+    if ((size > s.size) || (size > d.size))
+      break;
+    for (method = 0; method < BENCH_METHODS; method++)
+      bench_ns[method][n] = bench_measure(method, &d, &s, size);
+  }
+  bench_src = src;
+  bench_dst = dst;
+}
+
+//Index of a memory from its name or -1
+static int bench_mem_index(const char* name)
+{
+  int i;
+
+  for (i = 0; i < BENCH_MEMS; i++)
+    if (strcmp(name, bench_mem_names[i]) == 0)
+      return i;
+  return -1;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+//Save the memories used in the benchmark. Called from module init.
+void dma_bench_init(void* ocr_v, void* ocr_h, size_t ocr_size,
+  void* non_cached_v, dma_addr_t non_cached_h, void* cached_v,
+  phys_addr_t cached_h, size_t buff_size, ALT_DMA_PROGRAM_t* prog_v,
+  ALT_DMA_PROGRAM_t* prog_h)
+{
+  bench_mems[BENCH_OCR].v = ocr_v;
+  bench_mems[BENCH_OCR].h = ocr_h;
+  bench_mems[BENCH_OCR].size = ocr_size;
+  bench_mems[BENCH_OCR].io = true;
+  bench_mems[BENCH_COHERENT].v = non_cached_v;
+  bench_mems[BENCH_COHERENT].h = (void*) non_cached_h;
+  bench_mems[BENCH_COHERENT].size = buff_size;
+  bench_mems[BENCH_CACHED].v = cached_v;
+  bench_mems[BENCH_CACHED].h = (char*) cached_h + 0x80000000;//use acp
+  bench_mems[BENCH_CACHED].size = buff_size;
+  bench_prog_v = prog_v;
+  bench_prog_h = prog_h;
+}
+
+//Write to the sysfs entry: measure the pair "src dst"
+ssize_t dma_bench_store(const char *buf, size_t count)
+{
+  char src_name[16];
+  char dst_name[16];
+  int src;
+  int dst;
+  int ret;
+
+  if (mock_dma)
+    return -ENODEV;
+  if (sscanf(buf, "%15s %15s", src_name, dst_name) != 2)
+    return -EINVAL;
+  src = bench_mem_index(src_name);
+  dst = bench_mem_index(dst_name);
+  if ((src < 0) || (dst < 0))
+    return -EINVAL;
+
+  mutex_lock(&bench_mutex);
+  ret = dma_channel_reserve_all();
+  if (ret != 0)
+  {
+    mutex_unlock(&bench_mutex);
+    return ret;
+  }
+  //no channel is executing cached programs: the cache can be overwritten
+  dma_prog_cache_flush();
+
+  //the FPGA is only mapped (and accessed) if it is used
+  if ((src == BENCH_FPGA) || (dst == BENCH_FPGA))
+  {
+    bench_mems[BENCH_FPGA].h = dma_buff_padd;
+    bench_mems[BENCH_FPGA].size = bench_fpga_size;
+    bench_mems[BENCH_FPGA].io = true;
+    bench_mems[BENCH_FPGA].v = ioremap((unsigned long) dma_buff_padd,
+      bench_fpga_size);
+    if (bench_mems[BENCH_FPGA].v == NULL)
+    {
+      ret = -ENOMEM;
+      printk(KERN_INFO "DMA LKM: benchmark could not ioremap the FPGA\n");
+    }
+  }
+  if (ret == 0)
+    bench_run(src, dst);
+  if (bench_mems[BENCH_FPGA].v != NULL)
+  {
+    iounmap(bench_mems[BENCH_FPGA].v);
+    bench_mems[BENCH_FPGA].v = NULL;
+  }
+
+  dma_channel_release_all();
+  mutex_unlock(&bench_mutex);
+  if (ret != 0)
+    return ret;
+  return count;
+}
+
+//Read of the sysfs entry: table of the last measure
+ssize_t dma_bench_show(char *buf)
+{
+  unsigned int crossover = 0;
+  bool io;
+  u64 cpu;
+  size_t size;
+  int len;
+  int n;
+  int method;
+
+  mutex_lock(&bench_mutex);
+  if (bench_src < 0)
+  {
+    mutex_unlock(&bench_mutex);
+    return sprintf(buf, "write \"src dst\" (ocr, coherent, cached, fpga)\n");
+  }
+
+  io = bench_mems[bench_src].io || bench_mems[bench_dst].io;
+  len = sprintf(buf, "%s -> %s (ns)\n%8s", bench_mem_names[bench_src],
+    bench_mem_names[bench_dst], "size");
+  for (method = 0; method < BENCH_METHODS; method++)
+    len += sprintf(buf + len, " %10s", ((method == BENCH_MEMCPY) && io) ?
+      BENCH_MEMCPY_IO_NAME : bench_method_names[method]);
+  len += sprintf(buf + len, "\n");
+
+  for (n = 0, size = BENCH_MIN_SIZE; n < BENCH_SIZES; n++, size *= 2)
+  {
+    if (bench_ns[BENCH_MEMCPY][n] == 0)
+      break;
+    len += sprintf(buf + len, "%8u", (unsigned int) size);
+    for (method = 0; method < BENCH_METHODS; method++)
+    {
+      if (bench_ns[method][n] == 0)
+        len += sprintf(buf + len, " %10s", "-");
+      else
+        len += sprintf(buf + len, " %10llu", bench_ns[method][n]);
+    }
+    len += sprintf(buf + len, "\n");
+
+    //the crossover is reset each time the DMA is slower
+    cpu = bench_ns[BENCH_MEMCPY][n];
+    if ((bench_ns[BENCH_NEON][n] != 0) && (bench_ns[BENCH_NEON][n] < cpu))
+      cpu = bench_ns[BENCH_NEON][n];
+    if ((bench_ns[BENCH_DMA][n] == 0) || (bench_ns[BENCH_DMA][n] >= cpu))
+      crossover = 0;
+    else if (crossover == 0)
+      crossover = size;
+  }
+  if (crossover != 0)
+    len += sprintf(buf + len, "crossover: %u\n", crossover);
+  else
+    len += sprintf(buf + len, "crossover: none\n");
+#ifndef CONFIG_KERNEL_MODE_NEON
+  len += sprintf(buf + len, "neon: not built (needs CONFIG_KERNEL_MODE_NEON, kernel 3.11 or later)\n");
+#else
+  if (io)
+    len += sprintf(buf + len, "neon: only measured between coherent and cached\n");
+#endif
+  mutex_unlock(&bench_mutex);
+  return len;
+}
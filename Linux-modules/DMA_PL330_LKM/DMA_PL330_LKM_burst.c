@@ -0,0 +1,323 @@
+/**
+ * @file    DMA_PL330_LKM_burst.c
+ * @brief  Burst profiles of the transfers for each address window and tuner
+ * of the profiles, exported in sysfs
+ * (/sys/dma_pl330/pl330_lkm_attrs/burst_profiles).
+ *
+ * alt_dma_memory_to_memory_segment() moved the main part of all the
+ * transfers with bursts of 16 beats of 8 Bytes. The slaves reached by the
+ * DMAC prefer different bursts: the HPS-to-FPGA bridge can be 32, 64 or 128
+ * bits wide, the lightweight bridge is 32 bits wide and FPGA memories may
+ * split or stall long bursts. So the size (Bytes of each beat: 1, 2, 4 or 8)
+ * and length (beats of each burst: 1 to 16) of the bursts are selected for
+ * each transfer with a profile:
+ * -The profile of the file if it is set (burst in struct dma_pl330_config).
+ * -Else the profile of the window of the FPGA end of the transfer (h2f or
+ *  lwh2f). Between memories, the profile of the window of the destiny (sdram,
+ *  acp or the others, that use the sdram profile).
+ * All windows use 16 beats of 8 Bytes when the module is inserted.
+ *
+ * The profiles are used by the programs of read(), write(), ioctl XFER,
+ * XFER_P2P, XFER_USER and XFER_BATCH, readv()/writev(), the ring and the
+ * dmaengine channels (each segment of a batch or scatter-gather program gets
+ * the profile of its own addresses). The fill, the flow-controlled transfers
+ * and the cyclic capture write their own microcode and keep 16 beats of 8
+ * Bytes.
+ *
+ * Writing "window size length" to burst_profiles sets the profile of a window.
+ * Writing "tune window [addr [size]]" measures all the profiles moving size
+ * Bytes (64kB by default) to and from addr and keeps the fastest. addr is
+ * needed for lwh2f, is dma_buff_padd by default for h2f and is not given for
+ * sdram and acp (the second half of the buffers of the driver is used). The
+ * memory in addr is overwritten. The measure needs all the channels, so it
+ * returns -EBUSY if a file or a dmaengine client is using one.
+ *
+ * Reading burst_profiles prints "window size length ns" for each window (ns
+ * is the mean time of a write and a read with the profile in the last tune,
+ * or 0). The lines can be written back to burst_profiles (i.e. in a boot
+ * script) to restore the tuned profiles without tuning again.
+*/
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/string.h>
+#include <linux/mutex.h>
+#include <asm/div64.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//--------------------------VARIABLES OF THE PROFILES--------------------//
+#define DMA_BURST_SDRAM 0 //SDRAM through L3-to-SDRAMC and any other address
+#define DMA_BURST_ACP   1 //SDRAM through ACP
+#define DMA_BURST_H2F   2 //HPS-to-FPGA bridge
+#define DMA_BURST_LWH2F 3 //lightweight HPS-to-FPGA bridge
+#define DMA_BURST_WINDOWS 4
+
+//Blocks of the program of alt_dma_memory_to_memory_segment() that always
+//fit in ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE (512 Bytes) with any
+//alignment. Each block (about 10 Bytes) moves up to 65536 bursts.
+#define DMA_BURST_PROG_BLOCKS 32
+
+#define BURST_TUNE_SIZE (64*1024) //Bytes moved in each measure by default
+#define BURST_TUNE_REPS 8         //measures of each profile (the mean is used)
+
+struct dma_burst_window {
+  const char* name;
+  uint32_t start;
+  uint32_t size;
+  ALT_DMA_BURST_t burst;
+  u64 tuned_ns; //time of the profile in the last tune (0 if not tuned)
+};
+
+static struct dma_burst_window burst_windows[DMA_BURST_WINDOWS] = {
+  {"sdram", 0x00000000, 0x80000000, {8, 16}, 0},
+  {"acp",   0x80000000, 0x40000000, {8, 16}, 0},
+  {"h2f",   0xC0000000, 0x3C000000, {8, 16}, 0},
+  {"lwh2f", 0xFF200000, 0x00200000, {8, 16}, 0},
+};
+
+//Buffers and program given in dma_burst_init() for the tuner
+static void* burst_non_cached_h;
+static void* burst_cached_h;
+static size_t burst_buff_size;
+static ALT_DMA_PROGRAM_t* burst_prog_v;
+static ALT_DMA_PROGRAM_t* burst_prog_h;
+static DEFINE_MUTEX(burst_mutex);
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Window of an address (DMA_BURST_SDRAM if it is in no window)
+static int dma_burst_window(uint32_t addr)
+{
+  int i;
+
+  for (i = DMA_BURST_WINDOWS - 1; i > DMA_BURST_SDRAM; i--)
+  {
+    if ((addr >= burst_windows[i].start) &&
+      (addr - burst_windows[i].start < burst_windows[i].size))
+      return i;
+  }
+  return DMA_BURST_SDRAM;
+}
+
+//Index of a window from its name or -1
+static int dma_burst_window_index(const char* name)
+{
+  int i;
+
+  for (i = 0; i < DMA_BURST_WINDOWS; i++)
+    if (strcmp(name, burst_windows[i].name) == 0)
+      return i;
+  return -1;
+}
+
+static bool dma_burst_valid(uint32_t size, uint32_t length)
+{
+  return ((size == 1) || (size == 2) || (size == 4) || (size == 8)) &&
+    (length >= 1) && (length <= 16);
+}
+
+//Move size Bytes from src to dst with burst in channel 0 and wait. Returns
+//the time in ns or 0 if the DMA failed.
+static u64 dma_burst_measure(void* dst, void* src, size_t size,
+  ALT_DMA_BURST_t* burst)
+{
+  ALT_STATUS_CODE status;
+  ktime_t start = ktime_get();
+
+  arm_dma_completion(ALT_DMA_CHANNEL_0);
+  status = alt_dma_memory_to_memory_only_prepare_program_burst(
+    ALT_DMA_CHANNEL_0, burst_prog_v, burst_prog_h, dst, src, size,
+    dma_irq_ok, (ALT_DMA_EVENT_t) ALT_DMA_CHANNEL_0, burst);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_channel_exec(ALT_DMA_CHANNEL_0, burst_prog_h);
+  status = wait_dma_transfer(ALT_DMA_CHANNEL_0, status);
+  if (status != ALT_E_SUCCESS)
+    return 0;
+  return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+//Measure all the profiles writing and reading size Bytes in target (with
+//data from the uncached buffer) and keep the fastest in window w. Called
+//with all the channels reserved.
+static int dma_burst_tune(int w, void* target, size_t size)
+{
+  ALT_DMA_BURST_t burst;
+  ALT_DMA_BURST_t best = burst_windows[w].burst;
+  u64 best_ns = 0;
+  u64 total;
+  u64 t_wr;
+  u64 t_rd;
+  int i;
+
+  for (burst.size = 1; burst.size <= 8; burst.size *= 2)
+  {
+    for (burst.length = 1; burst.length <= 16; burst.length++)
+    {
+      total = 0;
+      for (i = 0; i < BURST_TUNE_REPS; i++)
+      {
+        t_wr = dma_burst_measure(target, burst_non_cached_h, size, &burst);
+        t_rd = dma_burst_measure(burst_non_cached_h, target, size, &burst);
+        if ((t_wr == 0) || (t_rd == 0))
+        {
+          printk(KERN_INFO "DMA LKM: burst tune of %s failed\n",
+            burst_windows[w].name);
+          return -EIO;
+        }
+        total += t_wr + t_rd;
+      }
+      do_div(total, 2*BURST_TUNE_REPS);
+      if ((best_ns == 0) || (total < best_ns))
+      {
+        best_ns = total;
+        best = burst;
+      }
+    }
+  }
+
+  burst_windows[w].burst = best;
+  burst_windows[w].tuned_ns = best_ns;
+  printk(KERN_INFO "DMA LKM: burst tune of %s: %u x %u Bytes, %llu ns for %u Bytes\n",
+    burst_windows[w].name, best.length, best.size, best_ns,
+    (unsigned int) size);
+  return 0;
+}
+
+//Write of "tune window [addr [size]]"
+static int dma_burst_tune_store(const char *buf)
+{
+  char name[16];
+  uint32_t addr = 0;
+  uint32_t size = BURST_TUNE_SIZE;
+  void* target;
+  int w;
+  int ret;
+
+  if (mock_dma)
+    return -ENODEV;
+  if (sscanf(buf, "tune %15s %x %u", name, &addr, &size) < 1)
+    return -EINVAL;
+  w = dma_burst_window_index(name);
+  if (w < 0)
+    return -EINVAL;
+
+  //the target in SDRAM is always the second half of a buffer of the driver
+  if ((w == DMA_BURST_SDRAM) || (w == DMA_BURST_ACP))
+  {
+    if (addr != 0)
+      return -EINVAL;
+    addr = (uint32_t) ((w == DMA_BURST_SDRAM) ? burst_non_cached_h :
+      burst_cached_h) + burst_buff_size/2;
+  }
+  else if ((addr == 0) && (w == DMA_BURST_H2F))
+    addr = (uint32_t) dma_buff_padd;
+  if ((size == 0) || (size > burst_buff_size/2) ||
+    (dma_burst_window(addr) != w) ||
+    (size > burst_windows[w].size - (addr - burst_windows[w].start)))
+    return -EINVAL;
+  target = (void*) addr;
+
+  mutex_lock(&burst_mutex);
+  ret = dma_channel_reserve_all();
+  if (ret == 0)
+  {
+    ret = dma_burst_tune(w, target, size);
+    dma_channel_release_all();
+  }
+  mutex_unlock(&burst_mutex);
+  return ret;
+}
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+//Save the buffers and program used by the tuner. Called from module init.
+void dma_burst_init(dma_addr_t non_cached_h, phys_addr_t cached_h,
+  size_t buff_size, ALT_DMA_PROGRAM_t* prog_v, ALT_DMA_PROGRAM_t* prog_h)
+{
+  burst_non_cached_h = (void*) non_cached_h;
+  burst_cached_h = (char*) cached_h + 0x80000000;//use acp
+  burst_buff_size = buff_size;
+  burst_prog_v = prog_v;
+  burst_prog_h = prog_h;
+}
+
+//Profile of a transfer from src to dst in the channel of the client
+void dma_burst_select(struct dma_client *client, const void* dst,
+  const void* src, ALT_DMA_BURST_t* burst)
+{
+  int w;
+
+  if (client->burst != 0)
+  {
+    burst->size = DMA_PL330_BURST_SIZE(client->burst);
+    burst->length = DMA_PL330_BURST_LENGTH(client->burst);
+    return;
+  }
+
+  w = dma_burst_window((uint32_t) dst);
+  if ((w != DMA_BURST_H2F) && (w != DMA_BURST_LWH2F))
+  {
+    int w_src = dma_burst_window((uint32_t) src);
+    if ((w_src == DMA_BURST_H2F) || (w_src == DMA_BURST_LWH2F))
+      w = w_src;
+  }
+  *burst = burst_windows[w].burst;
+}
+
+//Largest transfer moved with one program with burst: 256MB with 16 beats of
+//8 Bytes, 2MB with 1 beat of 1 Byte
+size_t dma_burst_max_len(const ALT_DMA_BURST_t* burst)
+{
+  return (size_t) DMA_BURST_PROG_BLOCKS * 65536 * burst->size * burst->length;
+}
+
+//Check a profile given with ioctl(DMA_PL330_IOC_SET_CONFIG) (0 is valid)
+bool dma_burst_config_valid(uint32_t burst)
+{
+  return (burst == 0) || dma_burst_valid(DMA_PL330_BURST_SIZE(burst),
+    DMA_PL330_BURST_LENGTH(burst));
+}
+
+//Write to the sysfs entry: "window size length" or "tune window [addr [size]]"
+ssize_t dma_burst_store(const char *buf, size_t count)
+{
+  char name[16];
+  uint32_t size;
+  uint32_t length;
+  int w;
+  int ret;
+
+  if (strncmp(buf, "tune ", 5) == 0)
+  {
+    ret = dma_burst_tune_store(buf);
+    if (ret != 0)
+      return ret;
+    return count;
+  }
+
+  if (sscanf(buf, "%15s %u %u", name, &size, &length) != 3)
+    return -EINVAL;
+  w = dma_burst_window_index(name);
+  if ((w < 0) || !dma_burst_valid(size, length))
+    return -EINVAL;
+
+  mutex_lock(&burst_mutex);
+  burst_windows[w].burst.size = size;
+  burst_windows[w].burst.length = length;
+  mutex_unlock(&burst_mutex);
+  return count;
+}
+
+//Read of the sysfs entry: profile of each window
+ssize_t dma_burst_show(char *buf)
+{
+  int len = 0;
+  int i;
+
+  mutex_lock(&burst_mutex);
+  for (i = 0; i < DMA_BURST_WINDOWS; i++)
+    len += sprintf(buf + len, "%s %u %u %llu\n", burst_windows[i].name,
+      burst_windows[i].burst.size, burst_windows[i].burst.length,
+      burst_windows[i].tuned_ns);
+  mutex_unlock(&burst_mutex);
+  return len;
+}
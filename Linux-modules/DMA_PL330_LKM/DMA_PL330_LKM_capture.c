@@ -0,0 +1,318 @@
+/**
+ * @file    DMA_PL330_LKM_capture.c
+ * @brief  Cyclic capture from a fixed FPGA address into a ring of periods
+ * (ioctl DMA_PL330_IOC_CAPTURE_START and DMA_PL330_IOC_CAPTURE_STOP).
+ *
+ * With read() the DMA only moves data while the application is inside the
+ * call, so the samples produced by the FPGA (i.e. an ADC) between two calls
+ * are lost. Here the channel of the file executes one program that never ends:
+ *
+ *   DMAMOV CCR (fixed source, incrementing destiny, bursts of 16x8 Bytes)
+ *   DMAMOV SAR fpga_addr
+ *   forever:
+ *     DMAMOV DAR ring
+ *     DMALP periods
+ *       DMALP bursts of one period
+ *         DMALD, DMAST
+ *       DMALPEND
+ *       DMAWMB, DMASEV (end of the period)
+ *     DMALPEND
+ *   DMALPEND (forever)
+ *
+ * The ring is a part of the staging buffer of the file (selected with a mmap
+ * offset, like in ioctl(DMA_PL330_IOC_XFER)), so the application reads the
+ * samples from the buffer it mapped. Each DMASEV raises the IRQ of the channel,
+ * where the driver reads the destiny address of the channel (DAR) to know
+ * which period is being written and advances head. head counts the periods
+ * completed since the start, so it does not lose periods when two events are
+ * served by one IRQ. head is in a header page mapped with
+ * mmap(DMA_PL330_MMAP_CAPTURE), together with tail, written by the
+ * application with the periods it consumed. poll() reports POLLIN while
+ * head != tail. If head - tail > periods the DMA overwrote periods not read
+ * yet.
+ *
+ * The PL330 has two loop counters and the forever loop does not use any, but
+ * alt_dma_program counts DMALPFE as one of the two loops. The DMALPEND of the
+ * forever loop is assembled here so the two DMALP can be nested in it.
+*/
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//-----------------------------MACROS------------------------------------//
+#define DMA_CAPTURE_CHANNELS 8 //channels (and events) of the PL330
+//Bursts of 16 beats of 8 Bytes (DMA_PL330_CAPTURE_BURST Bytes). The source
+//address is fixed, the destiny increments.
+#define DMA_CAPTURE_CCR (ALT_DMA_CCR_OPT_SB16 | ALT_DMA_CCR_OPT_SS64 | \
+  ALT_DMA_CCR_OPT_SAF | ALT_DMA_CCR_OPT_SP_DEFAULT | ALT_DMA_CCR_OPT_SC_DEFAULT | \
+  ALT_DMA_CCR_OPT_DB16 | ALT_DMA_CCR_OPT_DS64 | ALT_DMA_CCR_OPT_DAI | \
+  ALT_DMA_CCR_OPT_DP_DEFAULT | DMA_CCR_WC_ON)
+
+//------------------VARIABLES FOR ONE CAPTURE----------------------------//
+struct dma_capture {
+  struct dma_pl330_capture_hdr *hdr; //header shared with the application
+  bool running;          //the capture program is running in the channel
+  ALT_DMA_CHANNEL_t channel;
+  uint32_t ring_h;       //hardware address of the ring
+  uint32_t periods;      //periods in the ring
+  uint32_t period_size;  //Bytes per period
+  uint32_t last_pos;     //period being written in the last IRQ
+};
+
+//Capture running in each channel, used by the IRQ handler
+static struct dma_capture *capture_chan[DMA_CAPTURE_CHANNELS];
+static DEFINE_SPINLOCK(capture_lock);
+
+//-------------------------------FUNCTIONS-------------------------------//
+//DMALPEND of a forever loop that starts in start
+static ALT_STATUS_CODE dma_capture_lpend_forever(ALT_DMA_PROGRAM_t *pgm,
+  uint32_t start)
+{
+  uint8_t *buffer;
+  uint32_t jump = pgm->code_size - start;
+
+  if ((pgm->code_size + 2) > ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE)
+    return ALT_E_BUF_OVF;
+  if (jump > 255)
+    return ALT_E_ARG_RANGE;
+
+  buffer = pgm->program + pgm->buffer_start + pgm->code_size;
+  buffer[0] = 0x28; //DMALPEND with nf=0 (loop forever)
+  buffer[1] = (uint8_t) jump;
+  pgm->code_size += 2;
+  return ALT_E_SUCCESS;
+}
+
+//Generate the capture program in pgm (virtual address of the program)
+static ALT_STATUS_CODE dma_capture_program(struct dma_capture *cap,
+  ALT_DMA_PROGRAM_t *pgm, uint32_t fpga_padd)
+{
+  ALT_STATUS_CODE status;
+  uint32_t start = 0;
+
+  status = alt_dma_program_init(pgm);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_CCR,
+      DMA_CAPTURE_CCR);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_SAR, fpga_padd);
+  //start of the forever loop
+  if (status == ALT_E_SUCCESS)
+  {
+    start = pgm->code_size;
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_DAR, cap->ring_h);
+  }
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMALP(pgm, cap->periods);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMALP(pgm,
+      cap->period_size / DMA_PL330_CAPTURE_BURST);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMALD(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAST(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  //end of the period: the data is in memory before the event
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAWMB(pgm);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMASEV(pgm, (ALT_DMA_EVENT_t) cap->channel);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  if (status == ALT_E_SUCCESS)
+    status = dma_capture_lpend_forever(pgm, start);
+  //never reached, ends the program for alt_dma_program_validate()
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAEND(pgm);
+  return status;
+}
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+//Called from the IRQ handler of event evt. Advances head with the periods
+//completed since the last IRQ.
+void dma_capture_irq(ALT_DMA_EVENT_t evt)
+{
+  struct dma_capture *cap;
+  uint32_t dar;
+  uint32_t pos;
+
+  if ((unsigned int) evt >= DMA_CAPTURE_CHANNELS)
+    return;
+
+  spin_lock(&capture_lock);
+  cap = capture_chan[evt];
+  if ((cap != NULL) && (alt_dma_channel_reg_get(cap->channel,
+    ALT_DMA_PROGRAM_REG_DAR, &dar) == ALT_E_SUCCESS))
+  {
+    //DAR is in the period after the last completed one
+    pos = ((dar - cap->ring_h) / cap->period_size) % cap->periods;
+    cap->hdr->head += (pos + cap->periods - cap->last_pos) % cap->periods;
+    cap->last_pos = pos;
+  }
+  spin_unlock(&capture_lock);
+}
+
+long dma_capture_start(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_capture params;
+  struct dma_capture *cap;
+  void* ring_v;
+  void* ring_h;
+  uint32_t fpga_padd;
+  unsigned long flags;
+  ALT_STATUS_CODE status;
+  long ret = 0;
+
+  if (mock_dma)
+    return -ENODEV;
+  //head is advanced by the IRQs of the channel
+  if (!dma_irq_ok)
+    return -ENODEV;
+
+  if (copy_from_user(&params, (void*) arg, sizeof(params)) != 0)
+    return -EFAULT;
+  if ((params.periods < 2) || (params.periods > 256) ||
+    (params.period_size == 0) ||
+    (params.period_size % DMA_PL330_CAPTURE_BURST != 0) ||
+    (params.period_size / DMA_PL330_CAPTURE_BURST > 256))
+    return -EINVAL;
+  if (client_offset_to_buff(client, params.offset,
+    params.periods * params.period_size, &ring_v, &ring_h) != 0)
+    return -EINVAL;
+  //the source address is fixed: one beat of 8 Bytes is read
+  if (client_fpga_addr(client, params.fpga_addr, 8, &fpga_padd) != 0)
+    return -EINVAL;
+  if ((((uint32_t) ring_h) % 8 != 0) || (fpga_padd % 8 != 0))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  dma_nb_finish(client);
+  cap = client->capture;
+  if ((cap != NULL) && cap->running)
+  {
+    ret = -EBUSY;
+    goto out;
+  }
+  //the header is kept until close() because it can be still mapped
+  if (cap == NULL)
+  {
+    cap = kzalloc(sizeof(*cap), GFP_KERNEL);
+    if (cap == NULL)
+    {
+      ret = -ENOMEM;
+      goto out;
+    }
+    cap->hdr = vmalloc_user(PAGE_SIZE);
+    if (cap->hdr == NULL)
+    {
+      kfree(cap);
+      ret = -ENOMEM;
+      goto out;
+    }
+    client->capture = cap;
+  }
+  cap->channel = client->channel;
+  cap->ring_h = (uint32_t) ring_h;
+  cap->periods = params.periods;
+  cap->period_size = params.period_size;
+  cap->last_pos = 0;
+  cap->hdr->head = 0;
+  cap->hdr->tail = 0;
+  cap->hdr->periods = params.periods;
+  cap->hdr->period_size = params.period_size;
+
+  //the program is kept in the read slot of the channel while it runs
+  client->prog_prepared = false;
+  status = dma_capture_program(cap, client->prog_rd_v, fpga_padd);
+  if (status != ALT_E_SUCCESS)
+  {
+    printk(KERN_INFO "DMA LKM: could not generate capture program (%d)\n",
+      (int) status);
+    ret = -EINVAL;
+    goto out;
+  }
+
+  spin_lock_irqsave(&capture_lock, flags);
+  capture_chan[cap->channel] = cap;
+  spin_unlock_irqrestore(&capture_lock, flags);
+  arm_dma_completion(client->channel);
+  if (alt_dma_channel_exec(client->channel, client->prog_rd_h) != ALT_E_SUCCESS)
+  {
+    spin_lock_irqsave(&capture_lock, flags);
+    capture_chan[cap->channel] = NULL;
+    spin_unlock_irqrestore(&capture_lock, flags);
+    ret = -EIO;
+    goto out;
+  }
+  cap->running = true;
+out:
+  mutex_unlock(&client->lock);
+  return ret;
+}
+
+long dma_capture_stop(struct dma_client *client)
+{
+  struct dma_capture *cap = client->capture;
+  unsigned long flags;
+
+  mutex_lock(&client->lock);
+  if ((cap == NULL) || !cap->running)
+  {
+    mutex_unlock(&client->lock);
+    return -EINVAL;
+  }
+  alt_dma_channel_kill(client->channel);
+  spin_lock_irqsave(&capture_lock, flags);
+  capture_chan[cap->channel] = NULL;
+  spin_unlock_irqrestore(&capture_lock, flags);
+  cap->running = false;
+  mutex_unlock(&client->lock);
+  return 0;
+}
+
+//True while the channel of the file is used by the capture
+bool dma_capture_busy(struct dma_client *client)
+{
+  return (client->capture != NULL) && client->capture->running;
+}
+
+unsigned int dma_capture_poll(struct file *filep, poll_table *wait)
+{
+  struct dma_client *client = filep->private_data;
+  struct dma_pl330_capture_hdr *hdr = client->capture->hdr;
+
+  dma_poll_wait(filep, client->channel, wait);
+  if (ACCESS_ONCE(hdr->head) != ACCESS_ONCE(hdr->tail))
+    return POLLIN | POLLRDNORM;
+  return 0;
+}
+
+int dma_capture_mmap(struct dma_client *client, struct vm_area_struct *vma)
+{
+  if (client->capture == NULL)
+    return -EINVAL;
+  if ((vma->vm_end - vma->vm_start) > PAGE_SIZE)
+    return -EINVAL;
+
+  return remap_vmalloc_range(vma, client->capture->hdr, 0);
+}
+
+void dma_capture_release(struct dma_client *client)
+{
+  if (client->capture == NULL)
+    return;
+
+  if (client->capture->running)
+    dma_capture_stop(client);
+  vfree(client->capture->hdr);
+  kfree(client->capture);
+  client->capture = NULL;
+}
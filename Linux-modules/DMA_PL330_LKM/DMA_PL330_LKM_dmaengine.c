@@ -0,0 +1,658 @@
+/**
+ * @file    DMA_PL330_LKM_dmaengine.c
+ * @brief  dmaengine provider so other drivers of the kernel can use the
+ * PL330 without going through /dev/dma_pl330.
+ *
+ * The module registers a dma_device with dmaengine_channels channels and the
+ * capabilities:
+ * -DMA_MEMCPY: copies between two hardware addresses (i.e. buffers mapped
+ *  with dma_map_single()). Used by dmatest.
+ * -DMA_SLAVE: transfers between a scatterlist and the FPGA. The FPGA address
+ *  is given with dmaengine_slave_config() (dst_addr for DMA_MEM_TO_DEV and
+ *  src_addr for DMA_DEV_TO_MEM, 0 means dma_buff_padd). As in the rest of the
+ *  module the FPGA address advances with the data (memory windows, not
+ *  FIFOs). All the segments of the list are moved with one program (see
+ *  dma_batch_add() in DMA_PL330_LKM_batch.c).
+ * -DMA_CYCLIC: a buffer divided in periods is moved again and again from or to
+ *  the FPGA address until dmaengine_terminate_all(). The callback is called
+ *  after each period. The program of each period is taken from the cache of
+ *  programs, so after the first round no program is generated.
+ *
+ * Each dmaengine channel reserves a channel of the PL330 (and its slot of
+ * microcode) in alloc_chan_resources, the same way open() does, so the char
+ * device keeps working with the channels not used by other drivers. The
+ * descriptors issued are executed in order by a work of the channel.
+ *
+ * The channels are private (DMA_PRIVATE): they are only given to drivers
+ * calling dma_request_channel() (dmatest, slave drivers). Public channels are
+ * taken by dmaengine_get() users (async_tx, net_dma) when the device is
+ * registered and never released, which would take dmaengine_channels
+ * channels from /dev/dma_pl330 for as long as the module is inserted.
+ *
+ * dmaengine takes a reference to the owner of the driver bound to
+ * dma_device.dev while a channel is in use, so the provider is registered
+ * from the probe of a platform driver of this module (the device of
+ * /dev/dma_pl330 has no driver) and rmmod fails while a channel is used.
+ *
+ * With mock_dma=1 the copies are done with memcpy() (the FPGA address of
+ * slave and cyclic transfers goes to the mock FPGA memory), so dmatest can
+ * be run without using the DMAC.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/list.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+#include <linux/scatterlist.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/platform_device.h>
+#include <linux/string.h>
+#include <asm/io.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR DMAENGINE------------------------//
+static int dmaengine_channels = 2;
+module_param(dmaengine_channels, int, 0444);
+MODULE_PARM_DESC(dmaengine_channels, "Channels registered in dmaengine, 0 to not register (default 2)");
+
+#define DMA_ENG_MAX_CHANNELS 8
+
+enum dma_eng_type {
+  DMA_ENG_MEMCPY,
+  DMA_ENG_SLAVE,
+  DMA_ENG_CYCLIC,
+};
+
+struct dma_eng_seg {
+  dma_addr_t addr;
+  uint32_t len;
+};
+
+struct dma_eng_desc {
+  struct dma_async_tx_descriptor tx;
+  struct list_head node;
+  enum dma_eng_type type;
+  enum dma_transfer_direction dir; //slave and cyclic
+  dma_addr_t dst;     //memcpy
+  dma_addr_t src;     //memcpy and buffer of cyclic
+  size_t len;         //memcpy and cyclic (length of the buffer)
+  size_t period_len;  //cyclic
+  uint32_t fpga_padd; //slave and cyclic
+  unsigned int nsegs; //slave
+  struct dma_eng_seg segs[0];
+};
+
+struct dma_eng_chan {
+  struct dma_chan chan;
+  struct dma_client client;  //PL330 channel and its slot of microcode
+  bool reserved;             //a PL330 channel is reserved
+  struct dma_slave_config config;
+  spinlock_t lock;           //protects the lists, the cookies and stop
+  struct list_head submitted;//descriptors waiting for issue_pending
+  struct list_head issued;   //descriptors waiting to be executed
+  struct dma_eng_desc *active;//descriptor being executed by the work
+  struct list_head completed;//finished descriptors not acked by the client
+  dma_cookie_t error_cookie; //last descriptor that failed
+  bool stop;                 //terminate the active descriptor (cyclic)
+  struct work_struct work;
+};
+
+#define DMA_ENG_DRIVER_NAME "dma_pl330_eng"
+
+static struct dma_device dma_eng_dev;
+static struct dma_eng_chan dma_eng_chans[DMA_ENG_MAX_CHANNELS];
+static bool dma_eng_registered = false;
+static struct platform_device *dma_eng_pdev = NULL;
+static bool dma_eng_driver_registered = false;
+
+static inline struct dma_eng_chan* to_eng_chan(struct dma_chan *chan)
+{
+  return container_of(chan, struct dma_eng_chan, chan);
+}
+
+static inline struct dma_eng_desc* to_eng_desc(struct dma_async_tx_descriptor *tx)
+{
+  return container_of(tx, struct dma_eng_desc, tx);
+}
+
+//-------------------------EXECUTION OF DESCRIPTORS----------------------//
+//Move len Bytes from src to dst with the burst profile of the addresses and
+//wait for the end
+static int dma_eng_copy(struct dma_eng_chan *ec, dma_addr_t dst, dma_addr_t src,
+  size_t len, const ALT_DMA_BURST_t* burst)
+{
+  ALT_STATUS_CODE status;
+
+  if (mock_dma)
+  {
+    memcpy(phys_to_virt(dst), phys_to_virt(src), len);
+    return 0;
+  }
+  arm_dma_completion(ec->client.channel);
+  status = alt_dma_memory_to_memory_only_prepare_program_burst(
+    ec->client.channel, ec->client.prog_wr_v, ec->client.prog_wr_h,
+    (void*) dst, (void*) src, len, dma_irq_ok,
+    (ALT_DMA_EVENT_t) ec->client.channel, burst);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_channel_exec(ec->client.channel, ec->client.prog_wr_h);
+  status = wait_dma_transfer(ec->client.channel, status);
+  return (status == ALT_E_SUCCESS) ? 0 : -EIO;
+}
+
+//Move one period of a cyclic transfer using the cache of programs
+static int dma_eng_period(struct dma_eng_chan *ec, struct dma_eng_desc *d,
+  dma_addr_t mem)
+{
+  struct dma_client *client = &ec->client;
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  if (mock_dma)
+    return mock_dma_transfer(phys_to_virt(mem), d->fpga_padd, d->period_len,
+      (d->dir == DMA_MEM_TO_DEV) ? DMA_PL330_DIR_TO_FPGA :
+      DMA_PL330_DIR_FROM_FPGA);
+
+  arm_dma_completion(client->channel);
+  if (d->dir == DMA_MEM_TO_DEV)
+    status = dma_prog_cache_exec(client, client->prog_wr_v, client->prog_wr_h,
+      (void*) d->fpga_padd, (void*) mem, d->period_len);
+  else
+    status = dma_prog_cache_exec(client, client->prog_rd_v, client->prog_rd_h,
+      (void*) mem, (void*) d->fpga_padd, d->period_len);
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, d->period_len, t);
+  dma_prog_cache_done(client);
+  return (status == ALT_E_SUCCESS) ? 0 : -EIO;
+}
+
+//The copy is split only if it does not fit in one program
+static int dma_eng_do_memcpy(struct dma_eng_chan *ec, struct dma_eng_desc *d)
+{
+  ALT_DMA_BURST_t burst;
+  size_t max_len;
+  size_t done = 0;
+  size_t n;
+  int ret = 0;
+
+  dma_burst_select(&ec->client, (void*) d->dst, (void*) d->src, &burst);
+  max_len = dma_burst_max_len(&burst);
+  while ((done < d->len) && (ret == 0))
+  {
+    n = min(d->len - done, max_len);
+    ret = dma_eng_copy(ec, d->dst + done, d->src + done, n, &burst);
+    done += n;
+  }
+  return ret;
+}
+
+static int dma_eng_do_slave(struct dma_eng_chan *ec, struct dma_eng_desc *d)
+{
+  struct dma_batch b;
+  uint32_t fpga_padd = d->fpga_padd;
+  unsigned int i;
+  int ret = 0;
+
+  if (mock_dma)
+  {
+    for (i = 0; (i < d->nsegs) && (ret == 0); i++)
+    {
+      ret = mock_dma_transfer(phys_to_virt(d->segs[i].addr), fpga_padd,
+        d->segs[i].len, (d->dir == DMA_MEM_TO_DEV) ? DMA_PL330_DIR_TO_FPGA :
+        DMA_PL330_DIR_FROM_FPGA);
+      fpga_padd += d->segs[i].len;
+    }
+    return ret;
+  }
+
+  dma_batch_begin(&b, &ec->client);
+  for (i = 0; (i < d->nsegs) && (ret == 0); i++)
+  {
+    if (d->dir == DMA_MEM_TO_DEV)
+      ret = dma_batch_add(&b, (void*) fpga_padd, (void*) d->segs[i].addr,
+        d->segs[i].len);
+    else
+      ret = dma_batch_add(&b, (void*) d->segs[i].addr, (void*) fpga_padd,
+        d->segs[i].len);
+    fpga_padd += d->segs[i].len;
+  }
+  if (ret == 0)
+    ret = dma_batch_end(&b);
+  return ret;
+}
+
+//Periods are moved until the channel is stopped. The callback is called
+//after each period.
+static int dma_eng_do_cyclic(struct dma_eng_chan *ec, struct dma_eng_desc *d)
+{
+  size_t offset = 0;
+  bool stop;
+  int ret;
+
+  while (1)
+  {
+    ret = dma_eng_period(ec, d, d->src + offset);
+    if (ret != 0)
+      return ret;
+    if (d->tx.callback)
+      d->tx.callback(d->tx.callback_param);
+    offset += d->period_len;
+    if (offset >= d->len)
+      offset = 0;
+
+    spin_lock_irq(&ec->lock);
+    stop = ec->stop;
+    spin_unlock_irq(&ec->lock);
+    if (stop)
+      return 0;
+  }
+}
+
+//Work executing the issued descriptors in order
+static void dma_eng_work(struct work_struct *work)
+{
+  struct dma_eng_chan *ec = container_of(work, struct dma_eng_chan, work);
+  struct dma_eng_desc *d;
+  int ret;
+
+  while (1)
+  {
+    spin_lock_irq(&ec->lock);
+    if (list_empty(&ec->issued))
+    {
+      spin_unlock_irq(&ec->lock);
+      break;
+    }
+    d = list_first_entry(&ec->issued, struct dma_eng_desc, node);
+    list_del(&d->node);
+    ec->active = d;
+    spin_unlock_irq(&ec->lock);
+
+    mutex_lock(&ec->client.lock);
+    if (d->type == DMA_ENG_MEMCPY)
+      ret = dma_eng_do_memcpy(ec, d);
+    else if (d->type == DMA_ENG_SLAVE)
+      ret = dma_eng_do_slave(ec, d);
+    else
+      ret = dma_eng_do_cyclic(ec, d);
+    mutex_unlock(&ec->client.lock);
+    if (ret != 0)
+      printk(KERN_INFO "DMA LKM: dmaengine transfer failed in channel %d\n",
+        (int) ec->client.channel);
+
+    spin_lock_irq(&ec->lock);
+    ec->active = NULL;
+    ec->stop = false;
+    ec->chan.completed_cookie = d->tx.cookie;
+    if (ret != 0)
+      ec->error_cookie = d->tx.cookie;
+    spin_unlock_irq(&ec->lock);
+
+    if ((d->type != DMA_ENG_CYCLIC) && d->tx.callback)
+      d->tx.callback(d->tx.callback_param);
+    dma_run_dependencies(&d->tx);
+
+    //the client can use the descriptor until it is acked
+    spin_lock_irq(&ec->lock);
+    list_add_tail(&d->node, &ec->completed);
+    spin_unlock_irq(&ec->lock);
+  }
+}
+
+//---------------------------DMAENGINE CALLBACKS-------------------------//
+static void dma_eng_free_list(struct list_head *list)
+{
+  struct dma_eng_desc *d, *tmp;
+
+  list_for_each_entry_safe(d, tmp, list, node)
+  {
+    list_del(&d->node);
+    kfree(d);
+  }
+}
+
+static dma_cookie_t dma_eng_tx_submit(struct dma_async_tx_descriptor *tx)
+{
+  struct dma_eng_chan *ec = to_eng_chan(tx->chan);
+  struct dma_eng_desc *d = to_eng_desc(tx);
+  dma_cookie_t cookie;
+  unsigned long flags;
+
+  spin_lock_irqsave(&ec->lock, flags);
+  cookie = ec->chan.cookie + 1;
+  if (cookie < DMA_MIN_COOKIE)
+    cookie = DMA_MIN_COOKIE;
+  ec->chan.cookie = cookie;
+  tx->cookie = cookie;
+  list_add_tail(&d->node, &ec->submitted);
+  spin_unlock_irqrestore(&ec->lock, flags);
+
+  return cookie;
+}
+
+static struct dma_eng_desc* dma_eng_desc_alloc(struct dma_chan *chan,
+  enum dma_eng_type type, unsigned int nsegs, unsigned long flags)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+  struct dma_eng_desc *d, *tmp;
+  unsigned long lock_flags;
+  LIST_HEAD(acked);
+
+  //free the finished descriptors already acked
+  spin_lock_irqsave(&ec->lock, lock_flags);
+  list_for_each_entry_safe(d, tmp, &ec->completed, node)
+  {
+    if (async_tx_test_ack(&d->tx))
+      list_move_tail(&d->node, &acked);
+  }
+  spin_unlock_irqrestore(&ec->lock, lock_flags);
+  dma_eng_free_list(&acked);
+
+  d = kzalloc(sizeof(*d) + nsegs*sizeof(struct dma_eng_seg), GFP_NOWAIT);
+  if (d == NULL)
+    return NULL;
+  dma_async_tx_descriptor_init(&d->tx, chan);
+  d->tx.tx_submit = dma_eng_tx_submit;
+  d->tx.flags = flags;
+  d->type = type;
+  INIT_LIST_HEAD(&d->node);
+  return d;
+}
+
+//FPGA address of slave and cyclic transfers in the direction dir
+static uint32_t dma_eng_fpga_padd(struct dma_eng_chan *ec,
+  enum dma_transfer_direction dir)
+{
+  dma_addr_t addr = (dir == DMA_MEM_TO_DEV) ? ec->config.dst_addr :
+    ec->config.src_addr;
+
+  return (addr != 0) ? (uint32_t) addr : (uint32_t) dma_buff_padd;
+}
+
+static int dma_eng_alloc_chan_resources(struct dma_chan *chan)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+  int ch;
+
+  ch = dma_channel_reserve();
+  if (ch < 0)
+  {
+    printk(KERN_INFO "DMA LKM: no free DMA channel for dmaengine\n");
+    return -EBUSY;
+  }
+  dma_client_init(&ec->client, ch);
+  ec->reserved = true;
+  ec->stop = false;
+  ec->error_cookie = 0;
+  chan->completed_cookie = chan->cookie = DMA_MIN_COOKIE;
+  return 1;
+}
+
+//Drop the descriptors not started and stop the active one (cyclic)
+static void dma_eng_terminate_all(struct dma_eng_chan *ec)
+{
+  unsigned long flags;
+  LIST_HEAD(list);
+
+  spin_lock_irqsave(&ec->lock, flags);
+  list_splice_tail_init(&ec->submitted, &list);
+  list_splice_tail_init(&ec->issued, &list);
+  if (ec->active != NULL)
+    ec->stop = true;
+  spin_unlock_irqrestore(&ec->lock, flags);
+  dma_eng_free_list(&list);
+}
+
+static void dma_eng_free_chan_resources(struct dma_chan *chan)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+
+  dma_eng_terminate_all(ec);
+  cancel_work_sync(&ec->work);
+  dma_eng_free_list(&ec->completed);
+  ec->stop = false;
+  if (ec->reserved)
+    dma_channel_release(ec->client.channel);
+  ec->reserved = false;
+}
+
+static struct dma_async_tx_descriptor* dma_eng_prep_memcpy(
+  struct dma_chan *chan, dma_addr_t dst, dma_addr_t src, size_t len,
+  unsigned long flags)
+{
+  struct dma_eng_desc *d;
+
+  if (len == 0)
+    return NULL;
+  d = dma_eng_desc_alloc(chan, DMA_ENG_MEMCPY, 0, flags);
+  if (d == NULL)
+    return NULL;
+  d->dst = dst;
+  d->src = src;
+  d->len = len;
+  return &d->tx;
+}
+
+static struct dma_async_tx_descriptor* dma_eng_prep_slave_sg(
+  struct dma_chan *chan, struct scatterlist *sgl, unsigned int sg_len,
+  enum dma_transfer_direction dir, unsigned long flags, void *context)
+{
+  struct dma_eng_desc *d;
+  struct scatterlist *sg;
+  unsigned int i;
+
+  if ((sg_len == 0) || ((dir != DMA_MEM_TO_DEV) && (dir != DMA_DEV_TO_MEM)))
+    return NULL;
+  d = dma_eng_desc_alloc(chan, DMA_ENG_SLAVE, sg_len, flags);
+  if (d == NULL)
+    return NULL;
+  d->dir = dir;
+  d->fpga_padd = dma_eng_fpga_padd(to_eng_chan(chan), dir);
+  d->nsegs = sg_len;
+  for_each_sg(sgl, sg, sg_len, i)
+  {
+    d->segs[i].addr = sg_dma_address(sg);
+    d->segs[i].len = sg_dma_len(sg);
+  }
+  return &d->tx;
+}
+
+static struct dma_async_tx_descriptor* dma_eng_prep_cyclic(
+  struct dma_chan *chan, dma_addr_t buf_addr, size_t buf_len,
+  size_t period_len, enum dma_transfer_direction dir, unsigned long flags,
+  void *context)
+{
+  struct dma_eng_desc *d;
+
+  if ((period_len == 0) || (buf_len % period_len != 0) ||
+    ((dir != DMA_MEM_TO_DEV) && (dir != DMA_DEV_TO_MEM)))
+    return NULL;
+  d = dma_eng_desc_alloc(chan, DMA_ENG_CYCLIC, 0, flags);
+  if (d == NULL)
+    return NULL;
+  d->dir = dir;
+  d->fpga_padd = dma_eng_fpga_padd(to_eng_chan(chan), dir);
+  d->src = buf_addr;
+  d->len = buf_len;
+  d->period_len = period_len;
+  return &d->tx;
+}
+
+static int dma_eng_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
+  unsigned long arg)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+  unsigned long flags;
+
+  switch (cmd)
+  {
+  case DMA_TERMINATE_ALL:
+    dma_eng_terminate_all(ec);
+    return 0;
+  case DMA_SLAVE_CONFIG:
+    spin_lock_irqsave(&ec->lock, flags);
+    ec->config = *(struct dma_slave_config*) arg;
+    spin_unlock_irqrestore(&ec->lock, flags);
+    return 0;
+  default:
+    return -ENXIO;
+  }
+}
+
+static enum dma_status dma_eng_tx_status(struct dma_chan *chan,
+  dma_cookie_t cookie, struct dma_tx_state *txstate)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+  dma_cookie_t last_used;
+  dma_cookie_t last_complete;
+  dma_cookie_t error_cookie;
+  unsigned long flags;
+
+  spin_lock_irqsave(&ec->lock, flags);
+  last_used = chan->cookie;
+  last_complete = chan->completed_cookie;
+  error_cookie = ec->error_cookie;
+  spin_unlock_irqrestore(&ec->lock, flags);
+
+  dma_set_tx_state(txstate, last_complete, last_used, 0);
+  if ((error_cookie != 0) && (cookie == error_cookie))
+    return DMA_ERROR;
+  return dma_async_is_complete(cookie, last_complete, last_used);
+}
+
+static void dma_eng_issue_pending(struct dma_chan *chan)
+{
+  struct dma_eng_chan *ec = to_eng_chan(chan);
+  unsigned long flags;
+
+  spin_lock_irqsave(&ec->lock, flags);
+  list_splice_tail_init(&ec->submitted, &ec->issued);
+  spin_unlock_irqrestore(&ec->lock, flags);
+  schedule_work(&ec->work);
+}
+
+//-----------------------PLATFORM DEVICE AND DRIVER----------------------//
+//Register the dmaengine provider with the device bound to this driver
+static int dma_eng_probe(struct platform_device *pdev)
+{
+  struct dma_eng_chan *ec;
+  int ret;
+  int i;
+
+  memset(&dma_eng_dev, 0, sizeof(dma_eng_dev));
+  INIT_LIST_HEAD(&dma_eng_dev.channels);
+  dma_cap_zero(dma_eng_dev.cap_mask);
+  dma_cap_set(DMA_MEMCPY, dma_eng_dev.cap_mask);
+  dma_cap_set(DMA_SLAVE, dma_eng_dev.cap_mask);
+  dma_cap_set(DMA_CYCLIC, dma_eng_dev.cap_mask);
+  dma_cap_set(DMA_PRIVATE, dma_eng_dev.cap_mask);
+  dma_eng_dev.dev = &pdev->dev;
+  dma_eng_dev.device_alloc_chan_resources = dma_eng_alloc_chan_resources;
+  dma_eng_dev.device_free_chan_resources = dma_eng_free_chan_resources;
+  dma_eng_dev.device_prep_dma_memcpy = dma_eng_prep_memcpy;
+  dma_eng_dev.device_prep_slave_sg = dma_eng_prep_slave_sg;
+  dma_eng_dev.device_prep_dma_cyclic = dma_eng_prep_cyclic;
+  dma_eng_dev.device_control = dma_eng_control;
+  dma_eng_dev.device_tx_status = dma_eng_tx_status;
+  dma_eng_dev.device_issue_pending = dma_eng_issue_pending;
+
+  for (i = 0; i < dmaengine_channels; i++)
+  {
+    ec = &dma_eng_chans[i];
+    memset(ec, 0, sizeof(*ec));
+    ec->chan.device = &dma_eng_dev;
+    spin_lock_init(&ec->lock);
+    INIT_LIST_HEAD(&ec->submitted);
+    INIT_LIST_HEAD(&ec->issued);
+    INIT_LIST_HEAD(&ec->completed);
+    INIT_WORK(&ec->work, dma_eng_work);
+    list_add_tail(&ec->chan.device_node, &dma_eng_dev.channels);
+  }
+
+  ret = dma_async_device_register(&dma_eng_dev);
+  if (ret != 0)
+  {
+    printk(KERN_INFO "DMA LKM: dmaengine registration failed\n");
+    return ret;
+  }
+  dma_eng_registered = true;
+  printk(KERN_INFO "DMA LKM: %d channels registered in dmaengine\n",
+    dmaengine_channels);
+  return 0;
+}
+
+static int dma_eng_remove(struct platform_device *pdev)
+{
+  if (dma_eng_registered)
+    dma_async_device_unregister(&dma_eng_dev);
+  dma_eng_registered = false;
+  return 0;
+}
+
+static struct platform_driver dma_eng_driver = {
+  .probe = dma_eng_probe,
+  .remove = dma_eng_remove,
+  .driver = {
+    .name = DMA_ENG_DRIVER_NAME,
+    .owner = THIS_MODULE,
+  },
+};
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+//Register the platform driver and its device. The probe registers the
+//dmaengine provider. The char device works without it so errors are only
+//reported.
+int dma_eng_init(void)
+{
+  struct platform_device_info info;
+  int ret;
+
+  if (dmaengine_channels <= 0)
+    return 0;
+  if (dmaengine_channels > DMA_ENG_MAX_CHANNELS)
+    dmaengine_channels = DMA_ENG_MAX_CHANNELS;
+
+  ret = platform_driver_register(&dma_eng_driver);
+  if (ret != 0)
+  {
+    printk(KERN_INFO "DMA LKM: dmaengine driver registration failed\n");
+    return ret;
+  }
+  dma_eng_driver_registered = true;
+
+  //Clients map their buffers with the device of the provider
+  memset(&info, 0, sizeof(info));
+  info.name = DMA_ENG_DRIVER_NAME;
+  info.id = -1;
+  info.dma_mask = DMA_BIT_MASK(32);
+  dma_eng_pdev = platform_device_register_full(&info);
+  if (IS_ERR(dma_eng_pdev))
+  {
+    printk(KERN_INFO "DMA LKM: dmaengine device registration failed\n");
+    ret = PTR_ERR(dma_eng_pdev);
+    dma_eng_pdev = NULL;
+    dma_eng_uninit();
+    return ret;
+  }
+  if (!dma_eng_registered)
+  {
+    dma_eng_uninit(); //the probe failed
+    return -ENODEV;
+  }
+  return 0;
+}
+
+void dma_eng_uninit(void)
+{
+  if (dma_eng_pdev != NULL)
+    platform_device_unregister(dma_eng_pdev);
+  dma_eng_pdev = NULL;
+  if (dma_eng_driver_registered)
+    platform_driver_unregister(&dma_eng_driver);
+  dma_eng_driver_registered = false;
+}
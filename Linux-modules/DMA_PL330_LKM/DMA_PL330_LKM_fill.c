@@ -0,0 +1,182 @@
+/**
+ * @file    DMA_PL330_LKM_fill.c
+ * @brief  Fill of the staging buffers with the DMA (ioctl DMA_PL330_IOC_FILL).
+ *
+ * Clearing a buffer with memset() in the application goes through the caches
+ * of the processor: it takes CPU time and evicts useful data from L1 and L2.
+ * Here the DMAC writes the buffer while the CPU sleeps in wait_dma_transfer():
+ * -DMA_PL330_FILL_ZERO uses alt_dma_zero_to_memory() of the hwlib. The program
+ *  writes zeros with DMASTZ, so nothing is read. Any size and alignment.
+ * -DMA_PL330_FILL_PATTERN writes a 64-bit pattern. The pattern is stored in
+ *  the slot of the channel in HPS OCR (DMA_PATTERN_V) and the program reads
+ *  it with fixed-address bursts and stores it to the buffer:
+ *
+ *   DMAMOV CCR (SAF, SB16, SS64, DAI, DB16, DS64)
+ *   DMAMOV SAR pattern, DMAMOV DAR buffer
+ *   DMALP (nested if more than 256 bursts)
+ *     DMALD, DMAST (128 Bytes)
+ *   DMALPEND
+ *   DMAMOV CCR (SB and DB of the remaining beats), DMALD, DMAST
+ *   DMAWMB, DMASEV, DMAEND
+ *
+ *  The address and the size must be multiple of 8 Bytes.
+ * The cached buffer is written through ACP, so it stays coherent.
+*/
+#include <linux/kernel.h>
+#include <asm/io.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//-----------------------------MACROS------------------------------------//
+#define DMA_FILL_BEAT 8 //Bytes per beat (64-bit)
+#define DMA_FILL_BURST_BEATS 16 //beats per burst (max of the PL330)
+#define DMA_FILL_BURST (DMA_FILL_BEAT*DMA_FILL_BURST_BEATS)
+
+//CCR with bursts of beats beats reading the pattern (fixed) and writing the
+//buffer (incrementing)
+#define DMA_FILL_CCR(beats) ((((beats) - 1) << 4) | ALT_DMA_CCR_OPT_SAF | \
+  ALT_DMA_CCR_OPT_SS64 | ALT_DMA_CCR_OPT_SP_DEFAULT | DMA_CCR_RC_ON | \
+  (((beats) - 1) << 18) | ALT_DMA_CCR_OPT_DAI | ALT_DMA_CCR_OPT_DS64 | \
+  ALT_DMA_CCR_OPT_DP_DEFAULT | DMA_CCR_WC_ON)
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Body of the loops: one burst from the pattern to the buffer
+static ALT_STATUS_CODE dma_fill_burst(ALT_DMA_PROGRAM_t *pgm)
+{
+  ALT_STATUS_CODE status;
+
+  status = alt_dma_program_DMALD(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAST(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  return status;
+}
+
+//Generate the program to fill len Bytes in dst with the 8 Bytes in pattern.
+//The program is not finished (no DMASEV and DMAEND).
+static ALT_STATUS_CODE dma_fill_program(ALT_DMA_PROGRAM_t *pgm, uint32_t dst,
+  uint32_t pattern, uint32_t len)
+{
+  ALT_STATUS_CODE status;
+  uint32_t bursts = len / DMA_FILL_BURST;
+  uint32_t beats = (len % DMA_FILL_BURST) / DMA_FILL_BEAT;
+  uint32_t outer;
+
+  status = alt_dma_program_init(pgm);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_CCR,
+      DMA_FILL_CCR(DMA_FILL_BURST_BEATS));
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_SAR, pattern);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_DAR, dst);
+
+  while ((status == ALT_E_SUCCESS) && (bursts > 0))
+  {
+    if (bursts >= 256)
+    {
+      //blocks of 256 bursts in two nested loops
+      outer = min_t(uint32_t, bursts / 256, 256);
+      status = alt_dma_program_DMALP(pgm, outer);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALP(pgm, 256);
+      if (status == ALT_E_SUCCESS)
+        status = dma_fill_burst(pgm);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      bursts -= outer * 256;
+    }
+    else
+    {
+      status = alt_dma_program_DMALP(pgm, bursts);
+      if (status == ALT_E_SUCCESS)
+        status = dma_fill_burst(pgm);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      bursts = 0;
+    }
+  }
+
+  //the last Bytes in a shorter burst
+  if ((status == ALT_E_SUCCESS) && (beats > 0))
+  {
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_CCR,
+      DMA_FILL_CCR(beats));
+    if (status == ALT_E_SUCCESS)
+      status = dma_fill_burst(pgm);
+  }
+  return status;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+long dma_fill(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_fill fill;
+  ALT_STATUS_CODE status;
+  void* buff_v;
+  void* buff_h;
+  u32 t;
+
+  if (mock_dma)
+    return -ENODEV;
+
+  if (copy_from_user(&fill, (void*) arg, sizeof(fill)) != 0)
+    return -EFAULT;
+  if ((fill.mode != DMA_PL330_FILL_ZERO) &&
+    (fill.mode != DMA_PL330_FILL_PATTERN))
+    return -EINVAL;
+  if (client_offset_to_buff(client, fill.offset, fill.len, &buff_v,
+    &buff_h) != 0)
+    return -EINVAL;
+  if ((fill.mode == DMA_PL330_FILL_PATTERN) &&
+    ((((uint32_t) buff_h) % DMA_FILL_BEAT != 0) ||
+    (fill.len % DMA_FILL_BEAT != 0)))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  client->prog_prepared = false; //the slot of the channel is overwritten
+  arm_dma_completion(client->channel);
+  if (fill.mode == DMA_PL330_FILL_ZERO)
+  {
+    t = dma_stats_start();
+    status = alt_dma_zero_to_memory(client->channel, client->prog_wr_v,
+      client->prog_wr_h, buff_h, fill.len, dma_irq_ok,
+      (ALT_DMA_EVENT_t) client->channel);
+    dma_stats_end(DMA_STAGE_EXEC, fill.len, t);
+  }
+  else
+  {
+    //pattern in OCR, in the same order as in memory (little endian)
+    iowrite32((uint32_t) fill.pattern, client->pattern_v);
+    iowrite32((uint32_t) (fill.pattern >> 32), (char*) client->pattern_v + 4);
+
+    t = dma_stats_start();
+    status = dma_fill_program(client->prog_wr_v, (uint32_t) buff_h,
+      (uint32_t) client->pattern_h, fill.len);
+    dma_stats_end(DMA_STAGE_PREPARE, fill.len, t);
+    if (status != ALT_E_SUCCESS)
+    {
+      mutex_unlock(&client->lock);
+      printk(KERN_INFO "DMA LKM: could not generate fill program (%d)\n",
+        (int) status);
+      return -EINVAL;
+    }
+    t = dma_stats_start();
+    status = alt_dma_memory_to_memory_finish(client->channel,
+      client->prog_wr_v, client->prog_wr_h, dma_irq_ok,
+      (ALT_DMA_EVENT_t) client->channel);
+    dma_stats_end(DMA_STAGE_EXEC, fill.len, t);
+  }
+
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, fill.len, t);
+  mutex_unlock(&client->lock);
+
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+  return 0;
+}
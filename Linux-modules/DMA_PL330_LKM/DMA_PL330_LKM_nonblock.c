@@ -0,0 +1,190 @@
+/**
+ * @file    DMA_PL330_LKM_nonblock.c
+ * @brief  Non-blocking read() and write() (O_NONBLOCK) and poll().
+ *
+ * When the file is opened with O_NONBLOCK the transfers of read() and write()
+ * are started and the functions return without waiting for the DMA:
+ * -write() copies the data to the buffer of the file, starts the transfer to
+ *  the FPGA and returns. poll() reports POLLOUT when the channel finishes and
+ *  the next write() can be done.
+ * -The first read() starts the transfer from the FPGA and returns -EAGAIN.
+ *  poll() reports POLLIN when the channel finishes and the next read() copies
+ *  the data to the application.
+ * While a transfer is running read() and write() return -EAGAIN. Only one
+ * transfer per file can be running. The size is limited to the buffer of the
+ * file (no pipelining).
+ *
+ * The readiness comes from the IRQ of the channel (the DMASEV at the end of
+ * the program), that wakes up the wait queue of the channel used by poll(), so
+ * the module must have its IRQs (see completion_mode). Without them the
+ * transfers are blocking even with O_NONBLOCK.
+ *
+ * Other operations of the file (blocking read() and write(), ioctl(), close())
+ * first wait for the running transfer (dma_nb_finish()).
+ *
+ * While a cyclic capture runs in the channel poll() reports the periods
+ * captured (see DMA_PL330_LKM_capture.c).
+*/
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/poll.h>
+#include <asm/uaccess.h>
+
+#include "DMA_PL330_LKM.h"
+
+//-------------------------------FUNCTIONS-------------------------------//
+//The transfer of the file finished: check the result and release the program
+static void dma_nb_complete(struct dma_client *client)
+{
+  ALT_STATUS_CODE status;
+
+  //the channel already stopped so this does not wait
+  status = wait_dma_transfer(client->channel, ALT_E_SUCCESS);
+  dma_prog_cache_done(client);
+  client->nb_result = (status == ALT_E_SUCCESS) ? 0 : -EIO;
+  if (client->nb_state == DMA_NB_READ)
+    client->nb_state = DMA_NB_READ_DONE;
+  else
+    client->nb_state = DMA_NB_IDLE;
+}
+
+//Check if the running transfer finished. Returns -EAGAIN if not.
+static int dma_nb_check(struct dma_client *client)
+{
+  if ((client->nb_state == DMA_NB_WRITE) || (client->nb_state == DMA_NB_READ))
+  {
+    if (!dma_transfer_done(client->channel))
+      return -EAGAIN;
+    dma_nb_complete(client);
+  }
+  return 0;
+}
+
+//Start a transfer of len Bytes in the direction of state without waiting
+static int dma_nb_start(struct dma_client *client, size_t len, int state)
+{
+  ALT_STATUS_CODE status;
+
+  client_acp_count(client, len);
+  arm_dma_completion(client->channel);
+  if (state == DMA_NB_WRITE)
+    status = dma_prog_cache_exec(client, client->prog_wr_v, client->prog_wr_h,
+      client->fpga_padd, client_buff_h(client, len), len);
+  else
+    status = dma_prog_cache_exec(client, client->prog_rd_v, client->prog_rd_h,
+      client_buff_h(client, len), client->fpga_padd, len);
+  if (status != ALT_E_SUCCESS)
+  {
+    dma_prog_cache_done(client);
+    return -EIO;
+  }
+  client->nb_len = len;
+  client->nb_state = state;
+  return 0;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+ssize_t dma_nb_write(struct dma_client *client, const char *buffer, size_t len)
+{
+  int ret;
+
+  if ((len == 0) || (len > sub_buff_size))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  ret = dma_nb_check(client);
+  if (ret != 0)
+    goto out;
+  //the data of a finished read was not taken yet
+  if (client->nb_state == DMA_NB_READ_DONE)
+  {
+    ret = -EBUSY;
+    goto out;
+  }
+  //report the error of the previous write
+  ret = client->nb_result;
+  client->nb_result = 0;
+  if (ret != 0)
+    goto out;
+
+  if (copy_from_user(client_buff_v(client, len), buffer, len) != 0)
+  {
+    ret = -EFAULT;
+    goto out;
+  }
+  ret = dma_nb_start(client, len, DMA_NB_WRITE);
+out:
+  mutex_unlock(&client->lock);
+  return ret;
+}
+
+ssize_t dma_nb_read(struct dma_client *client, char *buffer, size_t len)
+{
+  int ret;
+
+  if ((len == 0) || (len > sub_buff_size))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  ret = dma_nb_check(client);
+  if (ret != 0)
+    goto out;
+
+  if (client->nb_state == DMA_NB_READ_DONE)
+  {
+    //the data is ready: give it to the application
+    client->nb_state = DMA_NB_IDLE;
+    ret = client->nb_result;
+    client->nb_result = 0;
+    if ((ret == 0) && (copy_to_user(buffer, client_buff_v(client,
+      client->nb_len), min(len, client->nb_len)) != 0))
+      ret = -EFAULT;
+    goto out;
+  }
+
+  //start the transfer from the FPGA. The data is returned by a later read()
+  client->nb_result = 0;
+  ret = dma_nb_start(client, len, DMA_NB_READ);
+  if (ret == 0)
+    ret = -EAGAIN;
+out:
+  mutex_unlock(&client->lock);
+  return ret;
+}
+
+//Wait for the running transfer. Called with client->lock taken before other
+//operations of the file use the channel. The data of a read is discarded.
+void dma_nb_finish(struct dma_client *client)
+{
+  if ((client->nb_state == DMA_NB_WRITE) || (client->nb_state == DMA_NB_READ))
+  {
+    wait_dma_transfer(client->channel, ALT_E_SUCCESS);
+    dma_prog_cache_done(client);
+  }
+  client->nb_state = DMA_NB_IDLE;
+  client->nb_result = 0;
+}
+
+unsigned int dma_nb_poll(struct file *filep, poll_table *wait)
+{
+  struct dma_client *client = filep->private_data;
+  unsigned int mask = 0;
+  int state;
+
+  if (dma_capture_busy(client))
+    return dma_capture_poll(filep, wait);
+  dma_poll_wait(filep, client->channel, wait);
+
+  state = ACCESS_ONCE(client->nb_state);
+  if ((state == DMA_NB_WRITE) || (state == DMA_NB_READ))
+  {
+    if (!dma_transfer_done(client->channel))
+      return 0;
+    state = (state == DMA_NB_READ) ? DMA_NB_READ_DONE : DMA_NB_IDLE;
+  }
+  if (state == DMA_NB_IDLE)
+    mask |= POLLOUT | POLLWRNORM;
+  if (state == DMA_NB_READ_DONE)
+    mask |= POLLIN | POLLRDNORM;
+  return mask;
+}
@@ -0,0 +1,212 @@
+/**
+ * @file    DMA_PL330_LKM_periph.c
+ * @brief  Transfers with flow control between the staging buffers and FIFOs
+ * in the FPGA (ioctl DMA_PL330_IOC_XFER_PERIPH).
+ *
+ * The other transfers of the driver are memory to memory: the DMA moves the
+ * data as fast as it can, so before writing to (or reading from) a FIFO in the
+ * FPGA the CPU must check that it has space (or data) for the whole transfer.
+ * Here the DMA uses the peripheral request interface of the PL330. The FIFO
+ * asserts the request (f2h_dma_req of the HPS) when it can take or give a
+ * burst and the program waits for it before each burst:
+ *
+ *   DMAFLUSHP periph
+ *   DMAMOV CCR (memory side incrementing, FIFO side fixed, bursts of burst*8 Bytes)
+ *   DMAMOV SAR, DMAMOV DAR
+ *   DMALP (nested if more than 256 bursts)
+ *     DMAWFP periph, burst
+ *     to the FPGA:   DMALD,          DMASTPB periph
+ *     from the FPGA: DMALDPB periph, DMAST
+ *   DMALPEND
+ *   DMAWMB, DMASEV, DMAEND
+ *
+ * The DMASTP/DMALDP tells the FIFO that the burst was done so it can
+ * request the next one. The request interfaces FPGA_4 to FPGA_7 must be given
+ * to the FPGA with the module parameter periph_mux.
+ *
+ * The hwlib implements alt_dma_memory_to_periph() and alt_dma_periph_to_memory()
+ * only for the peripherals of the HPS (UART, QSPI, I2C), so the program is
+ * generated here with the alt_dma_program_DMA* functions.
+*/
+#include <linux/kernel.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//-----------------------------MACROS------------------------------------//
+#define DMA_PERIPH_BEAT 8 //Bytes per beat (64-bit)
+#define DMA_PERIPH_FPGA_NUM 8 //peripheral request interfaces of the FPGA
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Body of the loop: wait for the request of the FIFO and move one burst
+static ALT_STATUS_CODE dma_periph_burst(ALT_DMA_PROGRAM_t *pgm,
+  ALT_DMA_PERIPH_t periph, uint32_t dir)
+{
+  ALT_STATUS_CODE status;
+
+  status = alt_dma_program_DMAWFP(pgm, periph, ALT_DMA_PROGRAM_INST_MOD_BURST);
+  if (dir == DMA_PL330_DIR_TO_FPGA)
+  {
+    if (status == ALT_E_SUCCESS)
+      status = alt_dma_program_DMALD(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+    if (status == ALT_E_SUCCESS)
+      status = alt_dma_program_DMASTP(pgm, ALT_DMA_PROGRAM_INST_MOD_BURST,
+        periph);
+  }
+  else
+  {
+    if (status == ALT_E_SUCCESS)
+      status = alt_dma_program_DMALDP(pgm, ALT_DMA_PROGRAM_INST_MOD_BURST,
+        periph);
+    if (status == ALT_E_SUCCESS)
+      status = alt_dma_program_DMAST(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+  }
+  return status;
+}
+
+//Generate the program for bursts bursts of beats beats. The program is not
+//finished (no DMASEV and DMAEND).
+static ALT_STATUS_CODE dma_periph_program(ALT_DMA_PROGRAM_t *pgm,
+  ALT_DMA_PERIPH_t periph, uint32_t dir, uint32_t dst, uint32_t src,
+  uint32_t beats, uint32_t bursts)
+{
+  ALT_STATUS_CODE status;
+  uint32_t ccr;
+  uint32_t outer;
+
+  //the memory side increments and the FIFO side is fixed
+  ccr = ((beats - 1) << 4) | ALT_DMA_CCR_OPT_SS64 | ALT_DMA_CCR_OPT_SP_DEFAULT |
+    DMA_CCR_RC_ON | ((beats - 1) << 18) | ALT_DMA_CCR_OPT_DS64 |
+    ALT_DMA_CCR_OPT_DP_DEFAULT | DMA_CCR_WC_ON;
+  if (dir == DMA_PL330_DIR_TO_FPGA)
+    ccr |= ALT_DMA_CCR_OPT_SAI | ALT_DMA_CCR_OPT_DAF;
+  else
+    ccr |= ALT_DMA_CCR_OPT_SAF | ALT_DMA_CCR_OPT_DAI;
+
+  status = alt_dma_program_init(pgm);
+  //discard requests of the FIFO from before this transfer
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAFLUSHP(pgm, periph);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_CCR, ccr);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_SAR, src);
+  if (status == ALT_E_SUCCESS)
+    status = alt_dma_program_DMAMOV(pgm, ALT_DMA_PROGRAM_REG_DAR, dst);
+
+  while ((status == ALT_E_SUCCESS) && (bursts > 0))
+  {
+    if (bursts >= 256)
+    {
+      //blocks of 256 bursts in two nested loops
+      outer = min_t(uint32_t, bursts / 256, 256);
+      status = alt_dma_program_DMALP(pgm, outer);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALP(pgm, 256);
+      if (status == ALT_E_SUCCESS)
+        status = dma_periph_burst(pgm, periph, dir);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      bursts -= outer * 256;
+    }
+    else
+    {
+      status = alt_dma_program_DMALP(pgm, bursts);
+      if (status == ALT_E_SUCCESS)
+        status = dma_periph_burst(pgm, periph, dir);
+      if (status == ALT_E_SUCCESS)
+        status = alt_dma_program_DMALPEND(pgm, ALT_DMA_PROGRAM_INST_MOD_NONE);
+      bursts = 0;
+    }
+  }
+  return status;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+long dma_periph_xfer(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_periph xfer;
+  ALT_DMA_PROGRAM_t* prog_v;
+  ALT_DMA_PROGRAM_t* prog_h;
+  ALT_STATUS_CODE status;
+  void* buff_v;
+  void* buff_h;
+  uint32_t fpga_padd;
+  uint32_t burst_size;
+  u32 t;
+
+  if (mock_dma)
+    return -ENODEV;
+
+  if (copy_from_user(&xfer, (void*) arg, sizeof(xfer)) != 0)
+    return -EFAULT;
+  if ((xfer.dir != DMA_PL330_DIR_TO_FPGA) &&
+    (xfer.dir != DMA_PL330_DIR_FROM_FPGA))
+    return -EINVAL;
+  if ((xfer.periph >= DMA_PERIPH_FPGA_NUM) || (xfer.burst == 0) ||
+    (xfer.burst > 16))
+    return -EINVAL;
+  burst_size = xfer.burst * DMA_PERIPH_BEAT;
+  if (xfer.len % burst_size != 0)
+    return -EINVAL;
+  if (client_offset_to_buff(client, xfer.offset, xfer.len, &buff_v,
+    &buff_h) != 0)
+    return -EINVAL;
+  //the address of the FIFO is fixed: beats of 8 Bytes
+  if (client_fpga_addr(client, xfer.fpga_addr, DMA_PERIPH_BEAT,
+    &fpga_padd) != 0)
+    return -EINVAL;
+  if ((((uint32_t) buff_h) % DMA_PERIPH_BEAT != 0) ||
+    (fpga_padd % DMA_PERIPH_BEAT != 0))
+    return -EINVAL;
+
+  mutex_lock(&client->lock);
+  if (xfer.dir == DMA_PL330_DIR_TO_FPGA)
+  {
+    prog_v = client->prog_wr_v;
+    prog_h = client->prog_wr_h;
+  }
+  else
+  {
+    prog_v = client->prog_rd_v;
+    prog_h = client->prog_rd_h;
+  }
+  client->prog_prepared = false; //the slot of the channel is overwritten
+
+  t = dma_stats_start();
+  if (xfer.dir == DMA_PL330_DIR_TO_FPGA)
+    status = dma_periph_program(prog_v, (ALT_DMA_PERIPH_t) xfer.periph,
+      xfer.dir, fpga_padd, (uint32_t) buff_h, xfer.burst,
+      xfer.len / burst_size);
+  else
+    status = dma_periph_program(prog_v, (ALT_DMA_PERIPH_t) xfer.periph,
+      xfer.dir, (uint32_t) buff_h, fpga_padd, xfer.burst,
+      xfer.len / burst_size);
+  dma_stats_end(DMA_STAGE_PREPARE, xfer.len, t);
+  if (status != ALT_E_SUCCESS)
+  {
+    mutex_unlock(&client->lock);
+    printk(KERN_INFO "DMA LKM: could not generate flow control program (%d)\n",
+      (int) status);
+    return -EINVAL;
+  }
+
+  arm_dma_completion(client->channel);
+  t = dma_stats_start();
+  status = alt_dma_memory_to_memory_finish(client->channel, prog_v, prog_h,
+    dma_irq_ok, (ALT_DMA_EVENT_t) client->channel);
+  dma_stats_end(DMA_STAGE_EXEC, xfer.len, t);
+  //the FIFO sets the speed. If it does not request bursts during
+  //dma_timeout_ms the channel is killed.
+  t = dma_stats_start();
+  status = wait_dma_transfer(client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, xfer.len, t);
+  mutex_unlock(&client->lock);
+
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+  return 0;
+}
@@ -0,0 +1,260 @@
+/**
+ * @file    DMA_PL330_LKM_progcache.c
+ * @brief  Cache of prepared DMA programs in HPS On-Chip RAM.
+ *
+ * Preparing the microcode of a transfer takes from 10% (big transfers) to 75%
+ * (small transfers) of the transfer time. Applications usually repeat the
+ * same transfers (same source, destiny and size), so the prepared programs
+ * are kept in the part of HPS OCR not used by the slots of the channels. When
+ * a transfer is requested the cache is searched and, if the program is found
+ * (hit), it is executed directly with alt_dma_channel_exec(). Otherwise (miss)
+ * the program is prepared in the least recently used entry of the cache.
+ *
+ * Programs of the same size whose addresses have the same 8-byte alignment
+ * only differ in the immediates of DMAMOV SAR and DMAMOV DAR. So before
+ * preparing a new program, a cached program of the same size not being
+ * executed is used as template: only its SAR and DAR are patched with
+ * alt_dma_memory_to_memory_patch() (patch). This way applications moving the
+ * same size from/to many buffers (i.e. ring descriptors) do not prepare one
+ * program per buffer.
+ *
+ * The key of each program is (dst, src, size, send_evt, evt, burst). The use
+ * of ACP is part of the key because it changes the hardware address of the
+ * buffers (+0x80000000). The burst is the profile selected for the transfer
+ * (see DMA_PL330_LKM_burst.c).
+ *
+ * An entry being executed by a channel is not evicted until the transfer
+ * finishes (dma_prog_cache_done()). When no entry can be used the program is
+ * prepared in the slot of the channel as before.
+*/
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR THE CACHE------------------------//
+//Each entry uses a slot of DMA_PROG_CACHE_SLOT Bytes in HPS OCR. The program
+//struct starts 16B after the slot so the microcode is 32B aligned (see
+//DMA_PROG_WR_V in DMA_PL330_LKM.c).
+#define DMA_PROG_CACHE_SLOT 1024
+#define DMA_PROG_CACHE_MAX_ENTRIES 48 //48kB of HPS OCR
+
+struct dma_prog_entry {
+  struct list_head lru;    //position in the LRU list (first is most recent)
+  ALT_DMA_PROGRAM_t* prog_v; //virtual address of the program
+  ALT_DMA_PROGRAM_t* prog_h; //hardware address of the program
+  bool valid;              //the entry contains a prepared program
+  int users;               //channels executing the program
+  //key
+  void* dst;
+  const void* src;
+  size_t size;
+  bool send_evt;
+  ALT_DMA_EVENT_t evt;
+  ALT_DMA_BURST_t burst;
+};
+
+static struct dma_prog_entry prog_cache[DMA_PROG_CACHE_MAX_ENTRIES];
+static unsigned int prog_cache_entries = 0;
+static LIST_HEAD(prog_cache_lru);
+static DEFINE_MUTEX(prog_cache_mutex); //protects the entries and the LRU list
+
+int prog_cache_enable = 1; //0 to always prepare programs in the channel slot
+unsigned int prog_cache_hits = 0;
+unsigned int prog_cache_misses = 0;
+unsigned int prog_cache_patches = 0;
+
+//-------------------------------FUNCTIONS-------------------------------//
+//The program of the entry uses the burst
+static bool dma_prog_cache_same_burst(struct dma_prog_entry *entry,
+  const ALT_DMA_BURST_t* burst)
+{
+  return (entry->burst.size == burst->size) &&
+    (entry->burst.length == burst->length);
+}
+
+//Search the program for a transfer. The entry returned is moved to the head
+//of the LRU list and marked as in use.
+static struct dma_prog_entry* dma_prog_cache_get(void* dst, const void* src,
+  size_t size, bool send_evt, ALT_DMA_EVENT_t evt,
+  const ALT_DMA_BURST_t* burst)
+{
+  struct dma_prog_entry *entry;
+  struct dma_prog_entry *victim = NULL;
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  list_for_each_entry(entry, &prog_cache_lru, lru)
+  {
+    if (entry->valid && (entry->dst == dst) && (entry->src == src) &&
+      (entry->size == size) && (entry->send_evt == send_evt) &&
+      (entry->evt == evt) && dma_prog_cache_same_burst(entry, burst))
+    {
+      prog_cache_hits++;
+      goto found;
+    }
+  }
+
+  //patch: use the least recently used program of the same shape not being
+  //executed as template
+  list_for_each_entry_reverse(entry, &prog_cache_lru, lru)
+  {
+    if (entry->valid && (entry->users == 0) && (entry->size == size) &&
+      (entry->send_evt == send_evt) && (entry->evt == evt) &&
+      dma_prog_cache_same_burst(entry, burst) &&
+      ((((uintptr_t) entry->dst ^ (uintptr_t) dst) & 0x7) == 0) &&
+      ((((uintptr_t) entry->src ^ (uintptr_t) src) & 0x7) == 0))
+    {
+      t = dma_stats_start();
+      status = alt_dma_memory_to_memory_patch(entry->prog_v, dst, src);
+      dma_stats_end(DMA_STAGE_PREPARE, size, t);
+      if (status != ALT_E_SUCCESS)
+        break;
+      entry->dst = dst;
+      entry->src = src;
+      prog_cache_patches++;
+      goto found;
+    }
+  }
+
+  //miss: use the least recently used entry not being executed
+  prog_cache_misses++;
+  list_for_each_entry_reverse(entry, &prog_cache_lru, lru)
+  {
+    if (entry->users == 0)
+    {
+      victim = entry;
+      break;
+    }
+  }
+  if (victim == NULL)
+    return NULL;
+
+  entry = victim;
+  entry->valid = false;
+  //the channel is not used when only preparing the program
+  t = dma_stats_start();
+  status = alt_dma_memory_to_memory_only_prepare_program_burst(
+    ALT_DMA_CHANNEL_0, entry->prog_v, entry->prog_h, dst, src, size, send_evt,
+    evt, burst);
+  dma_stats_end(DMA_STAGE_PREPARE, size, t);
+  if (status != ALT_E_SUCCESS)
+    return NULL;
+  entry->dst = dst;
+  entry->src = src;
+  entry->size = size;
+  entry->send_evt = send_evt;
+  entry->evt = evt;
+  entry->burst = *burst;
+  entry->valid = true;
+
+found:
+  list_move(&entry->lru, &prog_cache_lru);
+  entry->users++;
+  return entry;
+}
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+//Divide the region of HPS OCR reserved for the cache in entries
+void dma_prog_cache_init(void* base_v, void* base_h, unsigned int size)
+{
+  unsigned int i;
+
+  prog_cache_entries = size / DMA_PROG_CACHE_SLOT;
+  if (prog_cache_entries > DMA_PROG_CACHE_MAX_ENTRIES)
+    prog_cache_entries = DMA_PROG_CACHE_MAX_ENTRIES;
+
+  INIT_LIST_HEAD(&prog_cache_lru);
+  for (i = 0; i < prog_cache_entries; i++)
+  {
+    prog_cache[i].prog_v = (ALT_DMA_PROGRAM_t*)
+      ((char*) base_v + i*DMA_PROG_CACHE_SLOT + 16);
+    prog_cache[i].prog_h = (ALT_DMA_PROGRAM_t*)
+      ((char*) base_h + i*DMA_PROG_CACHE_SLOT + 16);
+    prog_cache[i].valid = false;
+    prog_cache[i].users = 0;
+    list_add_tail(&prog_cache[i].lru, &prog_cache_lru);
+  }
+  prog_cache_hits = 0;
+  prog_cache_misses = 0;
+  prog_cache_patches = 0;
+  printk(KERN_INFO "DMA LKM: cache of %u DMA programs in HPS OCR\n",
+    prog_cache_entries);
+}
+
+//Invalidate all the programs not being executed
+void dma_prog_cache_flush(void)
+{
+  struct dma_prog_entry *entry;
+
+  mutex_lock(&prog_cache_mutex);
+  list_for_each_entry(entry, &prog_cache_lru, lru)
+  {
+    if (entry->users == 0)
+      entry->valid = false;
+  }
+  mutex_unlock(&prog_cache_mutex);
+}
+
+//Execute in the channel of the client a program moving size Bytes from src to
+//dst. The program is taken from the cache or prepared in it. If the cache is
+//disabled or full of programs in use, it is prepared in progv/progh (slot of
+//the channel). dma_prog_cache_done() must be called after waiting for the
+//transfer.
+ALT_STATUS_CODE dma_prog_cache_exec(struct dma_client *client,
+  ALT_DMA_PROGRAM_t* progv, ALT_DMA_PROGRAM_t* progh, void* dst,
+  const void* src, size_t size)
+{
+  struct dma_prog_entry *entry = NULL;
+  ALT_DMA_PROGRAM_t* exec_h = progh;
+  ALT_DMA_BURST_t burst;
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  //nothing to do (same as alt_dma_memory_to_memory())
+  if ((size == 0) && !dma_irq_ok)
+    return ALT_E_SUCCESS;
+
+  dma_burst_select(client, dst, src, &burst);
+  if (prog_cache_enable && (prog_cache_entries > 0) && (size > 0))
+  {
+    mutex_lock(&prog_cache_mutex);
+    entry = dma_prog_cache_get(dst, src, size, dma_irq_ok,
+      (ALT_DMA_EVENT_t) client->channel, &burst);
+    mutex_unlock(&prog_cache_mutex);
+  }
+
+  client->prog_entry = entry;
+  if (entry == NULL)
+  {
+    //prepare the program in the slot of the channel
+    client->prog_prepared = false;
+    t = dma_stats_start();
+    status = alt_dma_memory_to_memory_only_prepare_program_burst(
+      client->channel, progv, progh, dst, src, size, dma_irq_ok,
+      (ALT_DMA_EVENT_t) client->channel, &burst);
+    dma_stats_end(DMA_STAGE_PREPARE, size, t);
+    if (status != ALT_E_SUCCESS)
+      return status;
+  }
+  else
+    exec_h = entry->prog_h;
+
+  t = dma_stats_start();
+  status = alt_dma_channel_exec(client->channel, exec_h);
+  dma_stats_end(DMA_STAGE_EXEC, size, t);
+  return status;
+}
+
+//The transfer started with dma_prog_cache_exec() finished
+void dma_prog_cache_done(struct dma_client *client)
+{
+  if (client->prog_entry == NULL)
+    return;
+
+  mutex_lock(&prog_cache_mutex);
+  client->prog_entry->users--;
+  mutex_unlock(&prog_cache_mutex);
+  client->prog_entry = NULL;
+}
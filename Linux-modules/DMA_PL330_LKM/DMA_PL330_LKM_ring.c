@@ -0,0 +1,350 @@
+/**
+ * @file    DMA_PL330_LKM_ring.c
+ * @brief  Submission/completion ring shared between DMA_PL330_LKM and the
+ * application.
+ *
+ * The application posts transfer descriptors in a submission queue (SQ) mapped
+ * in its memory and submits many of them with one ioctl. A work executes them
+ * in order in the DMA channel of the file using the cache of programs and
+ * writes one completion per descriptor in the completion queue (CQ), also
+ * mapped in the application. See dma_pl330_ioctl.h for the layout of the ring.
+ *
+ * When the module is inserted with mock_dma=1 the DMA channel is mocked: the
+ * transfers are done with memcpy() between the staging buffers and a mock
+ * FPGA memory allocated with vmalloc(). This way the ring can be tested
+ * without DMAC and without FPGA hardware.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <linux/wait.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR THE RING-------------------------//
+struct dma_ring {
+  struct dma_client *client;  //file using the ring
+  void* mem;                  //memory shared with the application
+  unsigned int mem_size;
+  struct dma_pl330_ring_hdr *hdr;
+  struct dma_pl330_sqe *sq;
+  unsigned int sq_entries;
+  struct dma_pl330_cqe *cq;
+  unsigned int cq_entries;
+  //Descriptors are copied from the SQ when submitted so the application
+  //cannot change them while the work executes them
+  struct dma_pl330_sqe *pending;//cq_entries descriptors
+  unsigned int pending_head;  //next descriptor to execute
+  unsigned int pending_tail;  //next free position
+  unsigned int sq_head;       //private copy of hdr->sq_head
+  unsigned int cq_tail;       //private copy of hdr->cq_tail
+  spinlock_t lock;            //protects pending_head, pending_tail and cq_tail
+  struct mutex submit_lock;   //serializes ioctl(DMA_PL330_IOC_RING_ENTER)
+  struct work_struct work;    //executes the pending descriptors
+  wait_queue_head_t wq;       //to wait for completions
+  bool stop;                  //set when the file is closed
+};
+
+//----------------------VARIABLES FOR THE MOCK DMA-----------------------//
+static int mock_fpga_size = 256*1024;
+module_param(mock_fpga_size, int, 0444);
+MODULE_PARM_DESC(mock_fpga_size, "Size of the mock FPGA memory when mock_dma=1 (default 256kB)");
+static void* mock_fpga_v; //mock FPGA memory. Its physical address is dma_buff_padd
+
+int dma_ring_mock_init(void)
+{
+  mock_fpga_v = vzalloc(mock_fpga_size);
+  if (mock_fpga_v == NULL)
+  {
+    printk(KERN_INFO "DMA LKM: allocation of mock FPGA memory failed\n");
+    return -ENOMEM;
+  }
+  printk(KERN_INFO "DMA LKM: mock DMA enabled. Mock FPGA memory of %d Bytes in 0x%x\n",
+    mock_fpga_size, (unsigned int) dma_buff_padd);
+  return 0;
+}
+
+void dma_ring_mock_uninit(void)
+{
+  vfree(mock_fpga_v);
+  mock_fpga_v = NULL;
+}
+
+//Transfer done with memcpy() instead of the DMAC. fpga_padd is the physical
+//address in the FPGA. The mock FPGA memory starts in dma_buff_padd.
+int mock_dma_transfer(void* buff_v, uint32_t fpga_padd, uint32_t len,
+  uint32_t dir)
+{
+  uint32_t offset = fpga_padd - (uint32_t) dma_buff_padd;
+
+  if ((fpga_padd < (uint32_t) dma_buff_padd) || (len > mock_fpga_size) ||
+    (offset > mock_fpga_size - len))
+    return -EINVAL;
+
+  if (dir == DMA_PL330_DIR_TO_FPGA)
+    memcpy((char*)mock_fpga_v + offset, buff_v, len);
+  else
+    memcpy(buff_v, (char*)mock_fpga_v + offset, len);
+  return 0;
+}
+
+//-------------------------EXECUTION OF DESCRIPTORS----------------------//
+//Execute one descriptor in the channel of the client. Returns 0 or a negative
+//error code to be written in the completion.
+static int dma_ring_do(struct dma_client *client, struct dma_pl330_sqe *sqe)
+{
+  ALT_STATUS_CODE status;
+  void* buff_v;
+  void* buff_h;
+  uint32_t buff_offset;
+  uint32_t fpga_padd;
+  int ret;
+
+  if (sqe->flags == DMA_PL330_DIR_TO_FPGA)
+  {
+    buff_offset = sqe->src;
+    fpga_padd = sqe->dst;
+  }
+  else if (sqe->flags == DMA_PL330_DIR_FROM_FPGA)
+  {
+    buff_offset = sqe->dst;
+    fpga_padd = sqe->src;
+  }
+  else
+    return -EINVAL;
+
+  if (client_fpga_addr(client, fpga_padd, sqe->len, &fpga_padd) != 0)
+    return -EINVAL;
+
+  ret = client_offset_to_buff(client, buff_offset, sqe->len, &buff_v, &buff_h);
+  if (ret != 0)
+    return ret;
+
+  if (mock_dma)
+    return mock_dma_transfer(buff_v, fpga_padd, sqe->len, sqe->flags);
+
+  if (sqe->flags == DMA_PL330_DIR_TO_FPGA)
+    status = dma_sched_xfer(client, client->prog_wr_v, client->prog_wr_h,
+      (void*) fpga_padd, buff_h, (size_t) sqe->len);
+  else
+    status = dma_sched_xfer(client, client->prog_rd_v, client->prog_rd_h,
+      buff_h, (void*) fpga_padd, (size_t) sqe->len);
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+  return 0;
+}
+
+//Work executing the pending descriptors in order and writing the completions
+static void dma_ring_work(struct work_struct *work)
+{
+  struct dma_ring *ring = container_of(work, struct dma_ring, work);
+  struct dma_client *client = ring->client;
+  struct dma_pl330_sqe sqe;
+  struct dma_pl330_cqe *cqe;
+  int res;
+
+  while (1)
+  {
+    spin_lock(&ring->lock);
+    if (ring->stop || (ring->pending_head == ring->pending_tail))
+    {
+      spin_unlock(&ring->lock);
+      break;
+    }
+    sqe = ring->pending[ring->pending_head & (ring->cq_entries - 1)];
+    spin_unlock(&ring->lock);
+
+    //the channel is shared with read, write and ioctl of the same file
+    //(and used by the capture while it runs)
+    mutex_lock(&client->lock);
+    res = dma_capture_busy(client) ? -EBUSY : dma_ring_do(client, &sqe);
+    mutex_unlock(&client->lock);
+
+    spin_lock(&ring->lock);
+    cqe = &ring->cq[ring->cq_tail & (ring->cq_entries - 1)];
+    cqe->user_data = sqe.user_data;
+    cqe->res = res;
+    cqe->reserved = 0;
+    smp_wmb(); //the completion must be visible before the new cq_tail
+    ring->cq_tail++;
+    ACCESS_ONCE(ring->hdr->cq_tail) = ring->cq_tail;
+    ring->pending_head++;
+    spin_unlock(&ring->lock);
+
+    wake_up_interruptible(&ring->wq);
+  }
+}
+
+//Completions written and not read yet by the application
+static unsigned int dma_ring_cq_ready(struct dma_ring *ring)
+{
+  return ring->cq_tail - ACCESS_ONCE(ring->hdr->cq_head);
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+long dma_ring_setup(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_ring_params params;
+  struct dma_ring *ring;
+
+  if (copy_from_user(&params, (void*) arg, sizeof(params)) != 0)
+    return -EFAULT;
+
+  if ((params.sq_entries == 0) || (params.sq_entries > DMA_PL330_RING_MAX_ENTRIES)
+    || !is_power_of_2(params.sq_entries))
+    return -EINVAL;
+
+  if (client->ring != NULL)
+    return -EBUSY;
+
+  ring = kzalloc(sizeof(struct dma_ring), GFP_KERNEL);
+  if (ring == NULL)
+    return -ENOMEM;
+
+  //layout of the memory shared with the application
+  params.cq_entries = 2*params.sq_entries;
+  params.sq_off = 64;
+  params.cq_off = params.sq_off + params.sq_entries*sizeof(struct dma_pl330_sqe);
+  params.ring_size = PAGE_ALIGN(params.cq_off +
+    params.cq_entries*sizeof(struct dma_pl330_cqe));
+  params.reserved = 0;
+
+  ring->mem = vmalloc_user(params.ring_size);
+  ring->pending = kmalloc(params.cq_entries*sizeof(struct dma_pl330_sqe), GFP_KERNEL);
+  if ((ring->mem == NULL) || (ring->pending == NULL))
+    goto error_alloc;
+
+  ring->client = client;
+  ring->mem_size = params.ring_size;
+  ring->hdr = (struct dma_pl330_ring_hdr*) ring->mem;
+  ring->sq = (struct dma_pl330_sqe*)((char*)ring->mem + params.sq_off);
+  ring->sq_entries = params.sq_entries;
+  ring->cq = (struct dma_pl330_cqe*)((char*)ring->mem + params.cq_off);
+  ring->cq_entries = params.cq_entries;
+  spin_lock_init(&ring->lock);
+  mutex_init(&ring->submit_lock);
+  INIT_WORK(&ring->work, dma_ring_work);
+  init_waitqueue_head(&ring->wq);
+
+  if (copy_to_user((void*) arg, &params, sizeof(params)) != 0)
+    goto error_alloc;
+
+  client->ring = ring;
+  return 0;
+
+error_alloc:
+  kfree(ring->pending);
+  vfree(ring->mem);
+  kfree(ring);
+  return -ENOMEM;
+}
+
+long dma_ring_enter(struct dma_client *client, unsigned long arg)
+{
+  struct dma_ring *ring = client->ring;
+  struct dma_pl330_ring_enter enter;
+  unsigned int sq_tail;
+  unsigned int available;
+  unsigned int in_use;
+  unsigned int submitted = 0;
+  int ret = 0;
+
+  if (ring == NULL)
+    return -EINVAL;
+
+  if (copy_from_user(&enter, (void*) arg, sizeof(enter)) != 0)
+    return -EFAULT;
+
+  mutex_lock(&ring->submit_lock);
+
+  //Copy the new descriptors to the pending list. There must be room for their
+  //completions in the CQ.
+  sq_tail = ACCESS_ONCE(ring->hdr->sq_tail);
+  smp_rmb(); //read the descriptors after sq_tail
+  available = sq_tail - ring->sq_head;
+  if (available > ring->sq_entries)
+  {
+    mutex_unlock(&ring->submit_lock);
+    return -EINVAL;
+  }
+  spin_lock(&ring->lock);
+  in_use = (ring->pending_tail - ring->pending_head) + dma_ring_cq_ready(ring);
+  spin_unlock(&ring->lock);
+  if (in_use > ring->cq_entries)
+    in_use = ring->cq_entries;
+  available = min(available, ring->cq_entries - in_use);
+  available = min(available, enter.to_submit);
+
+  while (submitted < available)
+  {
+    ring->pending[ring->pending_tail & (ring->cq_entries - 1)] =
+      ring->sq[ring->sq_head & (ring->sq_entries - 1)];
+    ring->sq_head++;
+    spin_lock(&ring->lock);
+    ring->pending_tail++;
+    spin_unlock(&ring->lock);
+    submitted++;
+  }
+  ACCESS_ONCE(ring->hdr->sq_head) = ring->sq_head;
+  if (submitted > 0)
+    schedule_work(&ring->work);
+
+  //Wait for completions. Never wait for more than can arrive.
+  if (enter.min_complete > 0)
+  {
+    spin_lock(&ring->lock);
+    in_use = (ring->pending_tail - ring->pending_head) + dma_ring_cq_ready(ring);
+    spin_unlock(&ring->lock);
+    if (enter.min_complete > in_use)
+      enter.min_complete = in_use;
+    ret = wait_event_interruptible(ring->wq,
+      dma_ring_cq_ready(ring) >= enter.min_complete);
+  }
+
+  mutex_unlock(&ring->submit_lock);
+
+  if (ret != 0)
+    return ret;
+  return submitted;
+}
+
+int dma_ring_mmap(struct dma_client *client, struct vm_area_struct *vma)
+{
+  struct dma_ring *ring = client->ring;
+
+  if (ring == NULL)
+    return -EINVAL;
+  if ((vma->vm_end - vma->vm_start) > ring->mem_size)
+    return -EINVAL;
+
+  return remap_vmalloc_range(vma, ring->mem, 0);
+}
+
+void dma_ring_release(struct dma_client *client)
+{
+  struct dma_ring *ring = client->ring;
+
+  if (ring == NULL)
+    return;
+
+  //Stop after the descriptor in execution
+  spin_lock(&ring->lock);
+  ring->stop = true;
+  spin_unlock(&ring->lock);
+  cancel_work_sync(&ring->work);
+
+  kfree(ring->pending);
+  vfree(ring->mem);
+  kfree(ring);
+  client->ring = NULL;
+}
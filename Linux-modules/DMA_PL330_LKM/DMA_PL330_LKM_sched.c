@@ -0,0 +1,198 @@
+/**
+ * @file    DMA_PL330_LKM_sched.c
+ * @brief  Arbitration of the transfers of the files with two priority classes.
+ *
+ * Each open file has its own channel, so the PL330 runs the transfers of all
+ * the files at the same time and shares its AXI master between them. A big
+ * frame moved by one file then slows down the small control messages of the
+ * other files. Each file has a class (see struct dma_pl330_config):
+ * -DMA_PL330_CLASS_LATENCY: the transfers start at once.
+ * -DMA_PL330_CLASS_BULK: while a transfer of the latency class is waiting or
+ *  running the transfers are split in slices of sched_slice_size Bytes.
+ *  Before each slice the file waits until no transfer of the latency class
+ *  is waiting or running, so a latency transfer only shares the DMAC with
+ *  the slices already started. To avoid starvation a slice does not wait
+ *  more than sched_max_wait_ms. Without latency transfers the rest of the
+ *  transfer is moved with one program, so bulk files pay the slices only
+ *  when there is someone to give way to.
+ * Bulk files do not wait for each other: the PL330 serves their channels in
+ * round robin.
+ *
+ * For each class the number of transfers waiting and running, the maximum
+ * waiting and the mean and maximum wait are exported in sysfs (sched_stats).
+ *
+ * read(), write(), ioctl(DMA_PL330_IOC_XFER), ioctl(DMA_PL330_IOC_XFER_P2P)
+ * and the ring go through the scheduler. read() and write() bigger than half
+ * the buffer of the file are not sliced again: each chunk of the pipeline is
+ * a slice.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>
+#include <linux/jiffies.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+#include <asm/div64.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES OF THE SCHEDULER---------------------//
+static unsigned int sched_slice_size = 64*1024;
+module_param(sched_slice_size, uint, 0644);
+MODULE_PARM_DESC(sched_slice_size, "Bytes of each slice of the bulk transfers (default 64kB, 0 no slices)");
+
+static int sched_max_wait_ms = 10;
+module_param(sched_max_wait_ms, int, 0644);
+MODULE_PARM_DESC(sched_max_wait_ms, "Max wait of a bulk slice for the latency transfers (default 10ms)");
+
+struct dma_sched_class {
+  unsigned int waiting;     //transfers waiting to start
+  unsigned int running;     //transfers started and not finished
+  unsigned int max_waiting;
+  unsigned int count;       //transfers started
+  u64 wait_ns;              //total time waiting to start
+  u64 max_wait_ns;
+};
+
+static struct dma_sched_class sched_classes[DMA_PL330_CLASS_NUM];
+static const char* sched_class_names[DMA_PL330_CLASS_NUM] =
+  {"latency", "bulk"};
+static DEFINE_SPINLOCK(sched_lock);
+static DECLARE_WAIT_QUEUE_HEAD(sched_wq);
+
+//-------------------------------FUNCTIONS-------------------------------//
+static bool dma_sched_bulk_can_run(void)
+{
+  return (ACCESS_ONCE(sched_classes[DMA_PL330_CLASS_LATENCY].waiting) == 0) &&
+    (ACCESS_ONCE(sched_classes[DMA_PL330_CLASS_LATENCY].running) == 0);
+}
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+//Wait until a transfer of the class of the client can start. Called with
+//client->lock taken, before starting the channel.
+void dma_sched_enter(struct dma_client *client)
+{
+  struct dma_sched_class *c = &sched_classes[client->sched_class];
+  ktime_t start = ktime_get();
+  u64 wait;
+
+  spin_lock(&sched_lock);
+  c->waiting++;
+  if (c->waiting > c->max_waiting)
+    c->max_waiting = c->waiting;
+  spin_unlock(&sched_lock);
+
+  if (client->sched_class == DMA_PL330_CLASS_BULK)
+    wait_event_timeout(sched_wq, dma_sched_bulk_can_run(),
+      msecs_to_jiffies(sched_max_wait_ms));
+
+  wait = ktime_to_ns(ktime_sub(ktime_get(), start));
+  spin_lock(&sched_lock);
+  c->waiting--;
+  c->running++;
+  c->count++;
+  c->wait_ns += wait;
+  if (wait > c->max_wait_ns)
+    c->max_wait_ns = wait;
+  spin_unlock(&sched_lock);
+}
+
+//The transfer started with dma_sched_enter() finished
+void dma_sched_leave(struct dma_client *client)
+{
+  struct dma_sched_class *c = &sched_classes[client->sched_class];
+  bool wake;
+
+  spin_lock(&sched_lock);
+  c->running--;
+  wake = (client->sched_class == DMA_PL330_CLASS_LATENCY) &&
+    (c->running == 0) && (c->waiting == 0);
+  spin_unlock(&sched_lock);
+  if (wake)
+    wake_up(&sched_wq);
+}
+
+//Move size Bytes from src to dst in the channel of the client and wait for
+//it. Transfers of the bulk class are split in slices while there are
+//latency transfers, and any transfer bigger than one program (see
+//dma_burst_max_len()) in several programs. Called with client->lock taken.
+ALT_STATUS_CODE dma_sched_xfer(struct dma_client *client,
+  ALT_DMA_PROGRAM_t* progv, ALT_DMA_PROGRAM_t* progh, void* dst,
+  const void* src, size_t size)
+{
+  ALT_STATUS_CODE status = ALT_E_SUCCESS;
+  ALT_DMA_BURST_t burst;
+  size_t max_len;
+  size_t done = 0;
+  size_t n;
+  u32 t;
+
+  dma_burst_select(client, dst, src, &burst);
+  max_len = dma_burst_max_len(&burst);
+
+  while ((done < size) && (status == ALT_E_SUCCESS))
+  {
+    n = size - done;
+    if ((client->sched_class == DMA_PL330_CLASS_BULK) &&
+      (sched_slice_size != 0) && (n > sched_slice_size) &&
+      !dma_sched_bulk_can_run())
+      n = sched_slice_size;
+    if (n > max_len)
+      n = max_len;
+
+    dma_sched_enter(client);
+    arm_dma_completion(client->channel);
+    status = dma_prog_cache_exec(client, progv, progh, (char*) dst + done,
+      (const char*) src + done, n);
+    t = dma_stats_start();
+    status = wait_dma_transfer(client->channel, status);
+    dma_stats_end(DMA_STAGE_WAIT, n, t);
+    dma_prog_cache_done(client);
+    dma_sched_leave(client);
+    done += n;
+  }
+  return status;
+}
+
+//Read of the sysfs entry sched_stats
+ssize_t dma_sched_show(char *buf)
+{
+  struct dma_sched_class c;
+  u64 mean;
+  int len = 0;
+  int i;
+
+  len += sprintf(buf, "class waiting running max_waiting count mean_wait_ns max_wait_ns\n");
+  for (i = 0; i < DMA_PL330_CLASS_NUM; i++)
+  {
+    spin_lock(&sched_lock);
+    c = sched_classes[i];
+    spin_unlock(&sched_lock);
+    mean = c.wait_ns;
+    if (c.count > 0)
+      do_div(mean, c.count);
+    len += sprintf(buf + len, "%s %u %u %u %u %llu %llu\n",
+      sched_class_names[i], c.waiting, c.running, c.max_waiting, c.count,
+      mean, c.max_wait_ns);
+  }
+  return len;
+}
+
+//Write to the sysfs entry sched_stats: reset the statistics (not the
+//transfers waiting and running)
+void dma_sched_reset(void)
+{
+  int i;
+
+  spin_lock(&sched_lock);
+  for (i = 0; i < DMA_PL330_CLASS_NUM; i++)
+  {
+    sched_classes[i].max_waiting = sched_classes[i].waiting;
+    sched_classes[i].count = 0;
+    sched_classes[i].wait_ns = 0;
+    sched_classes[i].max_wait_ns = 0;
+  }
+  spin_unlock(&sched_lock);
+}
@@ -0,0 +1,323 @@
+/**
+ * @file    DMA_PL330_LKM_sg.c
+ * @brief  Scatter-gather transfers between buffers of the application and the
+ * FPGA (ioctl DMA_PL330_IOC_XFER_USER).
+ *
+ * The pages of the buffer of the application are pinned with
+ * get_user_pages() and a DMA program with one segment per physically
+ * contiguous run of pages is built with alt_dma_memory_to_memory_append().
+ * There is no copy to the staging buffers and the size of the transfer is not
+ * limited by their size. When the program buffer is full the program is
+ * executed and a new one is started, so any number of runs can be moved.
+ *
+ * The buffer is pinned in chunks of DMA_SG_CHUNK_PAGES pages to limit the
+ * memory used to store the page pointers.
+ *
+ * When use_acp=1 in the configuration of the file (or use_acp=2 and the
+ * transfer is smaller than acp_crossover) the DMAC accesses the pages
+ * through ACP (physical address + 0x80000000) so no cache maintenance is
+ * needed. Otherwise the pages are mapped with dma_map_page(), that cleans or
+ * invalidates the caches.
+*/
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/sched.h>
+#include <linux/pagemap.h>
+#include <linux/dma-mapping.h>
+#include <asm/uaccess.h>
+
+#include "dma_pl330_ioctl.h"
+#include "DMA_PL330_LKM.h"
+
+//-----------------------------MACROS------------------------------------//
+//Pages pinned at once (2MB). A segment is never longer than a chunk, so it
+//always fits in an empty program (dma_burst_max_len() is 2MB or more).
+#define DMA_SG_CHUNK_PAGES 512
+//ACP only sees the first GB of SDRAM
+#define DMA_SG_ACP_OFFSET 0x80000000
+#define DMA_SG_ACP_WINDOW 0x40000000
+
+//------------------VARIABLES FOR ONE SCATTER-GATHER TRANSFER------------//
+struct dma_sg_xfer {
+  struct dma_client *client;
+  ALT_DMA_PROGRAM_t* prog_v; //program used (write or read program of the file)
+  ALT_DMA_PROGRAM_t* prog_h;
+  uint32_t dir;              //DMA_PL330_DIR_TO_FPGA or DMA_PL330_DIR_FROM_FPGA
+  uint32_t fpga_padd;        //FPGA address of the next segment
+  int segments;              //segments in the program not executed yet
+  size_t size;               //Bytes in the program not executed yet
+  int acp;                   //access the pages through ACP
+  struct page **pages;       //pinned pages of the current chunk
+  dma_addr_t *pages_h;       //hardware address of each pinned page
+};
+
+//-------------------------------FUNCTIONS-------------------------------//
+//Finish the program, execute it and wait for it. A new empty program is left.
+static int dma_sg_run(struct dma_sg_xfer *sg)
+{
+  ALT_STATUS_CODE status;
+  u32 t;
+
+  if (sg->segments == 0)
+    return 0;
+
+  arm_dma_completion(sg->client->channel);
+  t = dma_stats_start();
+  status = alt_dma_memory_to_memory_finish(sg->client->channel, sg->prog_v,
+    sg->prog_h, dma_irq_ok, (ALT_DMA_EVENT_t) sg->client->channel);
+  dma_stats_end(DMA_STAGE_EXEC, sg->size, t);
+  t = dma_stats_start();
+  status = wait_dma_transfer(sg->client->channel, status);
+  dma_stats_end(DMA_STAGE_WAIT, sg->size, t);
+
+  alt_dma_program_init(sg->prog_v);
+  sg->segments = 0;
+  sg->size = 0;
+  if (status != ALT_E_SUCCESS)
+    return -EIO;
+  return 0;
+}
+
+//Add a segment for a physically contiguous run of the buffer with the burst
+//profile of its addresses. If the program is full it is executed first.
+static int dma_sg_add(struct dma_sg_xfer *sg, dma_addr_t run_h, uint32_t len)
+{
+  ALT_DMA_BURST_t burst;
+  ALT_STATUS_CODE status;
+  void* dst;
+  void* src;
+  int ret;
+  u32 t;
+
+  if (sg->dir == DMA_PL330_DIR_TO_FPGA)
+  {
+    dst = (void*) sg->fpga_padd;
+    src = (void*) run_h;
+  }
+  else
+  {
+    dst = (void*) run_h;
+    src = (void*) sg->fpga_padd;
+  }
+
+  dma_burst_select(sg->client, dst, src, &burst);
+  t = dma_stats_start();
+  status = alt_dma_memory_to_memory_append_burst(sg->prog_v, dst, src, len,
+    &burst);
+  dma_stats_end(DMA_STAGE_PREPARE, len, t);
+  if ((status == ALT_E_BUF_OVF) && (sg->segments > 0))
+  {
+    ret = dma_sg_run(sg);
+    if (ret != 0)
+      return ret;
+    t = dma_stats_start();
+    status = alt_dma_memory_to_memory_append_burst(sg->prog_v, dst, src, len,
+      &burst);
+    dma_stats_end(DMA_STAGE_PREPARE, len, t);
+  }
+  if (status != ALT_E_SUCCESS)
+  {
+    printk(KERN_INFO "DMA LKM: could not add segment of %u Bytes to program\n",
+      len);
+    return -EIO;
+  }
+
+  sg->segments++;
+  sg->size += len;
+  sg->fpga_padd += len;
+  return 0;
+}
+
+//Get the hardware address of the pinned pages of the chunk
+static int dma_sg_map_pages(struct dma_sg_xfer *sg, int npages)
+{
+  enum dma_data_direction dma_dir = (sg->dir == DMA_PL330_DIR_TO_FPGA) ?
+    DMA_TO_DEVICE : DMA_FROM_DEVICE;
+  phys_addr_t padd;
+  int i;
+
+  for (i = 0; i < npages; i++)
+  {
+    if (sg->acp)
+    {
+      padd = page_to_phys(sg->pages[i]);
+      if (padd >= DMA_SG_ACP_WINDOW)
+      {
+        printk(KERN_INFO "DMA LKM: page in 0x%x not reachable through ACP\n",
+          (unsigned int) padd);
+        return -EINVAL;
+      }
+      sg->pages_h[i] = padd + DMA_SG_ACP_OFFSET;
+    }
+    else
+    {
+      sg->pages_h[i] = dma_map_page(NULL, sg->pages[i], 0, PAGE_SIZE, dma_dir);
+      if (dma_mapping_error(NULL, sg->pages_h[i]))
+      {
+        while (--i >= 0)
+          dma_unmap_page(NULL, sg->pages_h[i], PAGE_SIZE, dma_dir);
+        return -ENOMEM;
+      }
+    }
+  }
+  return 0;
+}
+
+static void dma_sg_unmap_pages(struct dma_sg_xfer *sg, int npages)
+{
+  enum dma_data_direction dma_dir = (sg->dir == DMA_PL330_DIR_TO_FPGA) ?
+    DMA_TO_DEVICE : DMA_FROM_DEVICE;
+  int i;
+
+  if (sg->acp)
+    return;
+  for (i = 0; i < npages; i++)
+    dma_unmap_page(NULL, sg->pages_h[i], PAGE_SIZE, dma_dir);
+}
+
+//Transfer one chunk of pinned pages. offset is the position of the data in
+//the first page.
+static int dma_sg_chunk(struct dma_sg_xfer *sg, int npages,
+  unsigned int offset, uint32_t len)
+{
+  dma_addr_t run_h = 0;   //start of the current contiguous run
+  uint32_t run_len = 0;   //size of the current contiguous run
+  dma_addr_t page_h;
+  uint32_t page_len;
+  int ret;
+  int i;
+
+  ret = dma_sg_map_pages(sg, npages);
+  if (ret != 0)
+    return ret;
+
+  for (i = 0; (i < npages) && (ret == 0); i++)
+  {
+    page_h = sg->pages_h[i] + offset;
+    page_len = min_t(uint32_t, PAGE_SIZE - offset, len);
+    offset = 0;
+    len -= page_len;
+
+    //merge pages physically contiguous in one segment
+    if ((run_len > 0) && (page_h == run_h + run_len))
+    {
+      run_len += page_len;
+      continue;
+    }
+    if (run_len > 0)
+      ret = dma_sg_add(sg, run_h, run_len);
+    run_h = page_h;
+    run_len = page_len;
+  }
+  if ((ret == 0) && (run_len > 0))
+    ret = dma_sg_add(sg, run_h, run_len);
+  //the pages are released after this chunk so its program must be executed
+  if (ret == 0)
+    ret = dma_sg_run(sg);
+
+  dma_sg_unmap_pages(sg, npages);
+  return ret;
+}
+
+//-------------------FUNCTIONS CALLED FROM DMA_PL330_LKM.c------------------//
+long dma_sg_xfer_user(struct dma_client *client, unsigned long arg)
+{
+  struct dma_pl330_xfer_user xfer;
+  struct dma_sg_xfer sg;
+  unsigned long uaddr;
+  unsigned int offset;
+  uint32_t done = 0;
+  uint32_t chunk_len;
+  int npages;
+  int pinned;
+  int write;
+  int ret = 0;
+  int i;
+
+  if (mock_dma)
+    return -ENODEV;
+
+  if (copy_from_user(&xfer, (void*) arg, sizeof(xfer)) != 0)
+    return -EFAULT;
+
+  if ((xfer.dir != DMA_PL330_DIR_TO_FPGA) &&
+    (xfer.dir != DMA_PL330_DIR_FROM_FPGA))
+    return -EINVAL;
+  if (xfer.len == 0)
+    return 0;
+  if (xfer.addr + xfer.len < xfer.addr)
+    return -EINVAL;
+
+  sg.client = client;
+  sg.dir = xfer.dir;
+  if (client_fpga_addr(client, xfer.fpga_addr, xfer.len, &sg.fpga_padd) != 0)
+    return -EINVAL;
+  sg.segments = 0;
+  sg.size = 0;
+  sg.acp = client->use_acp;
+  if (client->use_acp == USE_ACP_AUTO)
+  {
+    sg.acp = dma_acp_auto(xfer.len);
+    dma_acp_count(sg.acp);
+  }
+  sg.pages = kmalloc(DMA_SG_CHUNK_PAGES * sizeof(struct page*), GFP_KERNEL);
+  sg.pages_h = kmalloc(DMA_SG_CHUNK_PAGES * sizeof(dma_addr_t), GFP_KERNEL);
+  if ((sg.pages == NULL) || (sg.pages_h == NULL))
+  {
+    ret = -ENOMEM;
+    goto out_free;
+  }
+  //the DMA writes the pages when reading from the FPGA
+  write = (xfer.dir == DMA_PL330_DIR_FROM_FPGA);
+
+  mutex_lock(&client->lock);
+  if (xfer.dir == DMA_PL330_DIR_TO_FPGA)
+  {
+    sg.prog_v = client->prog_wr_v;
+    sg.prog_h = client->prog_wr_h;
+  }
+  else
+  {
+    sg.prog_v = client->prog_rd_v;
+    sg.prog_h = client->prog_rd_h;
+  }
+  alt_dma_program_init(sg.prog_v);
+  client->prog_prepared = false; //the slot of the channel is overwritten
+
+  while (done < xfer.len)
+  {
+    uaddr = (unsigned long) xfer.addr + done;
+    offset = uaddr & ~PAGE_MASK;
+    chunk_len = min_t(uint32_t, xfer.len - done,
+      DMA_SG_CHUNK_PAGES * PAGE_SIZE - offset);
+    npages = (offset + chunk_len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+
+    down_read(&current->mm->mmap_sem);
+    pinned = get_user_pages(current, current->mm, uaddr & PAGE_MASK, npages,
+      write, 0, sg.pages, NULL);
+    up_read(&current->mm->mmap_sem);
+
+    if (pinned == npages)
+      ret = dma_sg_chunk(&sg, npages, offset, chunk_len);
+    else
+      ret = -EFAULT;
+
+    for (i = 0; i < pinned; i++)
+    {
+      if (write && (ret == 0))
+        set_page_dirty_lock(sg.pages[i]);
+      page_cache_release(sg.pages[i]);
+    }
+    if (ret != 0)
+      break;
+    done += chunk_len;
+  }
+
+  mutex_unlock(&client->lock);
+
+out_free:
+  kfree(sg.pages);
+  kfree(sg.pages_h);
+  return ret;
+}
@@ -0,0 +1,214 @@
+/**
+ * @file    DMA_PL330_LKM_stats.c
+ * @brief  Latency histograms of the stages of the transfers, exported in
+ * debugfs (/sys/kernel/debug/dma_pl330/).
+ *
+ * The stages measured are:
+ * -prepare: generation of the microcode (alt_dma_*_prepare_program).
+ * -exec: start of the channel (alt_dma_channel_exec).
+ * -wait: wait for the end of the transfer (wait_dma_transfer).
+ * -copy: copy_from_user() and copy_to_user() in write() and read().
+ * The time is measured with the cycle counter of the Cortex-A9 (PMCCNTR), so
+ * all values are in CPU cycles. For each stage and size class of the transfer
+ * the minimum, mean and maximum are kept together with a histogram with
+ * log2 buckets (bucket n counts the times between 2^(n-1) and 2^n-1 cycles).
+ *
+ * There is one file per stage. Reading it prints the statistics and writing
+ * anything to it resets them.
+ *
+ * The cycle counters of the two CPUs are enabled at the same time when the
+ * module is inserted but they are not synchronized, so a stage that sleeps
+ * and continues in the other CPU (wait in irq mode) can get a small error.
+*/
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/smp.h>
+#include <linux/string.h>
+
+#include "DMA_PL330_LKM.h"
+
+//------------------------VARIABLES FOR THE STATISTICS-------------------//
+static int stats_enable = 1;
+module_param(stats_enable, int, 0644);
+MODULE_PARM_DESC(stats_enable, "Measure the stages of the transfers in debugfs (default 1)");
+
+//Size classes: up to 4kB, up to 64kB, up to 1MB and bigger
+#define DMA_STATS_CLASSES 4
+static const char* dma_stats_class_names[DMA_STATS_CLASSES] =
+  {"<=4kB", "<=64kB", "<=1MB", ">1MB"};
+static const char* dma_stats_stage_names[DMA_STAGE_NUM] =
+  {"prepare", "exec", "wait", "copy"};
+#define DMA_STATS_BUCKETS 33 //log2 of a 32 bit value (0 to 32)
+
+struct dma_stats {
+  u32 count;
+  u32 min;
+  u32 max;
+  u64 sum;
+  u32 hist[DMA_STATS_BUCKETS];
+};
+
+static struct dma_stats dma_stats[DMA_STAGE_NUM][DMA_STATS_CLASSES];
+static DEFINE_SPINLOCK(dma_stats_lock);
+static struct dentry *dma_stats_dir;
+
+//-----------------------------CYCLE COUNTER-----------------------------//
+//Enable PMCCNTR counting every cycle (PMCR.E=1, PMCR.D=0, PMCNTENSET.C=1).
+//The counter is not reset so other users (i.e. perf) are not disturbed.
+static void dma_stats_enable_ccnt(void *info)
+{
+  u32 pmcr;
+
+  asm volatile("mrc p15, 0, %0, c9, c12, 0" : "=r" (pmcr));
+  pmcr = (pmcr | 0x1) & ~0x8;
+  asm volatile("mcr p15, 0, %0, c9, c12, 0" : : "r" (pmcr));
+  asm volatile("mcr p15, 0, %0, c9, c12, 1" : : "r" (0x80000000));
+}
+
+static inline u32 dma_stats_ccnt(void)
+{
+  u32 ccnt;
+
+  asm volatile("mrc p15, 0, %0, c9, c13, 0" : "=r" (ccnt));
+  return ccnt;
+}
+
+static int dma_stats_class(size_t size)
+{
+  if (size <= 4*1024)
+    return 0;
+  if (size <= 64*1024)
+    return 1;
+  if (size <= 1024*1024)
+    return 2;
+  return 3;
+}
+
+static void dma_stats_reset(int stage)
+{
+  int c;
+
+  spin_lock(&dma_stats_lock);
+  memset(dma_stats[stage], 0, sizeof(dma_stats[stage]));
+  for (c = 0; c < DMA_STATS_CLASSES; c++)
+    dma_stats[stage][c].min = 0xFFFFFFFF;
+  spin_unlock(&dma_stats_lock);
+}
+
+//-----------------------------DEBUGFS FILES-----------------------------//
+static int dma_stats_show(struct seq_file *m, void *v)
+{
+  int stage = (int) m->private;
+  struct dma_stats st;
+  u64 mean;
+  int c;
+  int b;
+
+  seq_printf(m, "%s (CPU cycles)\n", dma_stats_stage_names[stage]);
+  for (c = 0; c < DMA_STATS_CLASSES; c++)
+  {
+    spin_lock(&dma_stats_lock);
+    st = dma_stats[stage][c];
+    spin_unlock(&dma_stats_lock);
+
+    if (st.count == 0)
+      continue;
+    mean = st.sum;
+    do_div(mean, st.count);
+    seq_printf(m, "size %s: count=%u min=%u mean=%llu max=%u\n",
+      dma_stats_class_names[c], st.count, st.min, mean, st.max);
+    for (b = 0; b < DMA_STATS_BUCKETS; b++)
+    {
+      if (st.hist[b] == 0)
+        continue;
+      seq_printf(m, "  [%u-%u]: %u\n", (b == 0) ? 0 : (1u << (b-1)),
+        (b == 32) ? 0xFFFFFFFF : ((1u << b) - 1), st.hist[b]);
+    }
+  }
+  return 0;
+}
+
+static int dma_stats_open(struct inode *inode, struct file *file)
+{
+  return single_open(file, dma_stats_show, inode->i_private);
+}
+
+static ssize_t dma_stats_write(struct file *file, const char *buf,
+  size_t count, loff_t *ppos)
+{
+  struct seq_file *m = file->private_data;
+
+  dma_stats_reset((int) m->private);
+  return count;
+}
+
+static const struct file_operations dma_stats_fops = {
+  .owner = THIS_MODULE,
+  .open = dma_stats_open,
+  .read = seq_read,
+  .write = dma_stats_write,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+//-------------------FUNCTIONS CALLED FROM OTHER FILES-------------------//
+int dma_stats_init(void)
+{
+  int stage;
+
+  for (stage = 0; stage < DMA_STAGE_NUM; stage++)
+    dma_stats_reset(stage);
+  on_each_cpu(dma_stats_enable_ccnt, NULL, 1);
+
+  dma_stats_dir = debugfs_create_dir("dma_pl330", NULL);
+  if (dma_stats_dir == NULL)
+  {
+    //the driver works without the statistics
+    printk(KERN_INFO "DMA LKM: could not create debugfs directory\n");
+    return -ENODEV;
+  }
+  for (stage = 0; stage < DMA_STAGE_NUM; stage++)
+    debugfs_create_file(dma_stats_stage_names[stage], 0644, dma_stats_dir,
+      (void*) stage, &dma_stats_fops);
+  return 0;
+}
+
+void dma_stats_uninit(void)
+{
+  debugfs_remove_recursive(dma_stats_dir);
+  dma_stats_dir = NULL;
+}
+
+//Time stamp of the start of a stage
+u32 dma_stats_start(void)
+{
+  if (!stats_enable)
+    return 0;
+  return dma_stats_ccnt();
+}
+
+//Add the time since start to the statistics of the stage
+void dma_stats_end(int stage, size_t size, u32 start)
+{
+  struct dma_stats *st;
+  u32 cycles;
+
+  if (!stats_enable)
+    return;
+  cycles = dma_stats_ccnt() - start;
+
+  st = &dma_stats[stage][dma_stats_class(size)];
+  spin_lock(&dma_stats_lock);
+  st->count++;
+  st->sum += cycles;
+  if (cycles < st->min)
+    st->min = cycles;
+  if (cycles > st->max)
+    st->max = cycles;
+  st->hist[fls(cycles)]++;
+  spin_unlock(&dma_stats_lock);
+}
@@ -137,6 +137,31 @@ static void* sysmgr_vaddress;
 // alt_dma_memory_to_memory_segment() is used inside 
 // alt_dma_memory_to_memory_only_prepare_program() and inside
 // alt_dma_memory_to_memory() to prepare DMAC program in memory.
+//
+//4.alt_dma_zero_to_memory_segment() and alt_dma_zero_to_memory() were
+// uncommented. alt_dma_zero_to_memory() receives the virtual and hardware
+// addresses of the program and the hardware address of the buffer (no MMU
+// coalescing), as alt_dma_memory_to_memory(). ALT_DMA_CCR_OPT_SC_DEFAULT and
+// ALT_DMA_CCR_OPT_DC(7) were changed by ALT_DMA_RC_ON and ALT_DMA_WC_ON.
+//
+//5.alt_dma_memory_to_memory_segment() uses LOOP0 and LOOP1 nested (as
+// alt_dma_memory_to_register_segment()) for more than 256 bursts of 16x8
+// Bytes, instead of one DMALP block per 32kB. The program of a 2MB transfer
+// has 1 block instead of 64, so it fits in the microcode slots and in the
+// instruction cache of the channel. Each block (about 10 bytes) moves up to
+// 65536 bursts, so with bursts of 16x8 bytes one program of
+// ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE (512 bytes) moves about 360MB with
+// the worst alignment (45 blocks).
+//
+//6.alt_dma_memory_to_memory_patch() was added. It changes only the SAR and
+// DAR of a prepared program (with alt_dma_program_update_reg()) to reuse it
+// for a transfer of the same size.
+//
+//7.alt_dma_memory_to_memory_segment() receives the size and length of the
+// bursts (ALT_DMA_BURST_t) instead of using always 16 beats of 8 bytes.
+// alt_dma_memory_to_memory_only_prepare_program_burst() and
+// alt_dma_memory_to_memory_append_burst() were added to select them. The
+// other functions use 16 beats of 8 bytes as before.
 //--------------------------------------------------------------//
 
 //#if defined(soc_a10)
@@ -1102,7 +1127,7 @@ ALT_STATUS_CODE alt_dma_channel_fault_status_get(ALT_DMA_CHANNEL_t channel,
     return ALT_E_SUCCESS;
 }
 
-/*ALT_STATUS_CODE alt_dma_event_int_select(ALT_DMA_EVENT_t evt_num,
+ALT_STATUS_CODE alt_dma_event_int_select(ALT_DMA_EVENT_t evt_num,
                                          ALT_DMA_EVENT_SELECT_t opt)
 {
     // Validate evt_num /
@@ -1137,7 +1162,7 @@ ALT_STATUS_CODE alt_dma_channel_fault_status_get(ALT_DMA_CHANNEL_t channel,
     }
 
     return ALT_E_SUCCESS;
-}*/
+}
 
 /*ALT_STATUS_CODE alt_dma_event_int_status_get_raw(ALT_DMA_EVENT_t evt_num)
 {
@@ -1174,7 +1199,7 @@ ALT_STATUS_CODE alt_dma_channel_fault_status_get(ALT_DMA_CHANNEL_t channel,
     }
 }*/
 
-/*ALT_STATUS_CODE alt_dma_int_status_get(ALT_DMA_EVENT_t irq_num)
+ALT_STATUS_CODE alt_dma_int_status_get(ALT_DMA_EVENT_t irq_num)
 {
     uint32_t int_status;
 
@@ -1207,9 +1232,9 @@ ALT_STATUS_CODE alt_dma_channel_fault_status_get(ALT_DMA_CHANNEL_t channel,
     {
         return ALT_E_FALSE;
     }
-}*/
+}
 
-/*ALT_STATUS_CODE alt_dma_int_clear(ALT_DMA_EVENT_t irq_num)
+ALT_STATUS_CODE alt_dma_int_clear(ALT_DMA_EVENT_t irq_num)
 {
     // Validate evt_num //
     switch (irq_num)
@@ -1233,17 +1258,40 @@ ALT_STATUS_CODE alt_dma_channel_fault_status_get(ALT_DMA_CHANNEL_t channel,
     alt_write_word(ALT_DMA_INTCLR_ADDR(ALT_DMASECURE_ADDR), 1 << irq_num);
 
     return ALT_E_SUCCESS;
-}*/
+}
+
+// Burst used by the functions without burst argument: beats of 8 bytes in
+// bursts of 16 beats. //
+static const ALT_DMA_BURST_t alt_dma_burst_default = { 8, 16 };
 
 static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * program,
 							uintptr_t segdstpa,
                                                         uintptr_t segsrcpa,
-                                                        size_t segsize)
+                                                        size_t segsize,
+                                                        const ALT_DMA_BURST_t * burst)
 {
     uint32_t burstcount;
     bool correction;
     size_t sizeleft = segsize;
     ALT_STATUS_CODE status = ALT_E_SUCCESS;
+    uint32_t width = burst->size;     // bytes of each beat
+    uint32_t wmask = width - 1;
+    uint32_t length = burst->length;  // beats of each burst
+    uint32_t sizecode;                // SS and DS fields of the CCR
+
+    switch (width)
+    {
+    case 1: sizecode = 0; break;
+    case 2: sizecode = 1; break;
+    case 4: sizecode = 2; break;
+    case 8: sizecode = 3; break;
+    default:
+        return ALT_E_BAD_ARG;
+    }
+    if ((length < 1) || (length > 16))
+    {
+        return ALT_E_BAD_ARG;
+    }
 
     if (status == ALT_E_SUCCESS)
     {
@@ -1259,10 +1307,10 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
      // It is extended for 2-byte and 1-byte unaligned cases.
      ///
 
-    /// First see how many byte(s) we need to transfer to get src to be 8 byte aligned //
-    if (segsrcpa & 0x7)
+    /// First see how many byte(s) we need to transfer to get src to be [width] byte aligned //
+    if (segsrcpa & wmask)
     {
-        uint32_t aligncount = ALT_MIN(8 - (segsrcpa & 0x7), sizeleft);
+        uint32_t aligncount = ALT_MIN(width - (segsrcpa & wmask), sizeleft);
         sizeleft -= aligncount;
 
         //dprintf("DMA[M->M][seg]: Total pre-alignment 1-byte burst size transfer(s): %" PRIu32 ".\n", aligncount);
@@ -1307,39 +1355,39 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         }
     }
 
-    // This is the number of 8-byte bursts //
-    burstcount = sizeleft >> 3;
+    // This is the number of [width]-byte beats //
+    burstcount = sizeleft / width;
 
     // If bursting was done and src and dst are not mod-8 congruent, we need to
     // correct for some data left over in the MFIFO due to unaligment issues. //
-    correction = (burstcount != 0) && ((segsrcpa & 0x7) != (segdstpa & 0x7));
+    correction = (burstcount != 0) && ((segsrcpa & wmask) != (segdstpa & wmask));
 
     // Update the size left to transfer //
-    sizeleft &= 0x7;
+    sizeleft &= wmask;
 
     //dprintf("DMA[M->M][seg]: Total Main 8-byte burst size transfer(s): %" PRIu32 ".\n", burstcount);
     #ifdef PRINT_K
     dprintf("DMA[M->M][seg]: Total Main 8-byte burst size transfer(s): %u.\n", burstcount);
     #endif
-    // Determine how many 16 length bursts can be done //
+    // Determine how many [length] length bursts can be done //
 
-    if (burstcount >> 4)
+    if (burstcount >= length)
     {
-        uint32_t length16burstcount = burstcount >> 4;
-        burstcount &= 0xf;
+        uint32_t lengthburstcount = burstcount / length;
+        burstcount %= length;
 
-        //dprintf("DMA[M->M][seg]:   Number of 16 burst length 8-byte transfer(s): %" PRIu32 ".\n", length16burstcount);
+        //dprintf("DMA[M->M][seg]:   Number of 16 burst length 8-byte transfer(s): %" PRIu32 ".\n", lengthburstcount);
         //dprintf("DMA[M->M][seg]:   Number of remaining 8-byte transfer(s):       %" PRIu32 ".\n", burstcount);
 	#ifdef PRINT_K
-    dprintf("DMA[M->M][seg]:   Number of 16 burst length 8-byte transfer(s): %u .\n", length16burstcount);
+    dprintf("DMA[M->M][seg]:   Number of %u burst length %u-byte transfer(s): %u .\n", length, width, lengthburstcount);
         dprintf("DMA[M->M][seg]:   Number of remaining 8-byte transfer(s):       %u .\n", burstcount);
 	#endif
 	
         // Program in the following parameters:
-        //  - SS64  : Source      burst size of 8-byte
-        //  - DS64  : Destination burst size of 8-byte
-        //  - SB16  : Source      burst length of 16 transfers
-        //  - DB16  : Destination burst length of 16 transfers
+        //  - SSx   : Source      burst size of [width] bytes
+        //  - DSx   : Destination burst size of [width] bytes
+        //  - SBx   : Source      burst length of [length] transfers
+        //  - DBx   : Destination burst length of [length] transfers
         //  - SC(7) : Source      cacheable write-back, allocate on reads only
         //  - DC(7) : Destination cacheable write-back, allocate on writes only
         //  - All other options default. //
@@ -1347,14 +1395,14 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         if (status == ALT_E_SUCCESS)
         {
             status = alt_dma_program_DMAMOV(program, ALT_DMA_PROGRAM_REG_CCR,
-                                            (   ALT_DMA_CCR_OPT_SB16
-                                              | ALT_DMA_CCR_OPT_SS64
+                                            (   ((length - 1) << 4) // SB //
+                                              | (sizecode << 1) // SS //
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
                                               //| ALT_DMA_CCR_OPT_SC(7)
                                               | ALT_DMA_RC_ON
-                                              | ALT_DMA_CCR_OPT_DB16
-                                              | ALT_DMA_CCR_OPT_DS64
+                                              | ((length - 1) << 18) // DB //
+                                              | (sizecode << 15) // DS //
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
                                              // | ALT_DMA_CCR_OPT_DC(7)
@@ -1364,20 +1412,62 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
                 );
         }
 
-        while (length16burstcount > 0)
+        // Blocks of 256 x 256 bursts are done with LOOP0 and LOOP1 nested
+        // (super loop), so each 8MB of data (with 16 beats of 8 bytes) adds
+        // only one block to the program instead of 256. //
+        if (lengthburstcount >> 8)
         {
-            uint32_t loopcount = ALT_MIN(length16burstcount, 256);
-            if (status != ALT_E_SUCCESS)
+            uint32_t loop256lengthburstcount = lengthburstcount >> 8;
+            lengthburstcount &= 0xff;
+
+            while (loop256lengthburstcount > 0)
             {
-                break;
+                uint32_t loopcount = ALT_MIN(loop256lengthburstcount, 256);
+                loop256lengthburstcount -= loopcount;
+
+                if (status != ALT_E_SUCCESS)
+                {
+                    break;
+                }
+
+                #ifdef PRINT_K
+                dprintf("DMA[M->M][seg]:   Looping %x super loop transfer(s).\n", loopcount);
+                #endif
+                if ((status == ALT_E_SUCCESS) && (loopcount > 1))
+                {
+                    status = alt_dma_program_DMALP(program, loopcount);
+                }
+                if (status == ALT_E_SUCCESS)
+                {
+                    status = alt_dma_program_DMALP(program, 256);
+                }
+                if (status == ALT_E_SUCCESS)
+                {
+                    status = alt_dma_program_DMALD(program, ALT_DMA_PROGRAM_INST_MOD_NONE);
+                }
+                if (status == ALT_E_SUCCESS)
+                {
+                    status = alt_dma_program_DMAST(program, ALT_DMA_PROGRAM_INST_MOD_NONE);
+                }
+                if (status == ALT_E_SUCCESS)
+                {
+                    status = alt_dma_program_DMALPEND(program, ALT_DMA_PROGRAM_INST_MOD_NONE);
+                }
+                if ((status == ALT_E_SUCCESS) && (loopcount > 1))
+                {
+                    status = alt_dma_program_DMALPEND(program, ALT_DMA_PROGRAM_INST_MOD_NONE);
+                }
             }
+        }
 
-            length16burstcount -= loopcount;
+        // The super loop above ensures that the lengthburstcount is below 256. //
+        if (lengthburstcount > 0)
+        {
+            uint32_t loopcount = lengthburstcount;
 
-            //dprintf("DMA[M->M][seg]:   Looping %" PRIu32 "x 16 burst length 8-byte transfer(s).\n", loopcount);
-	    #ifdef PRINT_K
-        dprintf("DMA[M->M][seg]:   Looping %x 16 burst length 8-byte transfer(s).\n", loopcount);
-	    #endif
+            #ifdef PRINT_K
+            dprintf("DMA[M->M][seg]:   Looping %x %u burst length %u-byte transfer(s).\n", loopcount, length, width);
+            #endif
             if ((status == ALT_E_SUCCESS) && (loopcount > 1))
             {
                 status = alt_dma_program_DMALP(program, loopcount);
@@ -1397,16 +1487,16 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         }
     }
 
-    // At this point, we should have [burstcount] 8-byte transfer(s)
-    // remaining. [burstcount] should be less than 16. //
+    // At this point, we should have [burstcount] [width]-byte transfer(s)
+    // remaining. [burstcount] should be less than [length]. //
 
     // Do one more burst with a SB / DB of length [burstcount]. //
 
     if (burstcount)
     {
         // Program in the following parameters:
-         //  - SS64  : Source      burst size of 8-byte
-         //  - DS64  : Destination burst size of 8-byte
+         //  - SSx   : Source      burst size of [width] bytes
+         //  - DSx   : Destination burst size of [width] bytes
          //  - SBx   : Source      burst length of [burstlength] transfer(s)
          //  - DBx   : Destination burst length of [burstlength] transfer(s)
          //  - SC(7) : Source      cacheable write-back, allocate on reads only
@@ -1417,13 +1507,13 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         {
             status = alt_dma_program_DMAMOV(program, ALT_DMA_PROGRAM_REG_CCR,
                                             (   ((burstcount - 1) << 4) // SB //
-                                              | ALT_DMA_CCR_OPT_SS64
+                                              | (sizecode << 1) // SS //
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
                                               //| ALT_DMA_CCR_OPT_SC(7)
                                               | ALT_DMA_RC_ON
                                               | ((burstcount - 1) << 18) // DB //
-                                              | ALT_DMA_CCR_OPT_DS64
+                                              | (sizecode << 15) // DS //
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
                                               //| ALT_DMA_CCR_OPT_DC(7)
@@ -1442,7 +1532,7 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         }
     }
 
-    // Corrections may be needed if usrc and udst are relatively 8-byte unaligned
+    // Corrections may be needed if usrc and udst are relatively [width]-byte unaligned
     // and bursts were previously used. //
 
     if (correction)
@@ -1452,7 +1542,7 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
             // This is the number of 1-byte corrections DMAST needed.
             // This is determined by how many remaining data is in the MFIFO after
             // the burst(s) have completed. //
-            int correctcount = (segdstpa + (8 - (segsrcpa & 0x7))) & 0x7;
+            int correctcount = (segdstpa + (width - (segsrcpa & wmask))) & wmask;
             #ifdef PRINT_K
             dprintf("DMA[M->M][seg]: Total correction 1-byte burst size transfer(s): %u.\n", correctcount);
             #endif
@@ -1488,7 +1578,7 @@ static ALT_STATUS_CODE alt_dma_memory_to_memory_segment(ALT_DMA_PROGRAM_t * prog
         }
     }
 
-    // At this point, there should be 0 - 7 1-byte transfers remaining. //
+    // At this point, there should be 0 - [width - 1] 1-byte transfers remaining. //
 
     if (sizeleft)
     {
@@ -1661,7 +1751,7 @@ ALT_STATUS_CODE alt_dma_memory_to_memory(ALT_DMA_CHANNEL_t channel,
                 //We did investigations in the baremetal programs and they transfer all at once always
                 //Even when transferring 2MB. Therefore we know the transfer can be done at once.
                 //If we comment all this code we delete the dependency with mmu files.
-                status = alt_dma_memory_to_memory_segment(programv, (uintptr_t) dst, (uintptr_t) src, size);
+                status = alt_dma_memory_to_memory_segment(programv, (uintptr_t) dst, (uintptr_t) src, size, &alt_dma_burst_default);
                 ///////------------------------------------------------------///
  /*           }
 
@@ -1742,14 +1832,15 @@ ALT_STATUS_CODE alt_dma_memory_to_memory(ALT_DMA_CHANNEL_t channel,
     return alt_dma_channel_exec(channel, programh);
 }
 
-ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t channel,
+ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program_burst(ALT_DMA_CHANNEL_t channel,
                                          ALT_DMA_PROGRAM_t * programv, //virtual address of DMAC microcode program (to be used in kernel space)
 					 ALT_DMA_PROGRAM_t * programh, //hardware address, to be used by the DMAC to find the program
                                          void * dst,
                                          const void * src,
                                          size_t size,
                                          bool send_evt,
-                                         ALT_DMA_EVENT_t evt)
+                                         ALT_DMA_EVENT_t evt,
+                                         const ALT_DMA_BURST_t * burst)
 {
     ALT_STATUS_CODE status = ALT_E_SUCCESS;
 
@@ -1867,7 +1958,7 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                 //We did investigations in the baremetal programs and they transfer all at once always
                 //Even when transferring 2MB. Therefore we know the transfer can be done at once.
                 //If we comment all this code we delete the dependency with mmu files.
-                status = alt_dma_memory_to_memory_segment(programv, (uintptr_t) dst, (uintptr_t) src, size);
+                status = alt_dma_memory_to_memory_segment(programv, (uintptr_t) dst, (uintptr_t) src, size, burst);
                 ///////------------------------------------------------------///
  /*           }
 
@@ -1923,8 +2014,8 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
         {
             #ifdef PRINT_K
             dprintf("DMA[M->M]: Adding event ...\n");
-            status = alt_dma_program_DMASEV(programv, evt);
             #endif
+            status = alt_dma_program_DMASEV(programv, evt);
         }
     }
 
@@ -1948,7 +2039,146 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
     return ALT_E_SUCCESS;
 }
 
-/*static ALT_STATUS_CODE alt_dma_zero_to_memory_segment(ALT_DMA_PROGRAM_t * program,
+ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t channel,
+                                         ALT_DMA_PROGRAM_t * programv, //virtual address of DMAC microcode program (to be used in kernel space)
+					 ALT_DMA_PROGRAM_t * programh, //hardware address, to be used by the DMAC to find the program
+                                         void * dst,
+                                         const void * src,
+                                         size_t size,
+                                         bool send_evt,
+                                         ALT_DMA_EVENT_t evt)
+{
+    return alt_dma_memory_to_memory_only_prepare_program_burst(channel, programv, programh,
+                                         dst, src, size, send_evt, evt, &alt_dma_burst_default);
+}
+
+ALT_STATUS_CODE alt_dma_memory_to_memory_append(ALT_DMA_PROGRAM_t * programv,
+                                                void * dst,
+                                                const void * src,
+                                                size_t size)
+{
+    return alt_dma_memory_to_memory_append_burst(programv, dst, src, size,
+                                                 &alt_dma_burst_default);
+}
+
+ALT_STATUS_CODE alt_dma_memory_to_memory_append_burst(ALT_DMA_PROGRAM_t * programv,
+                                                      void * dst,
+                                                      const void * src,
+                                                      size_t size,
+                                                      const ALT_DMA_BURST_t * burst)
+{
+    ALT_STATUS_CODE status;
+
+    // Save the state of the program to undo the segment if it does not fit. //
+    uint32_t flag      = programv->flag;
+    uint16_t code_size = programv->code_size;
+    uint16_t loop0     = programv->loop0;
+    uint16_t loop1     = programv->loop1;
+    uint16_t sar       = programv->sar;
+    uint16_t dar       = programv->dar;
+
+    if (size == 0)
+    {
+        return ALT_E_SUCCESS;
+    }
+
+    status = alt_dma_memory_to_memory_segment(programv, (uintptr_t) dst, (uintptr_t) src, size, burst);
+
+    // Keep space for the instructions added by alt_dma_memory_to_memory_finish(). //
+    if ((status == ALT_E_SUCCESS) &&
+        ((programv->code_size + ALT_DMA_PROGRAM_FINISH_SIZE) > ALT_DMA_PROGRAM_PROVISION_BUFFER_SIZE))
+    {
+        status = ALT_E_BUF_OVF;
+    }
+
+    if (status != ALT_E_SUCCESS)
+    {
+        programv->flag      = flag;
+        programv->code_size = code_size;
+        programv->loop0     = loop0;
+        programv->loop1     = loop1;
+        programv->sar       = sar;
+        programv->dar       = dar;
+    }
+
+    return status;
+}
+
+ALT_STATUS_CODE alt_dma_memory_to_memory_finish(ALT_DMA_CHANNEL_t channel,
+                                                ALT_DMA_PROGRAM_t * programv,
+                                                ALT_DMA_PROGRAM_t * programh,
+                                                bool send_evt,
+                                                ALT_DMA_EVENT_t evt)
+{
+    ALT_STATUS_CODE status = ALT_E_SUCCESS;
+
+    // Send event if requested. //
+    if (send_evt)
+    {
+        if (status == ALT_E_SUCCESS)
+        {
+            status = alt_dma_program_DMAWMB(programv);
+        }
+        if (status == ALT_E_SUCCESS)
+        {
+            status = alt_dma_program_DMASEV(programv, evt);
+        }
+    }
+
+    // Now that everything is done, end the program. //
+    if (status == ALT_E_SUCCESS)
+    {
+        status = alt_dma_program_DMAEND(programv);
+    }
+
+    if (status != ALT_E_SUCCESS)
+    {
+        alt_dma_program_clear(programv);
+        return status;
+    }
+
+    // Execute the program on the given channel. //
+    return alt_dma_channel_exec(channel, programh);
+}
+
+ALT_STATUS_CODE alt_dma_memory_to_memory_patch(ALT_DMA_PROGRAM_t * programv,
+                                               void * dst,
+                                               const void * src)
+{
+    ALT_STATUS_CODE status;
+    uint32_t diff_src;
+    uint32_t diff_dst;
+
+    // The difference with the addresses in the program must keep the 8-byte
+    // alignment, so the pre-alignment and correction bursts are still valid. //
+    status = alt_dma_program_progress_reg(programv, ALT_DMA_PROGRAM_REG_SAR,
+                                          (uint32_t)(uintptr_t) src, &diff_src);
+    if (status == ALT_E_SUCCESS)
+    {
+        status = alt_dma_program_progress_reg(programv, ALT_DMA_PROGRAM_REG_DAR,
+                                              (uint32_t)(uintptr_t) dst, &diff_dst);
+    }
+    if (status != ALT_E_SUCCESS)
+    {
+        return status;
+    }
+    if ((diff_src & 0x7) || (diff_dst & 0x7))
+    {
+        return ALT_E_BAD_ARG;
+    }
+
+    status = alt_dma_program_update_reg(programv, ALT_DMA_PROGRAM_REG_SAR,
+                                        (uint32_t)(uintptr_t) src);
+    if (status == ALT_E_SUCCESS)
+    {
+        status = alt_dma_program_update_reg(programv, ALT_DMA_PROGRAM_REG_DAR,
+                                            (uint32_t)(uintptr_t) dst);
+    }
+
+    return status;
+}
+
+static ALT_STATUS_CODE alt_dma_zero_to_memory_segment(ALT_DMA_PROGRAM_t * program,
                                                       uintptr_t segbufpa,
                                                       size_t segsize)
 {
@@ -1958,8 +2188,8 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
     uint32_t loop0;
     uint32_t loop1;
 
-    dprintf("DMA[Z->M][seg]: buf  = 0x%x (PA).\n", segbufpa);
-    dprintf("DMA[Z->M][seg]: size = 0x%x.\n",      segsize);
+    //dprintf("DMA[Z->M][seg]: buf  = 0x%x (PA).\n", segbufpa);
+    //dprintf("DMA[Z->M][seg]: size = 0x%x.\n",      segsize);
 
     if (status == ALT_E_SUCCESS)
     {
@@ -1972,12 +2202,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
         uint32_t aligncount = ALT_MIN(8 - (segbufpa & 0x7), sizeleft);
         sizeleft -= aligncount;
 
-        dprintf("DMA[Z->M][seg]: Total pre-alignment 1-byte burst size transfer(s): %" PRIu32 ".\n", aligncount);
+        //dprintf("DMA[Z->M][seg]: Total pre-alignment 1-byte burst size transfer(s): %" PRIu32 ".\n", aligncount);
 
         // Program in the following parameters:
          //  - DS8   : Destination burst size of 1-byte
          //  - DBx   : Destination burst length of [aligncount] transfer(s)
-         //  - DC(7) : Destination cacheable write-back, allocate on writes only
+         //  - WC_ON : Destination cacheable write-back (ALT_DMA_WC_ON)
          //  - All other options default. //
 
         if (status == ALT_E_SUCCESS)
@@ -1987,12 +2217,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                                               | ALT_DMA_CCR_OPT_SS_DEFAULT
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_SC_DEFAULT
+                                              | ALT_DMA_RC_ON
                                               | ((aligncount - 1) << 18) /// DB //
                                               | ALT_DMA_CCR_OPT_DS8
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_DC(7)
+                                              | ALT_DMA_WC_ON
                                               | ALT_DMA_CCR_OPT_ES_DEFAULT
                                             )
                 );
@@ -2009,7 +2239,7 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
     // Update the size left to transfer //
     sizeleft &= 0x7;
 
-    dprintf("DMA[Z->M][seg]: Total Main 8-byte burst size transfer(s): %" PRIu32 ".\n", burstcount);
+    //dprintf("DMA[Z->M][seg]: Total Main 8-byte burst size transfer(s): %" PRIu32 ".\n", burstcount);
 
     // Determine how many 16 length bursts can be done //
     if (burstcount >> 4)
@@ -2017,13 +2247,13 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
         uint32_t length16burstcount = burstcount >> 4;
         burstcount &= 0xf;
 
-        dprintf("DMA[Z->M][seg]:   Number of 16 burst length 8-byte transfer(s): %" PRIu32 ".\n", length16burstcount);
-        dprintf("DMA[Z->M][seg]:   Number of remaining 8-byte transfer(s):       %" PRIu32 ".\n", burstcount);
+        //dprintf("DMA[Z->M][seg]:   Number of 16 burst length 8-byte transfer(s): %" PRIu32 ".\n", length16burstcount);
+        //dprintf("DMA[Z->M][seg]:   Number of remaining 8-byte transfer(s):       %" PRIu32 ".\n", burstcount);
 
         // Program in the following parameters:
         //  - DS64  : Destination burst size of 8-byte
          //  - DB16  : Destination burst length of 16 transfers
-         //  - DC(7) : Destination cacheable write-back, allocate on writes only
+         //  - WC_ON : Destination cacheable write-back (ALT_DMA_WC_ON)
          //  - All other options default. /////
 
         if (status == ALT_E_SUCCESS)
@@ -2033,12 +2263,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                                               | ALT_DMA_CCR_OPT_SS_DEFAULT
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_SC_DEFAULT
+                                              | ALT_DMA_RC_ON
                                               | ALT_DMA_CCR_OPT_DB16
                                               | ALT_DMA_CCR_OPT_DS64
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_DC(7)
+                                              | ALT_DMA_WC_ON
                                               | ALT_DMA_CCR_OPT_ES_DEFAULT
                                             )
                 );
@@ -2063,7 +2293,7 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
 
             length16burstcount -= loop0 * loop1;
 
-            dprintf("DMA[Z->M][seg]:   Looping %" PRIu32 "x 16 burst length 8-byte transfer(s).\n", loop0*loop1);
+            //dprintf("DMA[Z->M][seg]:   Looping %" PRIu32 "x 16 burst length 8-byte transfer(s).\n", loop0*loop1);
 
             if ((status == ALT_E_SUCCESS) && (loop0 > 1))
             {
@@ -2098,7 +2328,7 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
         // Program in the following parameters:
          //  - DS64  : Destination burst size of 8-byte
          //  - DBx   : Destination burst length of [burstlength] transfer(s)
-         //  - DC(7) : Destination cacheable write-back, allocate on writes only
+         //  - WC_ON : Destination cacheable write-back (ALT_DMA_WC_ON)
          //  - All other options default. //
 
         if (status == ALT_E_SUCCESS)
@@ -2108,12 +2338,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                                               | ALT_DMA_CCR_OPT_SS_DEFAULT
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_SC_DEFAULT
+                                              | ALT_DMA_RC_ON
                                               | ((burstcount - 1) << 18) // DB //
                                               | ALT_DMA_CCR_OPT_DS64
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_DC(7)
+                                              | ALT_DMA_WC_ON
                                               | ALT_DMA_CCR_OPT_ES_DEFAULT
                                             )
                 );
@@ -2128,12 +2358,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
 
     if (sizeleft)
     {
-        dprintf("DMA[Z->M][seg]: Total post 1-byte burst size transfer(s): %u.\n", sizeleft);
+        //dprintf("DMA[Z->M][seg]: Total post 1-byte burst size transfer(s): %u.\n", sizeleft);
 
         // Program in the following parameters:
          //  - DS8   : Destination burst size of 1-byte
          //  - DBx   : Destination burst length of [sizeleft] transfer(s)
-         //  - DC(7) : Destination cacheable write-back, allocate on writes only
+         //  - WC_ON : Destination cacheable write-back (ALT_DMA_WC_ON)
          //  - All other options default. //
 
         if (status == ALT_E_SUCCESS)
@@ -2143,12 +2373,12 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                                               | ALT_DMA_CCR_OPT_SS_DEFAULT
                                               | ALT_DMA_CCR_OPT_SA_DEFAULT
                                               | ALT_DMA_CCR_OPT_SP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_SC_DEFAULT
+                                              | ALT_DMA_RC_ON
                                               | ((sizeleft - 1) << 18) // DB //
                                               | ALT_DMA_CCR_OPT_DS8
                                               | ALT_DMA_CCR_OPT_DA_DEFAULT
                                               | ALT_DMA_CCR_OPT_DP_DEFAULT
-                                              | ALT_DMA_CCR_OPT_DC(7)
+                                              | ALT_DMA_WC_ON
                                               | ALT_DMA_CCR_OPT_ES_DEFAULT
                                             )
                 );
@@ -2163,8 +2393,9 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
 }
 
 ALT_STATUS_CODE alt_dma_zero_to_memory(ALT_DMA_CHANNEL_t channel,
-                                       ALT_DMA_PROGRAM_t * program,
-                                       void * buf,
+                                       ALT_DMA_PROGRAM_t * programv, //virtual address of DMAC microcode program (to be used in kernel space)
+                                       ALT_DMA_PROGRAM_t * programh, //hardware address, to be used by the DMAC to find the program
+                                       void * buf, //hardware address of the buffer
                                        size_t size,
                                        bool send_evt,
                                        ALT_DMA_EVENT_t evt)
@@ -2179,79 +2410,34 @@ ALT_STATUS_CODE alt_dma_zero_to_memory(ALT_DMA_CHANNEL_t channel,
 
     if (status == ALT_E_SUCCESS)
     {
-        status = alt_dma_program_init(program);
+        status = alt_dma_program_init(programv);
     }
 
-    if (size != 0)
+    // The buffer is physically contiguous so there is no coalescing (as in
+    // alt_dma_memory_to_memory()): it is cleared with one segment. //
+    if ((status == ALT_E_SUCCESS) && (size != 0))
     {
-        // Detect if memory region overshoots the address space.
-         // This error checking is handled by the coalescing API. //
-
-        //
-         // Attempt to coalesce and make the transfer.
-        ///
-
-        ALT_MMU_VA_TO_PA_COALESCE_t coalesce;
-
-        dprintf("DMA[Z->M]: buf  = %p (VA).\n", buf);
-        dprintf("DMA[Z->M]: size = 0x%x.\n",    size);
-
-        if (status == ALT_E_SUCCESS)
-        {
-            status = alt_mmu_va_to_pa_coalesce_begin(&coalesce, buf, size);
-        }
-
-        while (size)
-        {
-            //
-             // Extract the next segment.
-             ////
-
-            uintptr_t segpa   = 0;
-            uint32_t  segsize = 0;
-
-            if (status != ALT_E_SUCCESS)
-            {
-                break;
-            }
-
-            status = alt_mmu_va_to_pa_coalesce_next(&coalesce, &segpa, &segsize);
-
-            size -= segsize;
-            dprintf("DMA[Z->M]: Next segment PA = 0x%x, size = 0x%" PRIx32 "; remaining = 0x%x.\n", segpa, segsize, size);
-
-            //
-             // Zero out the current segment.
-             // //
-
-            if (status == ALT_E_SUCCESS)
-            {
-                status = alt_dma_zero_to_memory_segment(program,
-                                                        segpa,
-                                                        segsize);
-            }
-        }
+        status = alt_dma_zero_to_memory_segment(programv, (uintptr_t) buf, size);
+    }
 
+    /// Send event if requested. //
+    if (send_evt)
+    {
         if (status == ALT_E_SUCCESS)
         {
-            status = alt_mmu_va_to_pa_coalesce_end(&coalesce);
+            status = alt_dma_program_DMAWMB(programv);
         }
-    } // if (size != 0) //
 
-    /// Send event if requested. //
-    if (send_evt)
-    {
         if (status == ALT_E_SUCCESS)
         {
-            dprintf("DMA[Z->M]: Adding event ...\n");
-            status = alt_dma_program_DMASEV(program, evt);
+            status = alt_dma_program_DMASEV(programv, evt);
         }
     }
 
     // Now that everything is done, end the program. //
     if (status == ALT_E_SUCCESS)
     {
-        status = alt_dma_program_DMAEND(program);
+        status = alt_dma_program_DMAEND(programv);
     }
 
     // If there was a problem assembling the program, clean up the buffer and exit. //
@@ -2259,13 +2445,13 @@ ALT_STATUS_CODE alt_dma_zero_to_memory(ALT_DMA_CHANNEL_t channel,
     {
         //Do not report the status for the clear operation. A failure should be
         // reported regardless of if the clear is successful. //
-        alt_dma_program_clear(program);
+        alt_dma_program_clear(programv);
         return status;
     }
 
     // Execute the program on the given channel.//
-    return alt_dma_channel_exec(channel, program);
-}*/
+    return alt_dma_channel_exec(channel, programh);
+}
 
 /*static ALT_STATUS_CODE alt_dma_memory_to_register_segment(ALT_DMA_CHANNEL_t channel,
                                                           ALT_DMA_PROGRAM_t * program,
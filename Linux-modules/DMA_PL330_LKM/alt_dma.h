@@ -868,18 +868,176 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
                                          bool send_evt,
                                          ALT_DMA_EVENT_t evt);
 
+/*!
+ * This type defines the bursts used in the main part of a memory to memory
+ * transfer. The unaligned bytes at the start and at the end are always moved
+ * with beats of 1 byte.
+ */
+typedef struct ALT_DMA_BURST_s
+{
+    /*! Bytes of each beat: 1, 2, 4 or 8. */
+    uint32_t size;
+    /*! Beats of each burst: 1 to 16. */
+    uint32_t length;
+}
+ALT_DMA_BURST_t;
+
+/*!
+ * Same as alt_dma_memory_to_memory_only_prepare_program() with the given
+ * bursts instead of 16 beats of 8 bytes. Narrow or short bursts can be faster
+ * with slaves that split or stall wide bursts (i.e. 32-bit memories behind
+ * the lightweight HPS-to-FPGA bridge).
+ *
+ * \param       burst
+ *              Size and length of the bursts.
+ *
+ * \retval      ALT_E_SUCCESS   The operation was successful.
+ * \retval      ALT_E_ERROR     The operation failed.
+ * \retval      ALT_E_BAD_ARG   The given channel, event identifier or burst
+ *                              is invalid.
+ */
+ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program_burst(ALT_DMA_CHANNEL_t channel,
+                                         ALT_DMA_PROGRAM_t * programv,
+                                         ALT_DMA_PROGRAM_t * programh,
+                                         void * dest,
+                                         const void * src,
+                                         size_t size,
+                                         bool send_evt,
+                                         ALT_DMA_EVENT_t evt,
+                                         const ALT_DMA_BURST_t * burst);
+
+/*!
+ * Number of bytes of the instructions added at the end of the program by
+ * alt_dma_memory_to_memory_finish() (DMAWMB, DMASEV and DMAEND).
+ */
+#define ALT_DMA_PROGRAM_FINISH_SIZE 4
+
+/*!
+ * Appends to the program a segment copying the specified memory from the
+ * given source address to the given destination address. It is used to build
+ * programs with many segments (i.e. scatter-gather lists) calling
+ * alt_dma_program_init(), this function once per segment and
+ * alt_dma_memory_to_memory_finish() to end and execute the program.
+ *
+ * If the segment does not fit in the program buffer (always keeping
+ * ALT_DMA_PROGRAM_FINISH_SIZE bytes to end the program), the program is left
+ * as it was before the call and ALT_E_BUF_OVF is returned. The caller can then
+ * finish and execute the program and append the segment to a new program.
+ *
+ * \param       programv
+ *              Virtual address of the program being built.
+ *
+ * \param       dst
+ *              The destination memory address to copy to.
+ *
+ * \param       src
+ *              The source memory address to copy from.
+ *
+ * \param       size
+ *              The size of the segment in bytes.
+ *
+ * \retval      ALT_E_SUCCESS   The segment was added to the program.
+ * \retval      ALT_E_BUF_OVF   The segment does not fit in the program.
+ * \retval      ALT_E_ERROR     The operation failed.
+ */
+ALT_STATUS_CODE alt_dma_memory_to_memory_append(ALT_DMA_PROGRAM_t * programv,
+                                                void * dst,
+                                                const void * src,
+                                                size_t size);
+
+/*!
+ * Same as alt_dma_memory_to_memory_append() with the given bursts instead of
+ * 16 beats of 8 bytes (see ALT_DMA_BURST_t). Each segment of a program can
+ * use different bursts.
+ *
+ * \param       burst
+ *              Size and length of the bursts.
+ *
+ * \retval      ALT_E_SUCCESS   The segment was added to the program.
+ * \retval      ALT_E_BUF_OVF   The segment does not fit in the program.
+ * \retval      ALT_E_ERROR     The operation failed.
+ * \retval      ALT_E_BAD_ARG   The burst is invalid.
+ */
+ALT_STATUS_CODE alt_dma_memory_to_memory_append_burst(ALT_DMA_PROGRAM_t * programv,
+                                                      void * dst,
+                                                      const void * src,
+                                                      size_t size,
+                                                      const ALT_DMA_BURST_t * burst);
+
+/*!
+ * Ends a program built with alt_dma_memory_to_memory_append(), sending an
+ * event if requested, and executes it in the given channel.
+ *
+ * \param       channel
+ *              The DMA channel thread to use for the transfer.
+ *
+ * \param       programv
+ *              Virtual address of the program (used in kernel space).
+ *
+ * \param       programh
+ *              Hardware address of the program (used by the DMAC).
+ *
+ * \param       send_evt
+ *              If set to true, the DMA engine will be instructed to send an
+ *              event upon completion or fault.
+ *
+ * \param       evt
+ *              If send_evt is true, the event specified will be sent.
+ *              Otherwise the parameter is ignored.
+ *
+ * \retval      ALT_E_SUCCESS   The operation was successful.
+ * \retval      ALT_E_ERROR     The operation failed.
+ */
+ALT_STATUS_CODE alt_dma_memory_to_memory_finish(ALT_DMA_CHANNEL_t channel,
+                                                ALT_DMA_PROGRAM_t * programv,
+                                                ALT_DMA_PROGRAM_t * programh,
+                                                bool send_evt,
+                                                ALT_DMA_EVENT_t evt);
+
+/*!
+ * Changes the source and destination addresses of a program prepared with
+ * alt_dma_memory_to_memory_only_prepare_program(), so a program can be used
+ * as a template for all the transfers of the same size. Only the immediates
+ * of the first DMAMOV SAR and DMAMOV DAR are written (see
+ * alt_dma_program_update_reg()), the rest of the program is not changed.
+ *
+ * The instructions generated for the unaligned bytes depend on the 8-byte
+ * alignment of the addresses, so the new addresses must have the same
+ * alignment as the ones used to prepare the program. The program must not be
+ * running in any channel.
+ *
+ * \param       programv
+ *              Virtual address of the prepared program.
+ *
+ * \param       dst
+ *              The new destination memory address.
+ *
+ * \param       src
+ *              The new source memory address.
+ *
+ * \retval      ALT_E_SUCCESS   The program was patched.
+ * \retval      ALT_E_BAD_ARG   The program has no SAR or DAR, or the new
+ *                              addresses have a different 8-byte alignment.
+ */
+ALT_STATUS_CODE alt_dma_memory_to_memory_patch(ALT_DMA_PROGRAM_t * programv,
+                                               void * dst,
+                                               const void * src);
+
 /*!
  * Uses the DMA engine to asynchronously zero out the specified memory buffer.
  *
  * \param       channel
  *              The DMA channel thread to use for the transfer.
  *
- * \param       program
+ * \param       programv
  *              An allocated DMA program buffer to use for the life of the
- *              transfer.
+ *              transfer (virtual address, used to write the program).
+ *
+ * \param       programh
+ *              Hardware address of programv, used by the DMAC.
  *
  * \param       buf
- *              The buffer memory address to zero out.
+ *              The hardware address of the buffer to zero out.
  *
  * \param       size
  *              The size of the buffer in bytes.
@@ -898,7 +1056,8 @@ ALT_STATUS_CODE alt_dma_memory_to_memory_only_prepare_program(ALT_DMA_CHANNEL_t
  *                              used) is invalid.
  */
 ALT_STATUS_CODE alt_dma_zero_to_memory(ALT_DMA_CHANNEL_t channel,
-                                       ALT_DMA_PROGRAM_t * program,
+                                       ALT_DMA_PROGRAM_t * programv,
+                                       ALT_DMA_PROGRAM_t * programh,
                                        void * buf,
                                        size_t size,
                                        bool send_evt,
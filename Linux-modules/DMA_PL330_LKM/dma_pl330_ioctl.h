@@ -0,0 +1,264 @@
+/**
+ * @file    dma_pl330_ioctl.h
+ * @brief  Definitions shared between the DMA_PL330_LKM module and the
+ * applications using /dev/dma_pl330 (mmap offsets and ioctl commands).
+ *
+ * This file is included from kernel space (DMA_PL330_LKM.c) and from
+ * application space (see Linux-applications/Test_DMA_PL330_LKM).
+*/
+#ifndef __DMA_PL330_IOCTL_H__
+#define __DMA_PL330_IOCTL_H__
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+//--------------------------MMAP OFFSETS----------------------------//
+//The staging buffers of the driver can be mapped into the application using
+//mmap() on /dev/dma_pl330. The offset passed to mmap() selects the buffer:
+//-DMA_PL330_MMAP_NON_CACHED: uncached buffer (dma_alloc_coherent). The DMAC
+// accesses it through the L3-to-SDRAMC port.
+//-DMA_PL330_MMAP_CACHED: cached buffer (kmalloc). The DMAC accesses it through
+// ACP so it is coherent with the processor caches.
+//The same offsets are used in the offset field of struct dma_pl330_xfer to
+//tell the driver the buffer and the position inside it where data is.
+#define DMA_PL330_MMAP_NON_CACHED 0x00000000
+#define DMA_PL330_MMAP_CACHED     0x10000000
+//-DMA_PL330_MMAP_RING: submission/completion ring of the file (see below).
+#define DMA_PL330_MMAP_RING       0x20000000
+//-DMA_PL330_MMAP_CAPTURE: header of the cyclic capture of the file (see below).
+#define DMA_PL330_MMAP_CAPTURE    0x30000000
+
+//-----------------------------IOCTLS-------------------------------//
+#define DMA_PL330_IOC_MAGIC 'P'
+
+//Direction of the transfer
+#define DMA_PL330_DIR_TO_FPGA   0 //from the staging buffer to the FPGA
+#define DMA_PL330_DIR_FROM_FPGA 1 //from the FPGA to the staging buffer
+
+//Transfer between a mapped staging buffer and the FPGA
+struct dma_pl330_xfer {
+  __u32 offset; //mmap offset of the data (selects buffer and position)
+  __u32 len;    //size of the transfer in Bytes
+  __u32 dir;    //DMA_PL330_DIR_TO_FPGA or DMA_PL330_DIR_FROM_FPGA
+  __u32 fpga_addr; //physical address in the FPGA (0 means fpga_addr of the file)
+};
+
+//Start a transfer on data already in a mapped staging buffer and wait for it
+#define DMA_PL330_IOC_XFER _IOW(DMA_PL330_IOC_MAGIC, 1, struct dma_pl330_xfer)
+
+//Transfer between a buffer of the application (i.e. malloc()) and the FPGA.
+//The pages of the buffer are pinned and the DMA accesses them directly, so
+//there is no copy to the staging buffers and no limit in the size.
+struct dma_pl330_xfer_user {
+  __u64 addr;      //virtual address of the buffer in the application
+  __u32 len;       //size of the transfer in Bytes
+  __u32 dir;       //DMA_PL330_DIR_TO_FPGA or DMA_PL330_DIR_FROM_FPGA
+  __u32 fpga_addr; //physical address in the FPGA (0 means fpga_addr of the file)
+  __u32 reserved;
+};
+
+//Do a transfer from/to a buffer of the application and wait for it
+#define DMA_PL330_IOC_XFER_USER _IOW(DMA_PL330_IOC_MAGIC, 4, struct dma_pl330_xfer_user)
+
+//Many transfers between mapped staging buffers and the FPGA moved with one
+//DMA program (one segment per descriptor). Use it for many small records.
+#define DMA_PL330_BATCH_MAX 256
+
+struct dma_pl330_batch {
+  __u64 xfers;    //address of an array of struct dma_pl330_xfer
+  __u32 count;    //number of descriptors in the array (max DMA_PL330_BATCH_MAX)
+  __u32 reserved;
+};
+
+//Do all the transfers of the array and wait for them
+#define DMA_PL330_IOC_XFER_BATCH _IOW(DMA_PL330_IOC_MAGIC, 7, struct dma_pl330_batch)
+
+//Transfer between two physical regions outside processor memory (i.e. two
+//windows of the FPGA). The data does not go through the staging buffers so
+//the SDRAM is not used. src and dst must be inside the HPS-to-FPGA bridge
+//(0xC0000000-0xFBFFFFFF) or the lightweight bridge (0xFF200000-0xFF3FFFFF),
+//as all the FPGA addresses given by the application (fpga_addr fields of the
+//other structs and of the ring descriptors). HPS On-Chip RAM
+//(0xFFFF0000-0xFFFFFFFF) cannot be used and returns -EINVAL: the module keeps
+//there the microcode of all the channels and its cache of programs.
+struct dma_pl330_p2p {
+  __u32 src;  //physical address of the source
+  __u32 dst;  //physical address of the destiny
+  __u32 len;  //size of the transfer in Bytes
+  __u32 reserved;
+};
+
+//Do a transfer between two physical regions and wait for it
+#define DMA_PL330_IOC_XFER_P2P _IOW(DMA_PL330_IOC_MAGIC, 8, struct dma_pl330_p2p)
+
+//Cyclic capture from a fixed FPGA address (i.e. the FIFO of an ADC). The
+//DMA writes the ring again and again without stopping, period after period,
+//until DMA_PL330_IOC_CAPTURE_STOP. The ring is in the staging buffers (mapped
+//with mmap() as usual). After the start, mmap(DMA_PL330_MMAP_CAPTURE) maps a
+//struct dma_pl330_capture_hdr. Period n is in the ring at
+//(n % periods)*period_size. Needs the IRQs of the DMAC.
+#define DMA_PL330_CAPTURE_BURST 128 //period_size must be a multiple of this
+
+struct dma_pl330_capture {
+  __u32 offset;      //mmap offset of the ring (selects buffer and position)
+  __u32 period_size; //Bytes per period (max 256*DMA_PL330_CAPTURE_BURST)
+  __u32 periods;     //periods in the ring (2 to 256)
+  __u32 fpga_addr;   //physical address read in the FPGA (0 means fpga_addr
+                     //of the file). It is not incremented.
+};
+
+//head is only written by the driver and tail only by the application. The
+//periods from tail to head are ready. If head - tail > periods the DMA
+//overwrote periods not read yet. poll() reports POLLIN while head != tail.
+struct dma_pl330_capture_hdr {
+  __u32 head;        //periods completed since the start
+  __u32 tail;        //periods consumed by the application
+  __u32 periods;
+  __u32 period_size;
+};
+
+//Start the capture. The channel of the file cannot be used for other
+//transfers until it is stopped (-EBUSY).
+#define DMA_PL330_IOC_CAPTURE_START _IOW(DMA_PL330_IOC_MAGIC, 9, struct dma_pl330_capture)
+//Stop the capture
+#define DMA_PL330_IOC_CAPTURE_STOP _IO(DMA_PL330_IOC_MAGIC, 10)
+
+//Transfer with flow control between a staging buffer and a FIFO in the FPGA
+//(i.e. a FIFO of Qsys) connected to a peripheral request interface of the
+//DMAC (f2h_dma_req signals of the HPS). The DMA waits for the request of the
+//FIFO before each burst, so the CPU does not poll the FIFO. The FIFO must
+//request a burst when it has space for (or data of) burst*8 Bytes.
+struct dma_pl330_periph {
+  __u32 offset;    //mmap offset of the data (selects buffer and position)
+  __u32 len;       //size of the transfer (multiple of burst*8 Bytes)
+  __u32 dir;       //DMA_PL330_DIR_TO_FPGA or DMA_PL330_DIR_FROM_FPGA
+  __u32 fpga_addr; //physical address of the FIFO (0 means fpga_addr of the
+                   //file). It is not incremented.
+  __u32 periph;    //peripheral request interface (0 to 7 for FPGA_0 to FPGA_7)
+  __u32 burst;     //beats of 8 Bytes per request (1 to 16)
+};
+
+//Do a transfer with flow control and wait for it
+#define DMA_PL330_IOC_XFER_PERIPH _IOW(DMA_PL330_IOC_MAGIC, 11, struct dma_pl330_periph)
+
+//Fill a part of a staging buffer with the DMA instead of memset(), so the
+//caches of the processor are not used
+#define DMA_PL330_FILL_ZERO    0 //write zeros (any offset and len)
+#define DMA_PL330_FILL_PATTERN 1 //repeat pattern (offset and len multiple of 8)
+
+struct dma_pl330_fill {
+  __u32 offset;  //mmap offset of the data (selects buffer and position)
+  __u32 len;     //Bytes to fill
+  __u32 mode;    //DMA_PL330_FILL_ZERO or DMA_PL330_FILL_PATTERN
+  __u32 reserved;
+  __u64 pattern; //8 Bytes written in each 8 Bytes of the buffer (as stored
+                 //in memory by the processor)
+};
+
+//Fill and wait for it
+#define DMA_PL330_IOC_FILL _IOW(DMA_PL330_IOC_MAGIC, 12, struct dma_pl330_fill)
+
+//Priority classes of the files when several files share the DMAC (see
+//DMA_PL330_LKM_sched.c)
+#define DMA_PL330_CLASS_LATENCY 0 //short control messages, start at once
+#define DMA_PL330_CLASS_BULK    1 //big frames, moved in slices that wait for
+                                  //the transfers of the latency class
+#define DMA_PL330_CLASS_NUM     2
+
+//Burst profile: size (Bytes of each beat: 1, 2, 4 or 8) and length (beats of
+//each burst: 1 to 16) of the bursts of the transfers (see
+//DMA_PL330_LKM_burst.c)
+#define DMA_PL330_BURST(size, length) (((size) << 8) | (length))
+#define DMA_PL330_BURST_SIZE(burst)   (((burst) >> 8) & 0xff)
+#define DMA_PL330_BURST_LENGTH(burst) ((burst) & 0xff)
+
+//Configuration of the file. When a file is opened it takes the values of the
+//sysfs entries in /sys/dma_pl330/pl330_lkm_attrs/. Later they can be changed
+//for this file only with DMA_PL330_IOC_SET_CONFIG, without parsing text.
+struct dma_pl330_config {
+  __u32 fpga_addr;  //physical address in the FPGA used by read(), write() and
+                    //transfers with fpga_addr 0 (0 means sysfs dma_buff_padd)
+  __u32 use_acp;    //1 read() and write() use the cached buffer through ACP,
+                    //0 the uncached buffer, 2 selects by the size of each
+                    //transfer (see sysfs acp_crossover)
+  __u32 prepare_microcode; //1 the microcode of read() and write() is prepared
+                    //now for transfer_size Bytes and reused in each call
+  __u32 transfer_size; //size of the prepared microcode in Bytes
+  __u32 sched_class; //DMA_PL330_CLASS_LATENCY or DMA_PL330_CLASS_BULK
+                     //(DMA_PL330_CLASS_BULK when the file is opened)
+  __u32 burst;       //DMA_PL330_BURST(size, length) for all the transfers of
+                     //the file or 0 to use the profile of the address window
+                     //(sysfs burst_profiles). 0 when the file is opened.
+};
+
+//Change the configuration of the file
+#define DMA_PL330_IOC_SET_CONFIG _IOW(DMA_PL330_IOC_MAGIC, 5, struct dma_pl330_config)
+//Get the configuration of the file
+#define DMA_PL330_IOC_GET_CONFIG _IOR(DMA_PL330_IOC_MAGIC, 6, struct dma_pl330_config)
+
+//-------------------SUBMISSION/COMPLETION RING----------------------//
+//Each file can have a ring shared with the application to do many transfers
+//without one syscall per transfer:
+//1-ioctl(DMA_PL330_IOC_RING_SETUP) creates the ring and returns its layout.
+//2-mmap(DMA_PL330_MMAP_RING) maps it: a struct dma_pl330_ring_hdr at offset 0,
+//  sq_entries struct dma_pl330_sqe at sq_off and cq_entries struct
+//  dma_pl330_cqe at cq_off.
+//3-The application writes descriptors in sq[sq_tail & (sq_entries-1)] and
+//  increments sq_tail. ioctl(DMA_PL330_IOC_RING_ENTER) submits them and the
+//  driver executes them in order in the DMA channel of the file.
+//4-For each finished descriptor the driver writes a completion in
+//  cq[cq_tail & (cq_entries-1)] and increments cq_tail. The application reads
+//  completions while cq_head != cq_tail and increments cq_head.
+//sq_head and cq_tail are only written by the driver. sq_tail and cq_head are
+//only written by the application. Use memory barriers between writing an
+//entry and its index.
+#define DMA_PL330_RING_MAX_ENTRIES 256
+
+struct dma_pl330_ring_hdr {
+  __u32 sq_head; //next descriptor to be consumed by the driver
+  __u32 sq_tail; //next free descriptor for the application
+  __u32 cq_head; //next completion to be read by the application
+  __u32 cq_tail; //next free completion for the driver
+};
+
+//Descriptor. The direction flag tells which address is in the FPGA:
+//-DMA_PL330_DIR_TO_FPGA: src is a mmap offset in the staging buffers (like
+// offset in struct dma_pl330_xfer) and dst a physical address in the FPGA.
+//-DMA_PL330_DIR_FROM_FPGA: src is a physical address in the FPGA and dst a
+// mmap offset in the staging buffers.
+//A physical address 0 means the fpga_addr of the file.
+struct dma_pl330_sqe {
+  __u32 src;
+  __u32 dst;
+  __u32 len;   //size of the transfer in Bytes
+  __u32 flags; //DMA_PL330_DIR_TO_FPGA or DMA_PL330_DIR_FROM_FPGA
+  __u64 user_data; //copied to the completion
+};
+
+//Completion
+struct dma_pl330_cqe {
+  __u64 user_data; //user_data of the descriptor
+  __s32 res; //0 if the transfer was correct or negative error code
+  __u32 reserved;
+};
+
+struct dma_pl330_ring_params {
+  __u32 sq_entries; //in: number of descriptors (power of 2, max 256)
+  __u32 cq_entries; //out: number of completions (2*sq_entries)
+  __u32 sq_off;     //out: offset of the descriptors in the ring
+  __u32 cq_off;     //out: offset of the completions in the ring
+  __u32 ring_size;  //out: size of the ring to mmap
+  __u32 reserved;
+};
+
+struct dma_pl330_ring_enter {
+  __u32 to_submit;    //max number of new descriptors to submit
+  __u32 min_complete; //wait until this number of completions are available
+};
+
+//Create the ring of the file
+#define DMA_PL330_IOC_RING_SETUP _IOWR(DMA_PL330_IOC_MAGIC, 2, struct dma_pl330_ring_params)
+//Submit descriptors and wait for completions. Returns number of submitted.
+#define DMA_PL330_IOC_RING_ENTER _IOW(DMA_PL330_IOC_MAGIC, 3, struct dma_pl330_ring_enter)
+
+#endif //__DMA_PL330_IOCTL_H__
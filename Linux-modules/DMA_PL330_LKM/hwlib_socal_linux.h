@@ -54,6 +54,11 @@ typedef int32_t             ALT_STATUS_CODE;
 /*! The buffer does not contain enough free space for the operation. */
 #define ALT_E_BUF_OVF               (-20)
 
+/*! Indicates a FALSE condition. */
+#define ALT_E_FALSE                 (0)
+/*! Indicates a TRUE condition. */
+#define ALT_E_TRUE                  (1)
+
 /*!
  * Provide base address of MPU address space
  */